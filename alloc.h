@@ -0,0 +1,119 @@
+// @Name   : ALLOC_H
+//
+// @Brief  : allocator hooks for the containers. a container keeps a
+//           copy of the allocator it was made with and a memstat it
+//           updates on every block it takes or gives back, so free
+//           and realloc are told the size of the block. a zeroed
+//           allocator, or a NULL one passed to a constructor, stands
+//           for malloc and free. with alloc set, a NULL realloc
+//           moves the block to a new one and a NULL free leaves the
+//           memory to the owner of ctx, as an arena would.
+
+#if !defined(ALLOC_H)
+#define ALLOC_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    void* (*alloc)  (void* ctx, size_t size);
+    void* (*realloc)(void* ctx, void* ptr, size_t old, size_t size);
+    void  (*free)   (void* ctx, void* ptr, size_t size);
+    void* ctx;
+}allocator;
+
+typedef struct {
+    size_t bytes;       /* live bytes */
+    size_t blocks;      /* live blocks */
+    size_t allocs;      /* blocks ever taken, reallocs included */
+}memstat;
+
+static inline void
+mem_init(allocator* a, memstat* st, const allocator* from)
+{
+    if( from )
+        *a = *from;
+    else
+        memset(a, 0, sizeof(*a));
+    memset(st, 0, sizeof(*st));
+}
+
+static inline void*
+mem_alloc(const allocator* a, memstat* st, size_t size)
+{
+    void* p = a->alloc ? a->alloc(a->ctx, size) : malloc(size);
+    if( p ) {
+        st->bytes += size;
+        st->blocks++;
+        st->allocs++;
+    }
+    return p;
+}
+
+/* calloc keeps the lazily zeroed pages of a big block from malloc */
+static inline void*
+mem_calloc(const allocator* a, memstat* st, size_t size)
+{
+    void* p;
+    if( a->alloc == NULL ) {
+        p = calloc(1, size);
+        if( p ) {
+            st->bytes += size;
+            st->blocks++;
+            st->allocs++;
+        }
+        return p;
+    }
+    p = mem_alloc(a, st, size);
+    if( p )
+        memset(p, 0, size);
+    return p;
+}
+
+/* on failure ptr is left as it was */
+static inline void*
+mem_realloc(const allocator* a, memstat* st, void* ptr,
+            size_t old, size_t size)
+{
+    void* p;
+    if( ptr == NULL )
+        return mem_alloc(a, st, size);
+    if( a->alloc == NULL )
+        p = realloc(ptr, size);
+    else if( a->realloc )
+        p = a->realloc(a->ctx, ptr, old, size);
+    else if( (p = a->alloc(a->ctx, size)) != NULL ) {
+        memcpy(p, ptr, old < size ? old : size);
+        if( a->free )
+            a->free(a->ctx, ptr, old);
+    }
+    if( p ) {
+        st->bytes += size - old;
+        st->allocs++;
+    }
+    return p;
+}
+
+static inline void
+mem_free(const allocator* a, memstat* st, void* ptr, size_t size)
+{
+    if( ptr == NULL )
+        return;
+    st->bytes -= size;
+    st->blocks--;
+    if( a->alloc == NULL )
+        free(ptr);
+    else if( a->free )
+        a->free(a->ctx, ptr, size);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
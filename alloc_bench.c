@@ -0,0 +1,186 @@
+// @Name   : alloc_bench.c
+//
+// @Brief  : malloc against a bump arena behind hs_new_alloc and
+//           jsw_snew_alloc, the two containers that take a block per
+//           item. a round builds a container, finds every key and
+//           deletes it; the arena frees nothing one by one and is
+//           reset after each round. the node memory the containers
+//           report is printed along.
+//           build with: make CFLAGS=-O2 alloc_bench
+//           usage: alloc_bench [keys] [rounds]
+
+#include "chainhash.h"
+#include "jsw_slib.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef unsigned int u32;
+typedef unsigned long long u64;
+
+#define CHUNK (1 << 22)   /* arena grows by this much at least */
+#define HEAD  ((sizeof(chunk) + 15) & ~(size_t)15)
+
+/* bump allocator over a list of chunks, the first one is kept over
+   a reset */
+typedef struct chunk {
+    struct chunk* next;
+    size_t size;
+    size_t used;
+}chunk;
+
+typedef struct {
+    chunk* head;
+}arena;
+
+static void* arena_alloc(void* ctx, size_t size)
+{
+    arena* a = (arena*)ctx;
+    chunk* c = a->head;
+    size = (size + 15) & ~(size_t)15;
+    if( c == NULL || c->used + size > c->size ) {
+        size_t n = size > CHUNK ? size : CHUNK;
+        c = (chunk*)malloc(HEAD + n);
+        if( c == NULL )
+            return NULL;
+        c->next = a->head;
+        c->size = n;
+        c->used = 0;
+        a->head = c;
+    }
+    c->used += size;
+    return (char*)c + HEAD + c->used - size;
+}
+
+static void arena_reset(arena* a)
+{
+    while( a->head && a->head->next ) {
+        chunk* c = a->head;
+        a->head = c->next;
+        free(c);
+    }
+    if( a->head )
+        a->head->used = 0;
+}
+
+/* keys are the pointer values themselves, nothing is dupped */
+static unsigned id_hash(const void* a)
+{
+    u32 key = (u32)(uintptr_t)a;
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static int id_cmp(const void* a, const void* b)
+{
+    return (uintptr_t)a < (uintptr_t)b ? -1 : (uintptr_t)a > (uintptr_t)b;
+}
+
+static void* id_dup(const void* key) { return (void*)key; }
+static void  id_rel(void* key) { (void)key; }
+
+static u64 now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char* name, u64 t[3], u64 ops, const memstat* mem)
+{
+    printf("%-16s build %7.2f  find %7.2f  delete %7.2f Mop/s"
+           "  %6.1f MB in %zu blocks\n", name,
+           ops * 1e3 / t[0], ops * 1e3 / t[1], ops * 1e3 / t[2],
+           mem->bytes / 1048576.0, mem->blocks);
+}
+
+static void bench_hash(const char* name, void** keys, u32 n, u32 rounds,
+                       const allocator* alloc, arena* a)
+{
+    u64 t[3] = {0, 0, 0}, s;
+    memstat mem;
+    u32 r, k;
+    for(r=0; r<rounds; r++) {
+        s = now_ns();
+        hs_table* hs = hs_new_alloc(n, &id_hash, &id_cmp, &id_dup, &id_dup,
+                                    &id_rel, &id_rel, alloc);
+        assert(hs);
+        for(k=0; k<n; k++)
+            hs_insert(hs, keys[k], keys[k]);
+        t[0] += now_ns() - s;
+        s = now_ns();
+        for(k=0; k<n; k++)
+            if( hs_find(hs, keys[k]) != keys[k] )
+                abort();
+        t[1] += now_ns() - s;
+        hs_mem(hs, &mem);
+        s = now_ns();
+        hs_delete(hs);
+        if( a )
+            arena_reset(a);
+        t[2] += now_ns() - s;
+    }
+    report(name, t, (u64)n * rounds, &mem);
+}
+
+static void bench_skip(const char* name, void** keys, u32 n, u32 rounds,
+                       const allocator* alloc, arena* a)
+{
+    u64 t[3] = {0, 0, 0}, s;
+    memstat mem;
+    u32 r, k;
+    for(r=0; r<rounds; r++) {
+        s = now_ns();
+        jsw_skip_t* skip = jsw_snew_alloc(24, &id_cmp, &id_dup, &id_rel,
+                                          alloc);
+        assert(skip);
+        for(k=0; k<n; k++)
+            jsw_sinsert(skip, keys[k]);
+        t[0] += now_ns() - s;
+        s = now_ns();
+        for(k=0; k<n; k++)
+            if( jsw_sfind(skip, keys[k]) != keys[k] )
+                abort();
+        t[1] += now_ns() - s;
+        jsw_smem(skip, &mem);
+        s = now_ns();
+        jsw_sdelete(skip);
+        if( a )
+            arena_reset(a);
+        t[2] += now_ns() - s;
+    }
+    report(name, t, (u64)n * rounds, &mem);
+}
+
+int main(int argc, char** argv)
+{
+    u32 n = argc > 1 ? (u32)atol(argv[1]) : 1000000;
+    u32 rounds = argc > 2 ? (u32)atol(argv[2]) : 5;
+    void** keys = (void**)malloc(sizeof(void*) * n);
+    arena a = {NULL};
+    allocator bump = {arena_alloc, NULL, NULL, &a};
+    u32 k, seed = 1;
+    assert(n > 0 && rounds > 0 && keys);
+    for(k=0; k<n; k++) {
+        seed = seed * 1103515245 + 12345;
+        keys[k] = (void*)(((uintptr_t)seed << 20) | (k + 1));
+    }
+
+    printf("%u keys, %u rounds\n", n, rounds);
+    bench_hash("chainhash malloc", keys, n, rounds, NULL, NULL);
+    bench_hash("chainhash arena", keys, n, rounds, &bump, &a);
+    bench_skip("skiplist malloc", keys, n / 4, rounds, NULL, NULL);
+    bench_skip("skiplist arena", keys, n / 4, rounds, &bump, &a);
+
+    arena_reset(&a);
+    free(a.head);
+    free(keys);
+    return 0;
+}
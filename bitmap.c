@@ -1,5 +1,5 @@
 
-// @Name   : bitmap.c 
+// @Name   : bitmap.c
 //
 // @Author : Yukang Chen (moorekang@gmail.com)
 // @Date   : 2012-03-01 22:07:09
@@ -10,47 +10,143 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include "bitmap.h"
 
-#define INDEX(a)  ((a)/(sizeof(u32)*8))
-#define OFFSET(a) ((a)%(sizeof(u32)*8))
+#define WORD_BITS 64
+#define INDEX(a)  ((a)/WORD_BITS)
+#define OFFSET(a) ((a)%WORD_BITS)
+#define BIT(a)    (1ULL << OFFSET(a))
+#define FULL      (~0ULL)
 
-#define first_bit0(x) (_first_onebit(~(x)))
-#define first_bit1(x)  (_first_onebit(x))
+/* index of the lowest one bit, begin with 0,
+   x must not be 0 */
+#define first_bit1(x) ((u32)__builtin_ctzll(x))
 
-/* ffs: if ret == 0 : no one bit found
-   return index is begin with 1,
-   this maybe just work in x86 platform */
-#if 0
-static inline int _first_onebit(u32 x)
+/* number of words needed to hold n bits */
+static inline u32
+words_of(u32 n)
 {
-    if (!x) {
-        return 0;
-    }
-    else {
-        int ret;
-        __asm__("bsfl %1, %0; incl %0" : "=r" (ret) : "r" (x));
-        return ret;
+    return INDEX(n) + (OFFSET(n) ? 1 : 0);
+}
+
+/* the table word as seen by a first1 (one) or first0 search */
+static inline u64
+word_of(const bitmap* bm, u32 idx, int one)
+{
+    return one ? bm->table[idx] : ~bm->table[idx];
+}
+
+static void bitmap_unmap(bitmap* bm);
+
+/* set bit idx in level 0 of a summary, and keep going up
+   while the word we touched was empty before */
+static inline void
+summary_mark(u64** sum, u32 nlevel, u32 idx)
+{
+    u32 l;
+    for(l = 0; l < nlevel; l++) {
+        u64 old = sum[l][INDEX(idx)];
+        sum[l][INDEX(idx)] = old | BIT(idx);
+        if(old)
+            break;
+        idx = INDEX(idx);
     }
 }
-#endif
 
-static inline int
-_first_onebit(u32 x) {
-    if (!x) {
-        return 0;
+/* clear bit idx in level 0 of a summary, and keep going up
+   while the word we touched became empty */
+static inline void
+summary_unmark(u64** sum, u32 nlevel, u32 idx)
+{
+    u32 l;
+    for(l = 0; l < nlevel; l++) {
+        sum[l][INDEX(idx)] &= ~BIT(idx);
+        if(sum[l][INDEX(idx)])
+            break;
+        idx = INDEX(idx);
     }
-    else {
-        int idx = 1;
-        while(x >0) {
-            if(x%2)
-                return idx;
-            else {
-                idx++;
-                x = x>>1;
-            }
+}
+
+/* recompute summary word w of level l from the level below,
+   the table for level 0 */
+static void
+summary_word(bitmap* bm, u32 l, u32 w)
+{
+    u32 i, end = (w + 1) * WORD_BITS;
+    u32 n = l ? bm->lcnt[l-1] : bm->cnt;
+    u64 one = 0, zero = 0;
+    if(end > n)
+        end = n;
+    for(i = w * WORD_BITS; i < end; i++) {
+        if(l == 0) {
+            one  |= (u64)(bm->table[i] != 0)    << OFFSET(i);
+            zero |= (u64)(bm->table[i] != FULL) << OFFSET(i);
+        } else {
+            one  |= (u64)(bm->ones[l-1][i] != 0)  << OFFSET(i);
+            zero |= (u64)(bm->zeros[l-1][i] != 0) << OFFSET(i);
         }
     }
+    bm->ones[l][w]  = one;
+    bm->zeros[l][w] = zero;
+}
+
+/* recompute levels from level l up, for the words covering
+   indexes [lo, hi] of the level below l */
+static void
+summary_refresh(bitmap* bm, u32 l, u32 lo, u32 hi)
+{
+    u32 w;
+    for(; l < bm->nlevel; l++) {
+        lo = INDEX(lo);
+        hi = INDEX(hi);
+        for(w = lo; w <= hi; w++)
+            summary_word(bm, l, w);
+    }
+}
+
+/* recompute every summary level from the table */
+static void
+summary_build(bitmap* bm)
+{
+    summary_refresh(bm, 0, 0, bm->cnt - 1);
+}
+
+/* fill in size, cnt and the summary level counts,
+   return the words taken by the table and all levels */
+static u32
+bitmap_layout(bitmap* bm, u32 size)
+{
+    u32 n, total;
+    bm->size = size;
+    bm->cnt  = words_of(size);
+
+    /* levels shrink by 64 until one word covers everything */
+    n = bm->cnt;
+    total = bm->cnt;
+    bm->nlevel = 0;
+    do {
+        n = words_of(n);
+        bm->lcnt[bm->nlevel++] = n;
+        total += 2 * n;
+    } while(n > 1);
+    assert(bm->nlevel <= BITMAP_MAX_LEVEL);
+    return total;
+}
+
+/* point the table and summary levels into one block */
+static void
+bitmap_bind(bitmap* bm, u64* block)
+{
+    u32 l;
+    bm->table = block;
+    block += bm->cnt;
+    for(l = 0; l < bm->nlevel; l++) {
+        bm->ones[l]  = block;
+        block += bm->lcnt[l];
+        bm->zeros[l] = block;
+        block += bm->lcnt[l];
+    }
 }
 
 bitmap* bitmap_new(u32 size)
@@ -58,21 +154,22 @@ bitmap* bitmap_new(u32 size)
     assert( size>0 && "size <= 0" );
     bitmap* bm = (bitmap*)malloc(sizeof(bitmap));
     assert(bm);
-    
-    u32 cnt = INDEX(size);
-    if(OFFSET(size))
-        cnt++;
-    assert(cnt);
 
-    bm->size = size;
-    bm->cnt  = cnt;
-    bm->table = (u32*)malloc(sizeof(u32) * cnt);
-    if(bm->table == NULL) {
+    u32 total = bitmap_layout(bm, size);
+    /* cache line aligned, a line of table is 512 bits */
+    size_t bytes = (sizeof(u64) * total + 63) & ~(size_t)63;
+    u64* block = (u64*)aligned_alloc(64, bytes);
+    if(block == NULL) {
         free(bm);
         return NULL;
     }
-    assert(bm->table);
-    memset(bm->table, 0, sizeof(bm->table[0]) * cnt);
+    memset(block, 0, sizeof(u64) * bm->cnt);
+    bitmap_bind(bm, block);
+    bm->map = NULL;
+    bm->maplen = 0;
+    bm->readonly = 0;
+    bm->version = 0;
+    summary_build(bm);
     return bm;
 }
 
@@ -80,71 +177,779 @@ void bitmap_del(bitmap* bm)
 {
     if(bm == NULL)
         return;
-    free(bm->table);
+    if(bm->map)
+        bitmap_unmap(bm);
+    else
+        free(bm->table);
     free(bm);
 }
 
-inline static
-void INIT(u32 val, u32* index, u32* offset)
-{
-    *index  = INDEX(val);
-    *offset = OFFSET(val);
-}
-
 void bitmap_set(bitmap* bm, u32 val)
 {
-    assert(val>=0 && val <= bm->size &&
-           "val out of range");
-    u32 index, offset;
-    INIT(val, &index, &offset);
-    bm->table[index] |= ( 0x1<<offset );
+    assert(val < bm->size && "val out of range");
+    assert(!bm->readonly && "bitmap is read only");
+    u32 index = INDEX(val);
+    u64 old = bm->table[index];
+    u64 now = old | BIT(val);
+    if(now == old)
+        return;
+    bm->table[index] = now;
+    bm->version++;
+    if(old == 0)
+        summary_mark(bm->ones, bm->nlevel, index);
+    if(now == FULL)
+        summary_unmark(bm->zeros, bm->nlevel, index);
 }
 
 void bitmap_clr(bitmap* bm, u32 val)
 {
-    assert(val>=0 && val <= bm->size &&
-           "val out of range");
-    u32 index, offset;
-    INIT(val, &index, &offset);
-    bm->table[index] &= ~( 0x1 << offset );
+    assert(val < bm->size && "val out of range");
+    assert(!bm->readonly && "bitmap is read only");
+    u32 index = INDEX(val);
+    u64 old = bm->table[index];
+    u64 now = old & ~BIT(val);
+    if(now == old)
+        return;
+    bm->table[index] = now;
+    bm->version++;
+    if(old == FULL)
+        summary_mark(bm->zeros, bm->nlevel, index);
+    if(now == 0)
+        summary_unmark(bm->ones, bm->nlevel, index);
 }
 
 int bitmap_tst(bitmap* bm, u32 val)
 {
-    assert(val>=0 && val <= bm->size &&
-           "val out of range");
-    u32 index, offset;
-    INIT(val, &index, &offset);
-    return bm->table[index] & (0x1 << offset );
+    assert(val < bm->size && "val out of range");
+    return (bm->table[INDEX(val)] >> OFFSET(val)) & 1;
+}
+
+/* set bits [from, to), whole words in the middle are filled
+   with memset and only their summary words are recomputed */
+void bitmap_set_range(bitmap* bm, u32 from, u32 to)
+{
+    assert(from <= to && to <= bm->size && "range out of bitmap");
+    assert(!bm->readonly && "bitmap is read only");
+    if(from == to)
+        return;
+    u32 first = INDEX(from), last = INDEX(to - 1);
+    u64 head = FULL << OFFSET(from);
+    u64 tail = FULL >> (WORD_BITS - 1 - OFFSET(to - 1));
+    if(first == last) {
+        bm->table[first] |= head & tail;
+    } else {
+        bm->table[first] |= head;
+        memset(bm->table + first + 1, 0xFF,
+               sizeof(u64) * (last - first - 1));
+        bm->table[last] |= tail;
+    }
+    summary_refresh(bm, 0, first, last);
+    bm->version++;
+}
+
+/* clear bits [from, to) */
+void bitmap_clr_range(bitmap* bm, u32 from, u32 to)
+{
+    assert(from <= to && to <= bm->size && "range out of bitmap");
+    assert(!bm->readonly && "bitmap is read only");
+    if(from == to)
+        return;
+    u32 first = INDEX(from), last = INDEX(to - 1);
+    u64 head = FULL << OFFSET(from);
+    u64 tail = FULL >> (WORD_BITS - 1 - OFFSET(to - 1));
+    if(first == last) {
+        bm->table[first] &= ~(head & tail);
+    } else {
+        bm->table[first] &= ~head;
+        memset(bm->table + first + 1, 0,
+               sizeof(u64) * (last - first - 1));
+        bm->table[last] &= ~tail;
+    }
+    summary_refresh(bm, 0, first, last);
+    bm->version++;
+}
+
+/* or mask into table word idx */
+void bitmap_or_word(bitmap* bm, u32 idx, u64 mask)
+{
+    assert(idx < bm->cnt && "word out of range");
+    assert(!bm->readonly && "bitmap is read only");
+    assert((idx + 1 < bm->cnt || OFFSET(bm->size) == 0 ||
+            !(mask >> OFFSET(bm->size))) && "bits past size");
+    u64 old = bm->table[idx];
+    u64 now = old | mask;
+    if(now == old)
+        return;
+    bm->table[idx] = now;
+    bm->version++;
+    if(old == 0)
+        summary_mark(bm->ones, bm->nlevel, idx);
+    if(now == FULL)
+        summary_unmark(bm->zeros, bm->nlevel, idx);
+}
+
+/* state of bits [from, to):
+   1 all set, 0 all clear, -1 mixed (or empty range) */
+int bitmap_tst_range(bitmap* bm, u32 from, u32 to)
+{
+    assert(from <= to && to <= bm->size && "range out of bitmap");
+    if(from == to)
+        return -1;
+    u32 i, first = INDEX(from), last = INDEX(to - 1);
+    u64 head = FULL << OFFSET(from);
+    u64 tail = FULL >> (WORD_BITS - 1 - OFFSET(to - 1));
+    u64 any = 0, all = FULL;
+    for(i = first; i <= last; i++) {
+        u64 mask = (i == first ? head : FULL) & (i == last ? tail : FULL);
+        u64 w = bm->table[i] & mask;
+        any |= w;
+        all &= w | ~mask;
+        if(any && all != FULL)
+            return -1;
+    }
+    if(all == FULL)
+        return 1;
+    return any ? -1 : 0;
+}
+
+/* the index of first 1 (one) or 0 bit at or after from,
+   climb the summary until a level has a candidate to the
+   right, then follow the lowest bits back down */
+static u32
+bitmap_find(bitmap* bm, u32 from, int one)
+{
+    assert(bm);
+    if(from >= bm->size)
+        return -1;
+
+    u64** sum = one ? bm->ones : bm->zeros;
+    u32 idx = INDEX(from);
+    u32 pos;
+    int l, k;
+    u64 w = word_of(bm, idx, one) & (FULL << OFFSET(from));
+    if(w) {
+        pos = idx * WORD_BITS + first_bit1(w);
+        return pos < bm->size ? pos : (u32)-1;
+    }
+
+    for(l = 0; l < (int)bm->nlevel; l++) {
+        u32 bit = idx + 1;
+        idx = INDEX(bit);
+        if(idx >= bm->lcnt[l])
+            return -1;
+        w = sum[l][idx] & (FULL << OFFSET(bit));
+        if(w == 0)
+            continue;
+
+        /* idx is now a word index one level down */
+        idx = idx * WORD_BITS + first_bit1(w);
+        for(k = l - 1; k >= 0; k--)
+            idx = idx * WORD_BITS + first_bit1(sum[k][idx]);
+        pos = idx * WORD_BITS + first_bit1(word_of(bm, idx, one));
+        return pos < bm->size ? pos : (u32)-1;
+    }
+    return -1;
 }
 
 /* the index of first 0,
    return -1 means no 0 bit */
 u32 bitmap_first0(bitmap* bm)
 {
-    assert(bm);
-    u32 i;
-    for( i = 0; i < bm->cnt; i++) {
-        if( bm->table[i] == 0xFFFFFFFF ) //full
-            continue;
-        u32 v = bm->table[i];
+    return bitmap_find(bm, 0, 0);
+}
 
-        return 32*i + first_bit0(v) - 1;
+/* start of the first run of len clear bits,
+   return -1 means no such run. hops gap to gap through
+   next0/next1, so full stretches cost one summary walk */
+u32 bitmap_find_run0(bitmap* bm, u32 len)
+{
+    assert(bm && len > 0);
+    u32 p = bitmap_find(bm, 0, 0);
+    while(p != (u32)-1) {
+        if(bm->size - p < len)
+            return -1;
+        u32 q = bitmap_find(bm, p, 1);
+        if(q == (u32)-1 || q - p >= len)
+            return p;
+        p = bitmap_find(bm, q, 0);
     }
-    return -1; 
+    return -1;
 }
 
 /* the index of first 1,
    return -1 means no 1 bit */
 u32 bitmap_first1(bitmap* bm)
 {
-    assert(bm);
+    return bitmap_find(bm, 0, 1);
+}
+
+/* the index of first 0 at or after from,
+   return -1 means no 0 bit */
+u32 bitmap_next0(bitmap* bm, u32 from)
+{
+    return bitmap_find(bm, from, 0);
+}
+
+/* the index of first 1 at or after from,
+   return -1 means no 1 bit */
+u32 bitmap_next1(bitmap* bm, u32 from)
+{
+    return bitmap_find(bm, from, 1);
+}
+
+/* ------------------------------------------------------------------
+   bulk set algebra and popcount, the kernels work on plain word
+   arrays and are picked once from what the cpu supports
+   ------------------------------------------------------------------ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITMAP_X86 1
+#endif
+
+enum { OP_AND, OP_OR, OP_XOR, OP_ANDNOT, OP_MAX };
+
+typedef void (*bulk_f)  (u64* d, const u64* a, const u64* b, u32 n);
+typedef u64  (*count_f) (const u64* t, u32 n);
+
+#define SCALAR_AND(x, y)    ((x) & (y))
+#define SCALAR_OR(x, y)     ((x) | (y))
+#define SCALAR_XOR(x, y)    ((x) ^ (y))
+#define SCALAR_ANDNOT(x, y) ((x) & ~(y))
+
+#define BULK_SCALAR(name, op)                                   \
+    static void                                                 \
+    name(u64* d, const u64* a, const u64* b, u32 n)             \
+    {                                                           \
+        u32 i;                                                  \
+        for(i = 0; i < n; i++)                                  \
+            d[i] = op(a[i], b[i]);                              \
+    }
+
+BULK_SCALAR(and_scalar,    SCALAR_AND)
+BULK_SCALAR(or_scalar,     SCALAR_OR)
+BULK_SCALAR(xor_scalar,    SCALAR_XOR)
+BULK_SCALAR(andnot_scalar, SCALAR_ANDNOT)
+
+static u64
+count_scalar(const u64* t, u32 n)
+{
     u32 i;
-    for( i = 0; i < bm->cnt; i++ ) {
-        if( bm->table[i] == 0x0 ) //empty
-            continue;
-        u32 v = bm->table[i];
-        return 32*i + first_bit1(v) - 1;
+    u64 sum = 0;
+    for(i = 0; i < n; i++) {
+        u64 x = t[i];
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        sum += (x * 0x0101010101010101ULL) >> 56;
     }
-    return -1;
+    return sum;
+}
+
+#if defined(BITMAP_X86)
+
+/* _mm_andnot(y, x) is ~y & x */
+#define SSE2_AND(x, y)    _mm_and_si128(x, y)
+#define SSE2_OR(x, y)     _mm_or_si128(x, y)
+#define SSE2_XOR(x, y)    _mm_xor_si128(x, y)
+#define SSE2_ANDNOT(x, y) _mm_andnot_si128(y, x)
+#define AVX2_AND(x, y)    _mm256_and_si256(x, y)
+#define AVX2_OR(x, y)     _mm256_or_si256(x, y)
+#define AVX2_XOR(x, y)    _mm256_xor_si256(x, y)
+#define AVX2_ANDNOT(x, y) _mm256_andnot_si256(y, x)
+
+#define BULK_SSE2(name, vop, sop)                                       \
+    static __attribute__((target("sse2"))) void                         \
+    name(u64* d, const u64* a, const u64* b, u32 n)                     \
+    {                                                                   \
+        u32 i = 0;                                                      \
+        for(; i + 2 <= n; i += 2) {                                     \
+            __m128i x = _mm_loadu_si128((const __m128i*)(a + i));       \
+            __m128i y = _mm_loadu_si128((const __m128i*)(b + i));       \
+            _mm_storeu_si128((__m128i*)(d + i), vop(x, y));             \
+        }                                                               \
+        for(; i < n; i++)                                               \
+            d[i] = sop(a[i], b[i]);                                     \
+    }
+
+#define BULK_AVX2(name, vop, sop)                                       \
+    static __attribute__((target("avx2"))) void                         \
+    name(u64* d, const u64* a, const u64* b, u32 n)                     \
+    {                                                                   \
+        u32 i = 0;                                                      \
+        for(; i + 8 <= n; i += 8) {                                     \
+            __m256i x0 = _mm256_loadu_si256((const __m256i*)(a + i));   \
+            __m256i y0 = _mm256_loadu_si256((const __m256i*)(b + i));   \
+            __m256i x1 = _mm256_loadu_si256((const __m256i*)(a + i + 4)); \
+            __m256i y1 = _mm256_loadu_si256((const __m256i*)(b + i + 4)); \
+            _mm256_storeu_si256((__m256i*)(d + i), vop(x0, y0));        \
+            _mm256_storeu_si256((__m256i*)(d + i + 4), vop(x1, y1));    \
+        }                                                               \
+        for(; i < n; i++)                                               \
+            d[i] = sop(a[i], b[i]);                                     \
+    }
+
+BULK_SSE2(and_sse2,    SSE2_AND,    SCALAR_AND)
+BULK_SSE2(or_sse2,     SSE2_OR,     SCALAR_OR)
+BULK_SSE2(xor_sse2,    SSE2_XOR,    SCALAR_XOR)
+BULK_SSE2(andnot_sse2, SSE2_ANDNOT, SCALAR_ANDNOT)
+BULK_AVX2(and_avx2,    AVX2_AND,    SCALAR_AND)
+BULK_AVX2(or_avx2,     AVX2_OR,     SCALAR_OR)
+BULK_AVX2(xor_avx2,    AVX2_XOR,    SCALAR_XOR)
+BULK_AVX2(andnot_avx2, AVX2_ANDNOT, SCALAR_ANDNOT)
+
+/* same bit tricks as count_scalar, two words at a time */
+static __attribute__((target("sse2"))) u64
+count_sse2(const u64* t, u32 n)
+{
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    __m128i acc = _mm_setzero_si128();
+    u64 lane[2];
+    u32 i = 0;
+    for(; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(t + i));
+        x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi64(x, 1), m1));
+        x = _mm_add_epi8(_mm_and_si128(x, m2),
+                         _mm_and_si128(_mm_srli_epi64(x, 2), m2));
+        x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi64(x, 4)), m4);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(x, _mm_setzero_si128()));
+    }
+    _mm_storeu_si128((__m128i*)lane, acc);
+    return lane[0] + lane[1] + count_scalar(t + i, n - i);
+}
+
+static __attribute__((target("popcnt"))) u64
+count_popcnt(const u64* t, u32 n)
+{
+    u32 i;
+    u64 sum = 0;
+    for(i = 0; i < n; i++)
+        sum += __builtin_popcountll(t[i]);
+    return sum;
+}
+
+/* nibble lookup with pshufb, byte counters are flushed with psadbw
+   before they can overflow (31 rounds * 8 < 256) */
+static __attribute__((target("avx2,popcnt"))) u64
+count_avx2(const u64* t, u32 n)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                            1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3,
+                                            1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i acc = _mm256_setzero_si256();
+    u64 lane[4], sum;
+    u32 i = 0, round;
+    while(i + 4 <= n) {
+        __m256i local = _mm256_setzero_si256();
+        for(round = 0; round < 31 && i + 4 <= n; round++, i += 4) {
+            __m256i v  = _mm256_loadu_si256((const __m256i*)(t + i));
+            __m256i lo = _mm256_and_si256(v, low);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, lo));
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, hi));
+        }
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(local,
+                                                    _mm256_setzero_si256()));
+    }
+    _mm256_storeu_si256((__m256i*)lane, acc);
+    sum = lane[0] + lane[1] + lane[2] + lane[3];
+    for(; i < n; i++)
+        sum += __builtin_popcountll(t[i]);
+    return sum;
+}
+
+#endif
+
+typedef u32  (*decode_f)(u64 w, u32 base, u32* out);
+
+/* positions of the set bits of w plus base into out,
+   out has room for 64, return how many were written */
+static u32
+decode_scalar(u64 w, u32 base, u32* out)
+{
+    u32 n = 0;
+    while(w) {
+        out[n++] = base + (u32)__builtin_ctzll(w);
+        w &= w - 1;
+    }
+    return n;
+}
+
+#if defined(BITMAP_X86)
+
+/* bit positions of every byte value, filled by kernel_init */
+static unsigned char decode_lut[256][8];
+
+/* dense words a byte at a time: the 8 positions of the byte are
+   widened to u32, offset and stored as a full vector, the next
+   byte overwrites the unused tail. sparse words go bit by bit */
+static __attribute__((target("avx2,popcnt"))) u32
+decode_avx2(u64 w, u32 base, u32* out)
+{
+    u32 n = 0, i;
+    if(__builtin_popcountll(w) < 12)
+        return decode_scalar(w, base, out);
+    for(i = 0; i < 8; i++, w >>= 8) {
+        u32 byte = (u32)(w & 0xFF);
+        __m256i pos = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*)decode_lut[byte]));
+        pos = _mm256_add_epi32(pos, _mm256_set1_epi32(base + i * 8));
+        _mm256_storeu_si256((__m256i*)(out + n), pos);
+        n += __builtin_popcount(byte);
+    }
+    return n;
+}
+
+#endif
+
+static bulk_f  bulk_kernel[OP_MAX];
+static count_f count_kernel;
+static decode_f decode_kernel;
+
+/* pick kernels on first use, once, through kernel_once */
+static void
+kernel_init()
+{
+    bulk_f  bulk[OP_MAX] = { and_scalar, or_scalar, xor_scalar, andnot_scalar };
+    count_f count = count_scalar;
+    decode_f decode = decode_scalar;
+    int op;
+#if defined(BITMAP_X86)
+    u32 v, k;
+    for(v = 0; v < 256; v++)
+        for(k = 0; k < 8; k++)
+            if(v & (1u << k))
+                decode_lut[v][__builtin_popcount(v & ((1u << k) - 1))] = k;
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        bulk_f avx2[OP_MAX] = { and_avx2, or_avx2, xor_avx2, andnot_avx2 };
+        memcpy(bulk, avx2, sizeof(bulk));
+    } else if(__builtin_cpu_supports("sse2")) {
+        bulk_f sse2[OP_MAX] = { and_sse2, or_sse2, xor_sse2, andnot_sse2 };
+        memcpy(bulk, sse2, sizeof(bulk));
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        count = count_avx2;
+    else if(__builtin_cpu_supports("popcnt"))
+        count = count_popcnt;
+    else if(__builtin_cpu_supports("sse2"))
+        count = count_sse2;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        decode = decode_avx2;
+#endif
+    for(op = 0; op < OP_MAX; op++)
+        bulk_kernel[op] = bulk[op];
+    decode_kernel = decode;
+    count_kernel = count;
+}
+
+static pthread_once_t kernel_ctl = PTHREAD_ONCE_INIT;
+
+/* the once control orders the stores of kernel_init, decode_lut
+   included, before every caller that returns from it */
+static inline void
+kernel_once()
+{
+    pthread_once(&kernel_ctl, kernel_init);
+}
+
+/* dst = a op b, one summary word (64 table words) at a time
+   so the summary is rebuilt while the block is still in cache */
+static void
+bitmap_bulk(bitmap* dst, bitmap* a, bitmap* b, int op)
+{
+    assert(dst && a && b);
+    assert(dst->size == a->size && a->size == b->size &&
+           "bitmap size mismatch");
+    assert(!dst->readonly && "bitmap is read only");
+    kernel_once();
+
+    bulk_f f = bulk_kernel[op];
+    u32 w;
+    for(w = 0; w < dst->lcnt[0]; w++) {
+        u32 i = w * WORD_BITS;
+        u32 n = dst->cnt - i < WORD_BITS ? dst->cnt - i : WORD_BITS;
+        f(dst->table + i, a->table + i, b->table + i, n);
+        summary_word(dst, 0, w);
+    }
+    summary_refresh(dst, 1, 0, dst->lcnt[0] - 1);
+    dst->version++;
+}
+
+/* in place: bm = bm op other */
+void bitmap_and(bitmap* bm, bitmap* other)    { bitmap_bulk(bm, bm, other, OP_AND); }
+void bitmap_or(bitmap* bm, bitmap* other)     { bitmap_bulk(bm, bm, other, OP_OR); }
+void bitmap_xor(bitmap* bm, bitmap* other)    { bitmap_bulk(bm, bm, other, OP_XOR); }
+void bitmap_andnot(bitmap* bm, bitmap* other) { bitmap_bulk(bm, bm, other, OP_ANDNOT); }
+
+/* out of place: dst = a op b, dst may be a or b */
+void bitmap_and_to(bitmap* dst, bitmap* a, bitmap* b)    { bitmap_bulk(dst, a, b, OP_AND); }
+void bitmap_or_to(bitmap* dst, bitmap* a, bitmap* b)     { bitmap_bulk(dst, a, b, OP_OR); }
+void bitmap_xor_to(bitmap* dst, bitmap* a, bitmap* b)    { bitmap_bulk(dst, a, b, OP_XOR); }
+void bitmap_andnot_to(bitmap* dst, bitmap* a, bitmap* b) { bitmap_bulk(dst, a, b, OP_ANDNOT); }
+
+/* number of 1 bits */
+u32 bitmap_count(bitmap* bm)
+{
+    assert(bm);
+    kernel_once();
+    return (u32)count_kernel(bm->table, bm->cnt);
+}
+
+/* number of 1 bits in [from, to) */
+u32 bitmap_count_range(bitmap* bm, u32 from, u32 to)
+{
+    assert(bm);
+    assert(from <= to && to <= bm->size && "range out of bitmap");
+    kernel_once();
+    if(from == to)
+        return 0;
+
+    u32 first = INDEX(from), last = INDEX(to - 1);
+    u64 head = FULL << OFFSET(from);
+    u64 tail = FULL >> (WORD_BITS - 1 - OFFSET(to - 1));
+    if(first == last)
+        return __builtin_popcountll(bm->table[first] & head & tail);
+
+    return __builtin_popcountll(bm->table[first] & head)
+        + (u32)count_kernel(bm->table + first + 1, last - first - 1)
+        + __builtin_popcountll(bm->table[last] & tail);
+}
+
+/* ------------------------------------------------------------------
+   on-disk form: one header page, then the table and summary block
+   exactly as it sits in memory, so opening is a single mmap
+   ------------------------------------------------------------------ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BITMAP_MAGIC     0x50414d42   /* "BMAP" */
+#define BITMAP_VERSION   1
+#define BITMAP_HDR_BYTES 4096
+
+#define HDR_OPEN   0x1   /* a writer has it mapped */
+#define HDR_SUMMED 0x2   /* datasum matches the data */
+
+typedef struct _bitmap_hdr{
+    u32 magic;
+    u32 version;
+    u32 size;
+    u32 wordbits;
+    u32 nlevel;
+    u32 flags;
+    u64 words;       /* table + summary words after the header */
+    u64 datasum;     /* checksum of those words at the last sync */
+    u64 hdrsum;      /* checksum of the fields above */
+}bitmap_hdr;
+
+static u64
+checksum(const void* p, size_t n)
+{
+    const unsigned char* c = (const unsigned char*)p;
+    u64 h = 0xcbf29ce484222325ULL;
+    while(n--) {
+        h ^= *c++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* word at a time, cheaper than bytes over a big table */
+static u64
+checksum_words(const u64* w, u64 n)
+{
+    u64 h = 0x9e3779b97f4a7c15ULL;
+    while(n--) {
+        h ^= *w++;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+static bitmap_hdr*
+bitmap_header(bitmap* bm)
+{
+    return (bitmap_hdr*)bm->map;
+}
+
+static void
+header_seal(bitmap_hdr* hdr)
+{
+    hdr->hdrsum = checksum(hdr, offsetof(bitmap_hdr, hdrsum));
+}
+
+/* a writer seals the data on the way out, so a clean close leaves
+   a verifiable file and only a crash leaves HDR_OPEN behind */
+static void
+bitmap_unmap(bitmap* bm)
+{
+    if(!bm->readonly) {
+        bitmap_header(bm)->flags &= ~HDR_OPEN;
+        bitmap_sync(bm);
+    }
+    munmap(bm->map, bm->maplen);
+}
+
+/* map path as a bitmap of size bits, creating it when missing
+   and mode is BITMAP_RDWR. size 0 takes the size from the file.
+   only the header is read here, table pages come in as they are
+   touched, and read-only maps share the page cache.
+   a read-only open fails while the header says a writer has the
+   file mapped: a writer that died leaves its summary levels torn
+   until the next writer rebuilds them, and a reader cannot tell it
+   from a live one. open readers once the writer is closed.
+   return NULL on any io error or a header that does not match */
+bitmap* bitmap_open_file(const char* path, u32 size, int mode)
+{
+    bitmap_hdr hdr;
+    struct stat st;
+    int rdonly = mode == BITMAP_RDONLY;
+    int created = 0;
+    int fd = open(path, rdonly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+        return NULL;
+
+    bitmap* bm = (bitmap*)malloc(sizeof(bitmap));
+    assert(bm);
+    if(fstat(fd, &st) < 0)
+        goto fail;
+
+    if(st.st_size == 0) {
+        if(rdonly || size == 0)
+            goto fail;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic    = BITMAP_MAGIC;
+        hdr.version  = BITMAP_VERSION;
+        hdr.size     = size;
+        hdr.wordbits = WORD_BITS;
+        hdr.words    = bitmap_layout(bm, size);
+        hdr.nlevel   = bm->nlevel;
+        /* a sparse file, the table reads back as zeros */
+        if(ftruncate(fd, BITMAP_HDR_BYTES + hdr.words * sizeof(u64)) < 0)
+            goto fail;
+        created = 1;
+    } else {
+        if(pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+           hdr.magic != BITMAP_MAGIC || hdr.version != BITMAP_VERSION ||
+           hdr.hdrsum != checksum(&hdr, offsetof(bitmap_hdr, hdrsum)) ||
+           hdr.wordbits != WORD_BITS || (size && size != hdr.size))
+            goto fail;
+        if(bitmap_layout(bm, hdr.size) != hdr.words ||
+           bm->nlevel != hdr.nlevel ||
+           (u64)st.st_size < BITMAP_HDR_BYTES + hdr.words * sizeof(u64))
+            goto fail;
+        if(rdonly && (hdr.flags & HDR_OPEN))
+            goto fail;
+    }
+
+    bm->maplen = BITMAP_HDR_BYTES + hdr.words * sizeof(u64);
+    bm->map = mmap(NULL, bm->maplen, rdonly ? PROT_READ : PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    if(bm->map == MAP_FAILED)
+        goto fail;
+    close(fd);
+    bm->readonly = rdonly;
+    bm->version = 0;
+    bitmap_bind(bm, (u64*)((char*)bm->map + BITMAP_HDR_BYTES));
+
+    if(!rdonly) {
+        bitmap_hdr* h = bitmap_header(bm);
+        if(created)
+            *h = hdr;
+        /* a writer died with it mapped, its summary may be torn
+           and its checksum stale */
+        if(created || (h->flags & HDR_OPEN)) {
+            summary_build(bm);
+            h->flags &= ~HDR_SUMMED;
+        }
+        h->flags |= HDR_OPEN;
+        header_seal(h);
+    }
+    return bm;
+
+fail:
+    close(fd);
+    free(bm);
+    return NULL;
+}
+
+/* checksum the data and flush it to the file,
+   return true if success, false for a bitmap not writable on disk */
+int bitmap_sync(bitmap* bm)
+{
+    assert(bm);
+    if(bm->map == NULL || bm->readonly)
+        return 0;
+    bitmap_hdr* hdr = bitmap_header(bm);
+    hdr->datasum = checksum_words(bm->table, hdr->words);
+    hdr->flags |= HDR_SUMMED;
+    header_seal(hdr);
+    return msync(bm->map, bm->maplen, MS_SYNC) == 0;
+}
+
+/* check the data against the checksum of the last sync, reads
+   every page. return true if it matches, changes made by a live
+   writer since its last sync do not match */
+int bitmap_verify(bitmap* bm)
+{
+    assert(bm);
+    if(bm->map == NULL)
+        return 0;
+    bitmap_hdr* hdr = bitmap_header(bm);
+    if(!(hdr->flags & HDR_SUMMED))
+        return 0;
+    return hdr->datasum == checksum_words(bm->table, hdr->words);
+}
+
+/* fill out with the positions of up to cap set bits at or after
+   start, in increasing order. return how many were written, 0 when
+   there are none left; continue from the last position + 1 */
+u32 bitmap_extract1(bitmap* bm, u32 start, u32* out, u32 cap)
+{
+    assert(bm && out);
+    kernel_once();
+    if(start >= bm->size || cap == 0)
+        return 0;
+
+    u32 n = 0, i = INDEX(start);
+    u64 w = bm->table[i] & (FULL << OFFSET(start));
+    for(;;) {
+        if(w == 0) {
+            /* a few words by hand, then let the summary skip
+               the empty stretch */
+            u32 stop = i + 8;
+            do {
+                if(++i >= bm->cnt)
+                    return n;
+                w = bm->table[i];
+            } while(w == 0 && i < stop);
+            if(w == 0) {
+                u32 next = bitmap_find(bm, i * WORD_BITS, 1);
+                if(next == (u32)-1)
+                    break;
+                i = INDEX(next);
+                w = bm->table[i];
+            }
+        }
+        if(cap - n >= WORD_BITS) {
+            n += decode_kernel(w, i * WORD_BITS, out + n);
+        } else {
+            while(w && n < cap) {
+                out[n++] = i * WORD_BITS + (u32)__builtin_ctzll(w);
+                w &= w - 1;
+            }
+            if(n == cap)
+                break;
+        }
+        w = 0;
+    }
+    return n;
 }
@@ -1,5 +1,5 @@
 
-// @Name   : BITMAP_H 
+// @Name   : BITMAP_H
 //
 // @Author : Yukang Chen (moorekang@gmail.com)
 // @Date   : 2012-03-01 22:05:41
@@ -9,12 +9,33 @@
 #if !defined(BITMAP_H)
 #define BITMAP_H
 
+#include <stddef.h>
+
 typedef unsigned int u32;
+typedef unsigned long long u64;
+
+/* 64^6 words covers the whole u32 bit range */
+#define BITMAP_MAX_LEVEL 6
 
 typedef struct _bitmap{
-    u32 size;
-    u32 cnt;
-    u32* table;
+    u32 size;                       /* number of bits */
+    u32 cnt;                        /* number of 64-bit words in table */
+    u64* table;
+
+    /* summary index over table: level 0 has one bit per table word,
+       level l+1 one bit per word of level l, the top level is a
+       single word. ones[] marks non-empty words, zeros[] non-full */
+    u32  nlevel;
+    u32  lcnt[BITMAP_MAX_LEVEL];
+    u64* ones[BITMAP_MAX_LEVEL];
+    u64* zeros[BITMAP_MAX_LEVEL];
+
+    u32 version;    /* bumped by every change, for derived indexes */
+
+    /* set when the bitmap lives in a mapped file */
+    void*  map;
+    size_t maplen;
+    int    readonly;
 }bitmap;
 
 bitmap* bitmap_new(u32 size);
@@ -24,6 +45,40 @@ void    bitmap_clr(bitmap* bm, u32 val);
 int     bitmap_tst(bitmap* bm, u32 val);
 u32     bitmap_first0(bitmap* bm);
 u32     bitmap_first1(bitmap* bm);
+u32     bitmap_next0(bitmap* bm, u32 from);
+u32     bitmap_next1(bitmap* bm, u32 from);
+
+/* or a 64-bit mask into word idx of the table */
+void    bitmap_or_word(bitmap* bm, u32 idx, u64 mask);
+
+/* ranges are [from, to) */
+void    bitmap_set_range(bitmap* bm, u32 from, u32 to);
+void    bitmap_clr_range(bitmap* bm, u32 from, u32 to);
+int     bitmap_tst_range(bitmap* bm, u32 from, u32 to);
+u32     bitmap_find_run0(bitmap* bm, u32 len);
+
+/* positions of set bits from start, at most cap of them */
+u32     bitmap_extract1(bitmap* bm, u32 start, u32* out, u32 cap);
+
+/* mapped file backed bitmaps */
+#define BITMAP_RDONLY 0
+#define BITMAP_RDWR   1
+
+bitmap* bitmap_open_file(const char* path, u32 size, int mode);
+int     bitmap_sync(bitmap* bm);
+int     bitmap_verify(bitmap* bm);
+
+/* whole-bitmap set algebra, all operands have the same size */
+void    bitmap_and(bitmap* bm, bitmap* other);
+void    bitmap_or(bitmap* bm, bitmap* other);
+void    bitmap_xor(bitmap* bm, bitmap* other);
+void    bitmap_andnot(bitmap* bm, bitmap* other);
+void    bitmap_and_to(bitmap* dst, bitmap* a, bitmap* b);
+void    bitmap_or_to(bitmap* dst, bitmap* a, bitmap* b);
+void    bitmap_xor_to(bitmap* dst, bitmap* a, bitmap* b);
+void    bitmap_andnot_to(bitmap* dst, bitmap* a, bitmap* b);
+u32     bitmap_count(bitmap* bm);
+u32     bitmap_count_range(bitmap* bm, u32 from, u32 to);
 
 
 #endif
@@ -0,0 +1,228 @@
+
+// @Name   : bitmap_bench.c
+//
+// @Brief  : first0/first1 through the summary index against the
+//           old linear scan, at 1%, 50% and 99% fill, and bulk
+//           and/count against a per-bit loop, set bit extraction
+//           against next1 and tst walks, and opening a mapped file
+//           against building the bitmap in memory.
+//           build with: make CFLAGS=-O2 bitmap_bench
+
+#include "bitmap.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NBITS  10000000
+#define ROUNDS 2000
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the scan bitmap.c used to do: 32-bit words from word 0,
+   then a bit by bit loop inside the word */
+static u32 linear_first(bitmap* bm, int one)
+{
+    const u32* t = (const u32*)bm->table;
+    u32 i, n = bm->cnt * 2;
+    for(i = 0; i < n; i++) {
+        u32 v = one ? t[i] : ~t[i];
+        u32 idx = 0;
+        if(v == 0)
+            continue;
+        while(v % 2 == 0) {
+            idx++;
+            v >>= 1;
+        }
+        idx += 32 * i;
+        return idx < bm->size ? idx : (u32)-1;
+    }
+    return -1;
+}
+
+static volatile u32 sink;
+
+/* allocator pattern: take the first free slot, then give it back */
+static double bench_alloc(bitmap* bm, int linear)
+{
+    int r;
+    double t = now_sec();
+    for(r = 0; r < ROUNDS; r++) {
+        u32 p = linear ? linear_first(bm, 0) : bitmap_first0(bm);
+        bitmap_set(bm, p);
+        bitmap_clr(bm, p);
+        sink = p;
+    }
+    return (now_sec() - t) / ROUNDS * 1e9;
+}
+
+static double bench_first1(bitmap* bm, int linear)
+{
+    int r;
+    double t = now_sec();
+    for(r = 0; r < ROUNDS; r++)
+        sink = linear ? linear_first(bm, 1) : bitmap_first1(bm);
+    return (now_sec() - t) / ROUNDS * 1e9;
+}
+
+/* a = a & b the way callers had to do it before bitmap_and */
+static void loop_and(bitmap* a, bitmap* b)
+{
+    u32 k;
+    for(k = 0; k < a->size; k++)
+        if(bitmap_tst(a, k) && !bitmap_tst(b, k))
+            bitmap_clr(a, k);
+}
+
+static void bench_bulk()
+{
+    bitmap* a = bitmap_new(NBITS);
+    bitmap* b = bitmap_new(NBITS);
+    double t, gbit = NBITS / 1e9;
+    u32 k, cnt = 0;
+    int r, rounds = 50;
+    assert(a && b);
+    for(k = 0; k < NBITS; k += 3)
+        bitmap_set(b, k);
+
+    printf("\n%-10s %14s %14s\n", "op", "loop Gbit/s", "bulk Gbit/s");
+    t = now_sec();
+    for(r = 0; r < 2; r++) {
+        bitmap_or(a, b);
+        loop_and(a, b);
+    }
+    double loop = 2 * gbit / (now_sec() - t);
+    t = now_sec();
+    for(r = 0; r < rounds; r++) {
+        bitmap_or(a, b);
+        bitmap_and(a, b);
+    }
+    printf("%-10s %14.2f %14.2f\n", "and", loop,
+           2 * rounds * gbit / (now_sec() - t));
+
+    t = now_sec();
+    for(k = 0; k < NBITS; k++)
+        cnt += bitmap_tst(a, k) != 0;
+    loop = gbit / (now_sec() - t);
+    t = now_sec();
+    for(r = 0; r < rounds; r++)
+        sink = bitmap_count(a);
+    assert(sink == cnt);
+    printf("%-10s %14.2f %14.2f\n", "count", loop,
+           rounds * gbit / (now_sec() - t));
+    bitmap_del(a);
+    bitmap_del(b);
+}
+
+/* million positions per second decoding every set bit */
+static void bench_extract()
+{
+    int dens[] = { 1, 10, 50, 90 }, d;
+    u32 buf[1024], k, n, pos, total;
+    double t, tst, next, ext;
+    printf("\n%-6s %12s %12s %12s\n", "fill", "tst Mpos/s",
+           "next1 Mpos/s", "extract Mpos/s");
+    for(d = 0; d < 4; d++) {
+        bitmap* bm = bitmap_new(NBITS);
+        assert(bm);
+        srand(d);
+        for(k = 0; k < NBITS; k++)
+            if(rand() % 100 < dens[d])
+                bitmap_set(bm, k);
+
+        t = now_sec();
+        for(k = 0, total = 0; k < NBITS; k++)
+            if(bitmap_tst(bm, k))
+                buf[total++ % 1024] = k;
+        tst = total / (now_sec() - t) / 1e6;
+
+        t = now_sec();
+        for(pos = bitmap_next1(bm, 0), n = 0; pos != (u32)-1;
+            pos = pos + 1 < NBITS ? bitmap_next1(bm, pos + 1) : (u32)-1)
+            buf[n++ % 1024] = pos;
+        assert(n == total);
+        next = total / (now_sec() - t) / 1e6;
+
+        t = now_sec();
+        for(pos = 0, n = 0; (k = bitmap_extract1(bm, pos, buf, 1024)); ) {
+            n += k;
+            pos = buf[k - 1] + 1;
+        }
+        assert(n == total);
+        ext = total / (now_sec() - t) / 1e6;
+        printf("%5d%% %12.1f %12.1f %12.1f\n", dens[d], tst, next, ext);
+        bitmap_del(bm);
+    }
+}
+
+/* a 1G-bit map: bitmap_new pays for every page up front, a mapped
+   file only for the header and the pages the first lookups touch */
+static void bench_open()
+{
+    const char* path = "/tmp/bitmap_bench.bmp";
+    u32 size = 1u << 30;
+    double t;
+    unlink(path);
+    bitmap* bm = bitmap_open_file(path, size, BITMAP_RDWR);
+    assert(bm);
+    bitmap_set(bm, size / 2);
+    bitmap_del(bm);
+
+    printf("\n%-22s %12s\n", "1G bits", "ms");
+    t = now_sec();
+    bm = bitmap_new(size);
+    bitmap_set(bm, size / 2);
+    sink = bitmap_first1(bm);
+    printf("%-22s %12.3f\n", "bitmap_new + first1", (now_sec() - t) * 1e3);
+    bitmap_del(bm);
+
+    t = now_sec();
+    bm = bitmap_open_file(path, 0, BITMAP_RDONLY);
+    assert(bm);
+    sink = bitmap_first1(bm);
+    assert(sink == size / 2);
+    printf("%-22s %12.3f\n", "open_file + first1", (now_sec() - t) * 1e3);
+    bitmap_del(bm);
+    unlink(path);
+}
+
+int main()
+{
+    double fills[] = { 0.01, 0.50, 0.99 };
+    int f;
+    u32 k;
+
+    printf("%-6s %-8s %14s %14s\n", "fill", "op", "linear ns/op", "index ns/op");
+    for(f = 0; f < 3; f++) {
+        u32 used = (u32)(NBITS * fills[f]);
+        bitmap* bm = bitmap_new(NBITS);
+        assert(bm);
+
+        /* slots handed out from the front */
+        for(k = 0; k < used; k++)
+            bitmap_set(bm, k);
+        assert(bitmap_first0(bm) == linear_first(bm, 0));
+        printf("%5.0f%% %-8s %14.1f %14.1f\n", fills[f] * 100, "first0",
+               bench_alloc(bm, 1), bench_alloc(bm, 0));
+
+        /* the same amount of bits, parked at the back */
+        for(k = 0; k < used; k++)
+            bitmap_clr(bm, k);
+        for(k = NBITS - used; k < NBITS; k++)
+            bitmap_set(bm, k);
+        assert(bitmap_first1(bm) == linear_first(bm, 1));
+        printf("%5.0f%% %-8s %14.1f %14.1f\n", fills[f] * 100, "first1",
+               bench_first1(bm, 1), bench_first1(bm, 0));
+        bitmap_del(bm);
+    }
+    bench_bulk();
+    bench_extract();
+    bench_open();
+    return 0;
+}
@@ -9,6 +9,32 @@
 #include "bitmap.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* run a writer on read only bm in a child, it must fail the assert
+   rather than fault on the read only mapping */
+static void expect_abort(bitmap* bm, int op)
+{
+    int status;
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if(pid == 0) {
+        bitmap* other = bitmap_new(bm->size);
+        freopen("/dev/null", "w", stderr);
+        switch(op) {
+        case 0: bitmap_set_range(bm, 0, bm->size); break;
+        case 1: bitmap_clr_range(bm, 0, bm->size); break;
+        case 2: bitmap_or(bm, other); break;
+        default: bitmap_and_to(bm, other, other); break;
+        }
+        _exit(0);
+    }
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
 
 int main()
 {
@@ -46,6 +72,189 @@ int main()
         assert(bitmap_tst(bm, k) == 0);
     }
     bitmap_del(bm);
-    
+
+    /* next0/next1 across words and summary levels, odd size */
+    bm = bitmap_new(300007);
+    assert(bm);
+    assert(bitmap_next1(bm, 0) == -1);
+    assert(bitmap_next0(bm, 300006) == 300006);
+    assert(bitmap_next0(bm, 300007) == -1);
+    bitmap_set(bm, 5);
+    bitmap_set(bm, 64);
+    bitmap_set(bm, 4096 * 3 + 17);
+    bitmap_set(bm, 300006);
+    assert(bitmap_first1(bm) == 5);
+    assert(bitmap_next1(bm, 5) == 5);
+    assert(bitmap_next1(bm, 6) == 64);
+    assert(bitmap_next1(bm, 65) == 4096 * 3 + 17);
+    assert(bitmap_next1(bm, 4096 * 3 + 18) == 300006);
+    assert(bitmap_next1(bm, 300006) == 300006);
+    bitmap_clr(bm, 300006);
+    assert(bitmap_next1(bm, 4096 * 3 + 18) == -1);
+
+    for(k=0; k<300007; k++)
+        bitmap_set(bm, k);
+    assert(bitmap_first0(bm) == -1);
+    bitmap_clr(bm, 262144 + 9);
+    bitmap_clr(bm, 7);
+    assert(bitmap_first0(bm) == 7);
+    assert(bitmap_next0(bm, 8) == 262144 + 9);
+    assert(bitmap_next0(bm, 262144 + 10) == -1);
+    for(k=0; k<300007; k++)
+        bitmap_clr(bm, k);
+    assert(bitmap_first1(bm) == -1);
+    assert(bitmap_first0(bm) == 0);
+    bitmap_del(bm);
+
+    /* bulk set algebra and counts */
+    bitmap* a = bitmap_new(100003);
+    bitmap* b = bitmap_new(100003);
+    bitmap* c = bitmap_new(100003);
+    assert(a && b && c);
+    for(k=0; k<100003; k+=2)
+        bitmap_set(a, k);
+    for(k=0; k<100003; k+=3)
+        bitmap_set(b, k);
+    assert(bitmap_count(a) == 50002);
+    assert(bitmap_count(b) == 33335);
+    assert(bitmap_count_range(a, 0, 0) == 0);
+    assert(bitmap_count_range(a, 1, 2) == 0);
+    assert(bitmap_count_range(a, 0, 1) == 1);
+    assert(bitmap_count_range(a, 3, 1003) == 500);
+    assert(bitmap_count_range(a, 0, 100003) == 50002);
+
+    bitmap_and_to(c, a, b);
+    assert(bitmap_count(c) == 16668);
+    assert(bitmap_first1(c) == 0);
+    assert(bitmap_next1(c, 1) == 6);
+    bitmap_or_to(c, a, b);
+    assert(bitmap_count(c) == 50002 + 33335 - 16668);
+    bitmap_xor_to(c, a, b);
+    assert(bitmap_count(c) == 50002 + 33335 - 2 * 16668);
+    bitmap_andnot_to(c, a, b);
+    assert(bitmap_count(c) == 50002 - 16668);
+    assert(bitmap_first1(c) == 2);
+    assert(bitmap_first0(c) == 0);
+    for(k=0; k<100003; k++)
+        assert(bitmap_tst(c, k) == (k % 2 == 0 && k % 3 != 0));
+
+    bitmap_or(a, b);
+    bitmap_andnot(a, b);
+    bitmap_xor(a, c);
+    assert(bitmap_count(a) == 0);
+    assert(bitmap_first1(a) == -1);
+    bitmap_or(a, b);
+    bitmap_and(a, c);
+    assert(bitmap_first1(a) == -1);
+    bitmap_del(a);
+    bitmap_del(b);
+    bitmap_del(c);
+
+    /* ranges and extent allocation */
+    bm = bitmap_new(1000000);
+    assert(bm);
+    assert(bitmap_tst_range(bm, 0, 1000000) == 0);
+    assert(bitmap_find_run0(bm, 1000000) == 0);
+    bitmap_set_range(bm, 10, 20);
+    assert(bitmap_count(bm) == 10);
+    assert(bitmap_tst_range(bm, 10, 20) == 1);
+    assert(bitmap_tst_range(bm, 9, 20) == -1);
+    assert(bitmap_tst_range(bm, 20, 30) == 0);
+    assert(bitmap_first1(bm) == 10);
+    assert(bitmap_next0(bm, 10) == 20);
+    bitmap_set_range(bm, 100, 700000);
+    assert(bitmap_count(bm) == 10 + 699900);
+    assert(bitmap_tst_range(bm, 100, 700000) == 1);
+    assert(bitmap_next0(bm, 100) == 700000);
+    assert(bitmap_find_run0(bm, 10) == 0);
+    assert(bitmap_find_run0(bm, 11) == 20);
+    assert(bitmap_find_run0(bm, 81) == 700000);
+    assert(bitmap_find_run0(bm, 300000) == 700000);
+    assert(bitmap_find_run0(bm, 300001) == -1);
+    bitmap_clr_range(bm, 1000, 1064 * 3);
+    assert(bitmap_tst_range(bm, 1000, 1064 * 3) == 0);
+    assert(bitmap_find_run0(bm, 81) == 1000);
+    assert(bitmap_next1(bm, 1000) == 1064 * 3);
+    bitmap_clr_range(bm, 0, 1000000);
+    assert(bitmap_first1(bm) == -1);
+    bitmap_set_range(bm, 0, 1000000);
+    assert(bitmap_first0(bm) == -1);
+    assert(bitmap_find_run0(bm, 1) == -1);
+    bitmap_del(bm);
+
+    /* batch extraction against next1 */
+    bm = bitmap_new(1000000);
+    assert(bm);
+    u32 out[200], got, pos, total;
+    assert(bitmap_extract1(bm, 0, out, 200) == 0);
+    srand(5);
+    for(k=0; k<50000; k++)
+        bitmap_set(bm, rand() % 300000);
+    bitmap_set_range(bm, 500000, 520000);
+    bitmap_set(bm, 999999);
+    for(got=0, total=0, pos=0; ; pos=out[got-1]+1) {
+        u32 want = 1 + total % 200;
+        got = bitmap_extract1(bm, pos, out, want);
+        if(got == 0)
+            break;
+        assert(got <= want);
+        for(k=0; k<got; k++)
+            assert(out[k] == bitmap_next1(bm, k ? out[k-1] + 1 : pos));
+        total += got;
+    }
+    assert(total == bitmap_count(bm));
+    assert(bitmap_extract1(bm, 999999, out, 200) == 1 && out[0] == 999999);
+    assert(bitmap_extract1(bm, 520000, out, 1) == 1 && out[0] == 999999);
+    bitmap_del(bm);
+
+    /* file backed, reopened read only */
+    char path[64];
+    sprintf(path, "/tmp/bitmap_test.%d", (int)getpid());
+    unlink(path);
+    assert(bitmap_open_file(path, 0, BITMAP_RDWR) == NULL);
+    assert(bitmap_open_file(path, 1000, BITMAP_RDONLY) == NULL);
+    bm = bitmap_new(1);
+    assert(bitmap_sync(bm) == 0 && bitmap_verify(bm) == 0);
+    bitmap_del(bm);
+
+    bm = bitmap_open_file(path, 5000000, BITMAP_RDWR);
+    assert(bm);
+    assert(bitmap_first1(bm) == -1 && bitmap_first0(bm) == 0);
+    bitmap_set(bm, 3);
+    bitmap_set_range(bm, 4096, 1000000);
+    assert(bitmap_sync(bm) && bitmap_verify(bm));
+    bitmap_clr(bm, 4096);
+    bitmap_del(bm);
+
+    assert(bitmap_open_file(path, 4000000, BITMAP_RDONLY) == NULL);
+    bm = bitmap_open_file(path, 0, BITMAP_RDONLY);
+    assert(bm && bm->size == 5000000);
+    assert(bitmap_verify(bm));
+    assert(bitmap_tst(bm, 3) && !bitmap_tst(bm, 4096));
+    assert(bitmap_next1(bm, 4) == 4097);
+    assert(bitmap_next0(bm, 4097) == 1000000);
+    assert(bitmap_count(bm) == 1 + 1000000 - 4097);
+    int op;
+    for(op = 0; op < 4; op++)
+        expect_abort(bm, op);
+
+    /* a writer that never closed: the next writer rebuilds */
+    bitmap* w1 = bitmap_open_file(path, 5000000, BITMAP_RDWR);
+    assert(w1);
+    bitmap_clr_range(w1, 0, 5000000);
+    bitmap* w2 = bitmap_open_file(path, 5000000, BITMAP_RDWR);
+    assert(w2 && bitmap_first1(w2) == -1);
+    assert(bitmap_verify(w2) == 0);
+    assert(bitmap_first1(bm) == -1);
+    /* no new readers until the writers are gone */
+    assert(bitmap_open_file(path, 0, BITMAP_RDONLY) == NULL);
+    bitmap_del(w2);
+    bitmap_del(w1);
+    bitmap_del(bm);
+    bm = bitmap_open_file(path, 0, BITMAP_RDONLY);
+    assert(bm && bitmap_verify(bm) && bitmap_first1(bm) == -1);
+    bitmap_del(bm);
+    unlink(path);
+
     return 0;
 }
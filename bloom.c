@@ -0,0 +1,213 @@
+
+// @Name   : bloom.c
+//
+// @Brief  : cache-line blocked bloom filter
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "bloom.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLOOM_X86 1
+#endif
+
+#define BATCH 16   /* keys whose blocks are prefetched together */
+
+typedef int (*probe_f)(const u64* block, const u64* mask);
+
+/* splitmix64 finalizer */
+static inline u64
+mix64(u64 x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* block of the key from the high half, the in-block mask from
+   h1 + i*h2 with h2 odd, so the k positions are distinct */
+static inline u32
+key_mask(const bloom* bf, u64 key, u64* mask)
+{
+    u64 h = mix64(key);
+    u32 block = (u32)(((h >> 32) * bf->nblock) >> 32);
+    u32 h1 = (u32)h;
+    u32 h2 = (u32)((h * 0xff51afd7ed558ccdULL) >> 32) | 1;
+    u32 i;
+    memset(mask, 0, sizeof(u64) * BLOOM_BLOCK_WORDS);
+    for(i = 0; i < bf->k; i++) {
+        u32 bit = (h1 + i * h2) % BLOOM_BLOCK_BITS;
+        mask[bit / 64] |= 1ULL << (bit % 64);
+    }
+    return block;
+}
+
+static int
+probe_scalar(const u64* block, const u64* mask)
+{
+    u64 miss = 0;
+    int i;
+    for(i = 0; i < BLOOM_BLOCK_WORDS; i++)
+        miss |= mask[i] & ~block[i];
+    return miss == 0;
+}
+
+#if defined(BLOOM_X86)
+
+static __attribute__((target("sse2"))) int
+probe_sse2(const u64* block, const u64* mask)
+{
+    __m128i miss = _mm_setzero_si128();
+    int i;
+    for(i = 0; i < BLOOM_BLOCK_WORDS; i += 2) {
+        __m128i b = _mm_load_si128((const __m128i*)(block + i));
+        __m128i m = _mm_loadu_si128((const __m128i*)(mask + i));
+        miss = _mm_or_si128(miss, _mm_andnot_si128(b, m));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(miss, _mm_setzero_si128()))
+        == 0xFFFF;
+}
+
+/* the whole line in two loads, testz on mask & ~block */
+static __attribute__((target("avx2"))) int
+probe_avx2(const u64* block, const u64* mask)
+{
+    __m256i b0 = _mm256_load_si256((const __m256i*)block);
+    __m256i b1 = _mm256_load_si256((const __m256i*)(block + 4));
+    __m256i m0 = _mm256_loadu_si256((const __m256i*)mask);
+    __m256i m1 = _mm256_loadu_si256((const __m256i*)(mask + 4));
+    return _mm256_testc_si256(b0, m0) & _mm256_testc_si256(b1, m1);
+}
+
+#endif
+
+static probe_f probe_kernel;
+static pthread_once_t probe_ctl = PTHREAD_ONCE_INIT;
+
+static void
+probe_init()
+{
+    probe_f probe = probe_scalar;
+#if defined(BLOOM_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        probe = probe_avx2;
+    else if(__builtin_cpu_supports("sse2"))
+        probe = probe_sse2;
+#endif
+    probe_kernel = probe;
+}
+
+bloom* bloom_new(u32 nkeys, u32 bits_per_key)
+{
+    assert(nkeys > 0 && bits_per_key > 0);
+    bloom* bf = (bloom*)malloc(sizeof(bloom));
+    if(bf == NULL)
+        return NULL;
+    pthread_once(&probe_ctl, probe_init);
+
+    u64 bits = (u64)nkeys * bits_per_key;
+    u64 nblock = (bits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+    assert(nblock * BLOOM_BLOCK_BITS <= 0xFFFFFFFFULL && "bloom too big");
+
+    /* k = bits_per_key * ln2 is optimal for the unblocked filter */
+    bf->k = (u32)(bits_per_key * 0.693 + 0.5);
+    if(bf->k < 1)
+        bf->k = 1;
+    if(bf->k > BLOOM_MAX_K)
+        bf->k = BLOOM_MAX_K;
+    bf->nblock = (u32)nblock;
+    bf->bits_per_key = bits_per_key;
+    bf->bm = bitmap_new((u32)(nblock * BLOOM_BLOCK_BITS));
+    if(bf->bm == NULL) {
+        free(bf);
+        return NULL;
+    }
+    return bf;
+}
+
+void bloom_del(bloom* bf)
+{
+    if(bf == NULL)
+        return;
+    bitmap_del(bf->bm);
+    free(bf);
+}
+
+void bloom_add(bloom* bf, u64 key)
+{
+    u64 mask[BLOOM_BLOCK_WORDS];
+    u32 block = key_mask(bf, key, mask);
+    u32 i;
+    for(i = 0; i < BLOOM_BLOCK_WORDS; i++)
+        if(mask[i])
+            bitmap_or_word(bf->bm, block * BLOOM_BLOCK_WORDS + i, mask[i]);
+}
+
+int bloom_tst(bloom* bf, u64 key)
+{
+    u64 mask[BLOOM_BLOCK_WORDS];
+    u32 block = key_mask(bf, key, mask);
+    return probe_kernel(bf->bm->table + block * BLOOM_BLOCK_WORDS, mask);
+}
+
+void bloom_add_batch(bloom* bf, const u64* keys, u32 n)
+{
+    u64 mask[BATCH][BLOOM_BLOCK_WORDS];
+    u32 block[BATCH];
+    u32 i, j, w, m;
+    for(i = 0; i < n; i += m) {
+        m = n - i < BATCH ? n - i : BATCH;
+        for(j = 0; j < m; j++) {
+            block[j] = key_mask(bf, keys[i + j], mask[j]);
+            __builtin_prefetch(bf->bm->table + block[j] * BLOOM_BLOCK_WORDS, 1);
+        }
+        for(j = 0; j < m; j++)
+            for(w = 0; w < BLOOM_BLOCK_WORDS; w++)
+                if(mask[j][w])
+                    bitmap_or_word(bf->bm, block[j] * BLOOM_BLOCK_WORDS + w,
+                                   mask[j][w]);
+    }
+}
+
+/* masks for a batch first, prefetching each block, then the probes,
+   so the cache misses of the batch overlap */
+u32 bloom_tst_batch(bloom* bf, const u64* keys, u32 n, unsigned char* out)
+{
+    u64 mask[BATCH][BLOOM_BLOCK_WORDS];
+    u32 block[BATCH];
+    u32 i, j, m, hit = 0;
+    const u64* t = bf->bm->table;
+    for(i = 0; i < n; i += m) {
+        m = n - i < BATCH ? n - i : BATCH;
+        for(j = 0; j < m; j++) {
+            block[j] = key_mask(bf, keys[i + j], mask[j]);
+            __builtin_prefetch(t + block[j] * BLOOM_BLOCK_WORDS);
+        }
+        for(j = 0; j < m; j++) {
+            out[i + j] = (unsigned char)
+                probe_kernel(t + block[j] * BLOOM_BLOCK_WORDS, mask[j]);
+            hit += out[i + j];
+        }
+    }
+    return hit;
+}
+
+/* the bitmap's block holds its summary levels after the table, and
+   bitmap_new rounds it up to a cache line */
+size_t bloom_bytes(bloom* bf)
+{
+    bitmap* bm = bf->bm;
+    size_t words = bm->cnt;
+    u32 l;
+    for(l = 0; l < bm->nlevel; l++)
+        words += 2 * (size_t)bm->lcnt[l];
+    return sizeof(bloom) + sizeof(bitmap) +
+        ((sizeof(u64) * words + 63) & ~(size_t)63);
+}
@@ -0,0 +1,43 @@
+
+// @Name   : BLOOM_H
+//
+// @Brief  : cache-line blocked bloom filter on top of bitmap. a key
+//           picks one 512-bit block (one cache line of bm->table)
+//           and sets k bits inside it by double hashing, so a query
+//           costs one cache miss whatever k is.
+
+#if !defined(BLOOM_H)
+#define BLOOM_H
+
+#include "bitmap.h"
+
+#define BLOOM_BLOCK_BITS  512
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+#define BLOOM_MAX_K       16
+
+typedef struct _bloom{
+    bitmap* bm;          /* nblock * BLOOM_BLOCK_BITS bits */
+    u32 nblock;
+    u32 k;               /* bits set per key */
+    u32 bits_per_key;
+}bloom;
+
+/* room for nkeys keys at bits_per_key bits each */
+bloom* bloom_new(u32 nkeys, u32 bits_per_key);
+void   bloom_del(bloom* bf);
+
+/* keys are 64-bit, they are mixed here, so plain integer ids and
+   already hashed strings both work */
+void   bloom_add(bloom* bf, u64 key);
+int    bloom_tst(bloom* bf, u64 key);
+
+/* set the bits of n keys */
+void   bloom_add_batch(bloom* bf, const u64* keys, u32 n);
+/* out[i] is 1 when keys[i] may be present,
+   return the number of such keys */
+u32    bloom_tst_batch(bloom* bf, const u64* keys, u32 n, unsigned char* out);
+
+/* heap bytes held by the filter, the bitmap's summary index included */
+size_t bloom_bytes(bloom* bf);
+
+#endif
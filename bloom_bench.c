@@ -0,0 +1,71 @@
+
+// @Name   : bloom_bench.c
+//
+// @Brief  : false positive rate, memory and query rate of the
+//           blocked bloom filter over bits per key, one key at a
+//           time and in prefetched batches.
+//           build with: make CFLAGS=-O2 bloom_bench
+//           usage: bloom_bench [keys]
+
+#include "bloom.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NPROBE (1u << 22)
+
+static volatile u32 sink;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    u32 nkeys = argc > 1 ? (u32)atoi(argv[1]) : 10000000;
+    static const u32 bpk[] = {6, 8, 10, 12, 16};
+    u64* probe = (u64*)malloc(sizeof(u64) * NPROBE);
+    unsigned char* out = (unsigned char*)malloc(NPROBE);
+    u32 i, k;
+    assert(nkeys > 0 && probe && out);
+
+    /* misses only, so every hit is a false positive */
+    for(k=0; k<NPROBE; k++)
+        probe[k] = (u64)k + (1ULL << 40);
+
+    printf("%u keys, %u probes\n", nkeys, NPROBE);
+    printf("%-6s %-3s %10s %10s %12s %12s %12s\n", "bits", "k", "fpr %",
+           "MB", "add Mk/s", "tst Mq/s", "batch Mq/s");
+    for(i = 0; i < sizeof(bpk) / sizeof(bpk[0]); i++) {
+        bloom* bf = bloom_new(nkeys, bpk[i]);
+        double t, add, one, batch;
+        u32 fp = 0;
+        assert(bf);
+
+        t = now_sec();
+        for(k=0; k<nkeys; k++)
+            bloom_add(bf, k);
+        add = nkeys / (now_sec() - t) / 1e6;
+
+        t = now_sec();
+        for(k=0; k<NPROBE; k++)
+            fp += bloom_tst(bf, probe[k]);
+        one = NPROBE / (now_sec() - t) / 1e6;
+
+        t = now_sec();
+        sink = bloom_tst_batch(bf, probe, NPROBE, out);
+        batch = NPROBE / (now_sec() - t) / 1e6;
+        assert(sink == fp);
+
+        printf("%-6u %-3u %10.4f %10.2f %12.2f %12.2f %12.2f\n", bpk[i], bf->k,
+               100.0 * fp / NPROBE, bloom_bytes(bf) / 1048576.0, add, one, batch);
+        bloom_del(bf);
+    }
+    free(probe);
+    free(out);
+    return 0;
+}
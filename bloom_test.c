@@ -0,0 +1,73 @@
+// @Name   : bloom_test.c
+//
+// @Brief  :
+
+#include "bloom.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NKEYS  200000
+#define NPROBE 1000000
+
+int main()
+{
+    bloom* bf = bloom_new(NKEYS, 10);
+    u64* keys = (u64*)malloc(sizeof(u64) * NPROBE);
+    unsigned char* out = (unsigned char*)malloc(NPROBE);
+    u32 k, fp;
+    assert(bf && keys && out);
+    assert(bf->k == 7);
+    assert(bloom_bytes(bf) >= NKEYS * 10 / 8);
+    /* the table alone is not all of it */
+    assert(bloom_bytes(bf) > sizeof(bloom) + sizeof(bitmap) +
+           (size_t)bf->nblock * BLOOM_BLOCK_BITS / 8);
+
+    /* empty filter says no to everything */
+    for(k=0; k<1000; k++)
+        assert(!bloom_tst(bf, k));
+
+    /* no false negatives, single and batch inserts alike */
+    for(k=0; k<NKEYS/2; k++)
+        bloom_add(bf, k * 2654435761ULL);
+    for(k=0; k<NKEYS/2; k++)
+        keys[k] = (NKEYS/2 + k) * 2654435761ULL;
+    bloom_add_batch(bf, keys, NKEYS/2);
+    for(k=0; k<NKEYS; k++)
+        assert(bloom_tst(bf, k * 2654435761ULL));
+    for(k=0; k<NKEYS; k++)
+        keys[k] = k * 2654435761ULL;
+    assert(bloom_tst_batch(bf, keys, NKEYS, out) == NKEYS);
+    for(k=0; k<NKEYS; k++)
+        assert(out[k] == 1);
+
+    /* about 1% false positives at 10 bits per key, blocking
+       costs a little over the textbook 0.82% */
+    for(k=0; k<NPROBE; k++)
+        keys[k] = (u64)k + (1ULL << 40);
+    fp = bloom_tst_batch(bf, keys, NPROBE, out);
+    for(k=0; k<NPROBE; k++)
+        assert(out[k] == bloom_tst(bf, keys[k]));
+    printf("bloom fpr %.4f%%\n", 100.0 * fp / NPROBE);
+    assert(fp < NPROBE / 50);
+    bloom_del(bf);
+
+    /* odd sizes and extreme bits per key */
+    bf = bloom_new(1, 1);
+    assert(bf && bf->nblock == 1 && bf->k == 1);
+    bloom_add(bf, 42);
+    assert(bloom_tst(bf, 42));
+    bloom_del(bf);
+    bf = bloom_new(1000, 64);
+    assert(bf && bf->k == BLOOM_MAX_K);
+    for(k=0; k<1000; k++)
+        bloom_add(bf, k);
+    for(k=0; k<1000; k++)
+        assert(bloom_tst(bf, k));
+    bloom_del(bf);
+
+    free(keys);
+    free(out);
+    printf("bloom test ok\n");
+    return 0;
+}
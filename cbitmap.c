@@ -0,0 +1,110 @@
+
+// @Name   : cbitmap.c
+//
+// @Brief  : lock-free bitmap, see cbitmap.h
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "cbitmap.h"
+
+#define WORD_BITS  64
+#define LINE_WORDS 8     /* 64-byte cache line */
+#define INDEX(a)   ((a)/WORD_BITS)
+#define OFFSET(a)  ((a)%WORD_BITS)
+#define BIT(a)     (1ULL << OFFSET(a))
+#define FULL       (~0ULL)
+
+cbitmap* cbitmap_new(u32 size)
+{
+    assert( size>0 && "size <= 0" );
+    cbitmap* cbm = (cbitmap*)malloc(sizeof(cbitmap));
+    if(cbm == NULL)
+        return NULL;
+
+    u32 cnt = INDEX(size) + (OFFSET(size) ? 1 : 0);
+    size_t bytes = sizeof(u64) * cnt;
+    /* round up so aligned_alloc accepts it */
+    bytes = (bytes + LINE_WORDS * sizeof(u64) - 1) & ~(LINE_WORDS * sizeof(u64) - 1);
+    cbm->size  = size;
+    cbm->cnt   = cnt;
+    cbm->table = (u64*)aligned_alloc(LINE_WORDS * sizeof(u64), bytes);
+    if(cbm->table == NULL) {
+        free(cbm);
+        return NULL;
+    }
+    memset(cbm->table, 0, bytes);
+
+    /* bits past size are kept set so nobody can claim them */
+    if(OFFSET(size))
+        cbm->table[cnt - 1] = FULL << OFFSET(size);
+    return cbm;
+}
+
+void cbitmap_del(cbitmap* cbm)
+{
+    if(cbm == NULL)
+        return;
+    free(cbm->table);
+    free(cbm);
+}
+
+int cbitmap_tst(cbitmap* cbm, u32 val)
+{
+    assert(val < cbm->size && "val out of range");
+    u64 w = __atomic_load_n(&cbm->table[INDEX(val)], __ATOMIC_ACQUIRE);
+    return (w >> OFFSET(val)) & 1;
+}
+
+int cbitmap_test_and_set(cbitmap* cbm, u32 val)
+{
+    assert(val < cbm->size && "val out of range");
+    u64 old = __atomic_fetch_or(&cbm->table[INDEX(val)], BIT(val),
+                                __ATOMIC_ACQ_REL);
+    return (old >> OFFSET(val)) & 1;
+}
+
+int cbitmap_test_and_clr(cbitmap* cbm, u32 val)
+{
+    assert(val < cbm->size && "val out of range");
+    u64 old = __atomic_fetch_and(&cbm->table[INDEX(val)], ~BIT(val),
+                                 __ATOMIC_ACQ_REL);
+    return (old >> OFFSET(val)) & 1;
+}
+
+u32 cbitmap_alloc_first0(cbitmap* cbm, u32* hint)
+{
+    assert(cbm);
+    u32 start = hint ? *hint : 0;
+    u32 i, n;
+    if(start >= cbm->cnt)
+        start = 0;
+
+    for(n = 0, i = start; n < cbm->cnt; n++) {
+        u64* p = &cbm->table[i];
+        /* a plain load first, full words are skipped without
+           taking the line exclusive */
+        u64 w = __atomic_load_n(p, __ATOMIC_RELAXED);
+        while(w != FULL) {
+            u64 bit = ~w & (w + 1);   /* lowest clear bit */
+            /* on failure w is reloaded and we retry the word */
+            if(__atomic_compare_exchange_n(p, &w, w | bit, 1,
+                                           __ATOMIC_ACQ_REL,
+                                           __ATOMIC_RELAXED)) {
+                if(hint)
+                    *hint = i;
+                return i * WORD_BITS + (u32)__builtin_ctzll(bit);
+            }
+        }
+        if(++i == cbm->cnt)
+            i = 0;
+    }
+    return -1;
+}
+
+u32 cbitmap_hint(cbitmap* cbm, u32 no, u32 n)
+{
+    assert(cbm && n > 0 && no < n);
+    u32 i = (u32)((u64)cbm->cnt * no / n);
+    return i & ~(u32)(LINE_WORDS - 1);
+}
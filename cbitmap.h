@@ -0,0 +1,37 @@
+
+// @Name   : CBITMAP_H
+//
+// @Brief  : bitmap shared between threads without a lock, every
+//           word is updated with atomic read-modify-write, ids are
+//           claimed with compare-and-swap.
+
+#if !defined(CBITMAP_H)
+#define CBITMAP_H
+
+typedef unsigned int u32;
+typedef unsigned long long u64;
+
+typedef struct _cbitmap{
+    u32 size;   /* number of bits */
+    u32 cnt;    /* number of 64-bit words in table */
+    u64* table; /* cache line aligned */
+}cbitmap;
+
+cbitmap* cbitmap_new(u32 size);
+void     cbitmap_del(cbitmap* cbm);
+int      cbitmap_tst(cbitmap* cbm, u32 val);
+
+/* return the previous state of the bit */
+int      cbitmap_test_and_set(cbitmap* cbm, u32 val);
+int      cbitmap_test_and_clr(cbitmap* cbm, u32 val);
+
+/* claim a clear bit and return its index, -1 when full.
+   the search starts at *hint and wraps around, *hint is moved to
+   the claimed word, so a thread keeping its own hint allocates
+   from its own cache lines. hint may be NULL to start at 0 */
+u32      cbitmap_alloc_first0(cbitmap* cbm, u32* hint);
+
+/* a starting hint for thread no out of n, spread over the table */
+u32      cbitmap_hint(cbitmap* cbm, u32 no, u32 n);
+
+#endif
@@ -0,0 +1,99 @@
+
+// @Name   : cbitmap_bench.c
+//
+// @Brief  : id allocation throughput from 1 to N threads, the
+//           lock-free cbitmap against bitmap behind one mutex.
+//           build with: make CFLAGS=-O2 cbitmap_bench
+//           usage: cbitmap_bench [max threads]
+
+#include "cbitmap.h"
+#include "bitmap.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NBITS  (1u << 22)
+#define BATCH  64          /* ids held by a thread before freeing */
+#define ROUNDS 20000
+
+static cbitmap* cbm;
+static bitmap*  bm;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int nthread;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* run_lockfree(void* arg)
+{
+    u32 hint = cbitmap_hint(cbm, (u32)(size_t)arg, nthread);
+    u32 ids[BATCH];
+    int r, k;
+    for(r = 0; r < ROUNDS; r++) {
+        for(k = 0; k < BATCH; k++)
+            ids[k] = cbitmap_alloc_first0(cbm, &hint);
+        for(k = 0; k < BATCH; k++)
+            cbitmap_test_and_clr(cbm, ids[k]);
+    }
+    return NULL;
+}
+
+static void* run_mutex(void* arg)
+{
+    u32 ids[BATCH];
+    int r, k;
+    (void)arg;
+    for(r = 0; r < ROUNDS; r++) {
+        for(k = 0; k < BATCH; k++) {
+            pthread_mutex_lock(&lock);
+            ids[k] = bitmap_first0(bm);
+            bitmap_set(bm, ids[k]);
+            pthread_mutex_unlock(&lock);
+        }
+        for(k = 0; k < BATCH; k++) {
+            pthread_mutex_lock(&lock);
+            bitmap_clr(bm, ids[k]);
+            pthread_mutex_unlock(&lock);
+        }
+    }
+    return NULL;
+}
+
+/* million alloc+free pairs per second */
+static double run(void* (*fn)(void*), int n)
+{
+    pthread_t th[256];
+    double t;
+    int i;
+    nthread = n;
+    t = now_sec();
+    for(i = 0; i < n; i++)
+        pthread_create(&th[i], NULL, fn, (void*)(size_t)i);
+    for(i = 0; i < n; i++)
+        pthread_join(th[i], NULL);
+    t = now_sec() - t;
+    return (double)n * ROUNDS * BATCH / t / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    int max = argc > 1 ? atoi(argv[1]) : 8, n;
+    assert(max > 0 && max <= 256);
+    cbm = cbitmap_new(NBITS);
+    bm  = bitmap_new(NBITS);
+    assert(cbm && bm);
+
+    printf("%-8s %16s %16s\n", "threads", "mutex Mop/s", "lockfree Mop/s");
+    for(n = 1; n <= max; n *= 2)
+        printf("%-8d %16.2f %16.2f\n", n, run(run_mutex, n),
+               run(run_lockfree, n));
+    cbitmap_del(cbm);
+    bitmap_del(bm);
+    return 0;
+}
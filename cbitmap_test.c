@@ -0,0 +1,92 @@
+
+// @Name   : cbitmap_test.c
+//
+// @Brief  :
+
+#include "cbitmap.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SIZE     1000003
+#define NTHREAD  4
+
+static cbitmap* cbm;
+static u32* owner[NTHREAD];
+static u32  owned[NTHREAD];
+
+static void* grab(void* arg)
+{
+    u32 no = (u32)(size_t)arg;
+    u32 hint = cbitmap_hint(cbm, no, NTHREAD);
+    u32 id;
+    while((id = cbitmap_alloc_first0(cbm, &hint)) != (u32)-1)
+        owner[no][owned[no]++] = id;
+    return NULL;
+}
+
+static void* release(void* arg)
+{
+    u32 no = (u32)(size_t)arg;
+    u32 k;
+    for(k=0; k<owned[no]; k++)
+        assert(cbitmap_test_and_clr(cbm, owner[no][k]) == 1);
+    return NULL;
+}
+
+int main()
+{
+    pthread_t th[NTHREAD];
+    u32 k, total = 0;
+    int t;
+
+    cbm = cbitmap_new(SIZE);
+    assert(cbm);
+    assert(cbitmap_tst(cbm, 1) == 0);
+    assert(cbitmap_test_and_set(cbm, 1) == 0);
+    assert(cbitmap_test_and_set(cbm, 1) == 1);
+    assert(cbitmap_tst(cbm, 1));
+    assert(cbitmap_alloc_first0(cbm, NULL) == 0);
+    assert(cbitmap_alloc_first0(cbm, NULL) == 2);
+    assert(cbitmap_test_and_clr(cbm, 1) == 1);
+    assert(cbitmap_test_and_clr(cbm, 1) == 0);
+    assert(cbitmap_alloc_first0(cbm, NULL) == 1);
+    assert(cbitmap_test_and_clr(cbm, 0) && cbitmap_test_and_clr(cbm, 1) &&
+           cbitmap_test_and_clr(cbm, 2));
+
+    /* threads race for every id, each must be handed out once */
+    for(t=0; t<NTHREAD; t++) {
+        owner[t] = (u32*)malloc(sizeof(u32) * SIZE);
+        assert(owner[t]);
+        pthread_create(&th[t], NULL, grab, (void*)(size_t)t);
+    }
+    for(t=0; t<NTHREAD; t++)
+        pthread_join(th[t], NULL);
+
+    char* seen = (char*)calloc(SIZE, 1);
+    assert(seen);
+    for(t=0; t<NTHREAD; t++) {
+        total += owned[t];
+        for(k=0; k<owned[t]; k++) {
+            assert(owner[t][k] < SIZE);
+            assert(!seen[owner[t][k]]);
+            seen[owner[t][k]] = 1;
+        }
+    }
+    assert(total == SIZE);
+    assert(cbitmap_alloc_first0(cbm, NULL) == -1);
+
+    for(t=0; t<NTHREAD; t++)
+        pthread_create(&th[t], NULL, release, (void*)(size_t)t);
+    for(t=0; t<NTHREAD; t++)
+        pthread_join(th[t], NULL);
+    for(k=0; k<SIZE; k++)
+        assert(cbitmap_tst(cbm, k) == 0);
+
+    for(t=0; t<NTHREAD; t++)
+        free(owner[t]);
+    free(seen);
+    cbitmap_del(cbm);
+    return 0;
+}
@@ -6,19 +6,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
-#ifdef __cplusplus
-#include <cstdlib>
 
-using std::malloc;
-using std::free;
-#else
-#include <stdlib.h>
-#endif
+#define HS_BATCH 16  /* keys whose lookups overlap */
 
 typedef struct _node {
   void            *key;  /* Key used for searching */
   void            *val; /* Actual content of a node */
   struct _node *next; /* Next link in the chain */
+  unsigned        code; /* Hash of the key, so a resize need not rehash */
 } hs_node;
 
 typedef struct _head {
@@ -30,6 +25,9 @@ struct _hash_table {
   hs_head     **table;    /* Dynamic chained hash table */
   size_t       size;     /* Current item count */
   size_t       capacity; /* Current table size */
+  size_t       mincap;   /* Shrinking stops at the size it was made with */
+  double       maxload;  /* Grow past this many items per bucket */
+  double       minload;  /* Shrink below this many */
   size_t       curri;    /* Current index for traversal */
   hs_node     *currl;    /* Current link for traversal */
   hash_f       hash;     /* User defined key hash function */
@@ -38,24 +36,32 @@ struct _hash_table {
   valdup_f     valdup;  /* User defined val copy function */
   keyrel_f     keyrel;   /* User defined key delete function */
   valrel_f     valrel;  /* User defined val delete function */
+  allocator    alloc;   /* Source of the table, chain and node memory */
+  memstat      mem;     /* What the table holds of it */
 };
 
 static hs_node*
-new_node(void* key, void* val, hs_node* next)
+new_node(hs_table* hstab, void* key, void* val, unsigned code,
+         hs_node* next)
 {
-    hs_node* node = (hs_node*)malloc(sizeof(hs_node));
-    assert(node);
+    hs_node* node = (hs_node*)mem_alloc(&hstab->alloc, &hstab->mem,
+                                        sizeof(hs_node));
+    if( node == NULL )
+        return NULL;
     node->key = key;
     node->val = val;
     node->next = next;
+    node->code = code;
     return node;
 }
 
 static hs_head*
-new_chain()
+new_chain(hs_table* hstab)
 {
-    hs_head* chain = (hs_head*)malloc(sizeof(hs_head));
-    assert(chain);
+    hs_head* chain = (hs_head*)mem_alloc(&hstab->alloc, &hstab->mem,
+                                         sizeof(hs_head));
+    if( chain == NULL )
+        return NULL;
     chain->first = NULL;
     chain->size  = 0;
     return chain;
@@ -73,17 +79,37 @@ hs_new(size_t size, hash_f hash, cmp_f cmp,
           keydup_f keydup, valdup_f valdup,
           keyrel_f keyrel, valrel_f valrel )
 {
-    size_t i;
-    hs_table* hstab = (hs_table*)malloc(sizeof(hs_table));
+  return hs_new_alloc ( size, hash, cmp, keydup, valdup,
+                        keyrel, valrel, NULL );
+}
+
+hs_table*
+hs_new_alloc(size_t size, hash_f hash, cmp_f cmp,
+          keydup_f keydup, valdup_f valdup,
+          keyrel_f keyrel, valrel_f valrel, const allocator *alloc )
+{
+    allocator a;
+    memstat mem;
+    hs_table* hstab;
 
+    mem_init(&a, &mem, alloc);
+    hstab = (hs_table*)mem_alloc(&a, &mem, sizeof(hs_table));
     if( hstab == NULL )
         return NULL;
-    hstab->table = (hs_head**)malloc(sizeof(hs_head*) * size);
-    assert(hstab->table);
-    memset(hstab->table, 0, sizeof(hstab->table[0]) * size);
+    hstab->alloc = a;
+    hstab->mem = mem;
+    hstab->table = (hs_head**)mem_calloc(&hstab->alloc, &hstab->mem,
+                                         sizeof(hs_head*) * size);
+    if( hstab->table == NULL ) {
+        mem_free(&a, &hstab->mem, hstab, sizeof(hs_table));
+        return NULL;
+    }
 
   hstab->size = 0;
   hstab->capacity = size;
+  hstab->mincap = size;
+  hstab->maxload = HS_MAX_LOAD;
+  hstab->minload = HS_MIN_LOAD;
   hstab->curri = 0;
   hstab->currl = NULL;
   hstab->hash = hash;
@@ -101,6 +127,7 @@ hs_delete(hs_table* hstab)
 {
     size_t i;
     hs_node *next, *it;
+    allocator alloc;
     for(i=0; i<hstab->capacity; i++) {
         if( hstab->table[i] == NULL )
             continue;
@@ -109,13 +136,16 @@ hs_delete(hs_table* hstab)
             next = it->next;
             hstab->keyrel(it->key);
             hstab->valrel(it->val);
-            free(it);
+            mem_free(&hstab->alloc, &hstab->mem, it, sizeof(hs_node));
             it = next;
         }
-        free(hstab->table[i]);
+        mem_free(&hstab->alloc, &hstab->mem, hstab->table[i],
+                 sizeof(hs_head));
     }
-    free( hstab->table );
-    free(hstab);
+    mem_free(&hstab->alloc, &hstab->mem, hstab->table,
+             sizeof(hs_head*) * hstab->capacity);
+    alloc = hstab->alloc;
+    mem_free(&alloc, &hstab->mem, hstab, sizeof(hs_table));
 }
 /*
   Find an item with the selected key
@@ -136,6 +166,61 @@ hs_find (hs_table* hstab, void *key )
   return NULL;
 }
 
+/*
+  Find the items of n keys, vals[i] for keys[i] or NULL. The bucket
+  slots, chain heads and nodes of a group of keys are prefetched a
+  stage at a time, so their cache misses overlap
+
+  Returns: The number of keys found
+*/
+size_t
+hs_find_batch ( hs_table *hstab, void **keys, size_t n, void **vals )
+{
+  unsigned h[HS_BATCH];
+  hs_node *it[HS_BATCH];
+  size_t i, j, m, live[HS_BATCH], nlive, keep, found = 0;
+
+  for ( i = 0; i < n; i += m ) {
+    m = n - i < HS_BATCH ? n - i : HS_BATCH;
+    for ( j = 0; j < m; j++ ) {
+      h[j] = hstab->hash ( keys[i + j] ) % hstab->capacity;
+      __builtin_prefetch ( &hstab->table[h[j]] );
+    }
+    for ( j = 0; j < m; j++ ) {
+      if ( hstab->table[h[j]] != NULL )
+        __builtin_prefetch ( hstab->table[h[j]] );
+    }
+    nlive = 0;
+    for ( j = 0; j < m; j++ ) {
+      vals[i + j] = NULL;
+      it[j] = hstab->table[h[j]] != NULL ? hstab->table[h[j]]->first : NULL;
+      if ( it[j] != NULL ) {
+        __builtin_prefetch ( it[j] );
+        live[nlive++] = j;
+      }
+    }
+    /* One step down every unresolved chain per round */
+    while ( nlive ) {
+      keep = 0;
+      for ( j = 0; j < nlive; j++ ) {
+        size_t q = live[j];
+        if ( hstab->cmp ( keys[i + q], it[q]->key ) == 0 ) {
+          vals[i + q] = it[q]->val;
+          ++found;
+          continue;
+        }
+        it[q] = it[q]->next;
+        if ( it[q] != NULL ) {
+          __builtin_prefetch ( it[q] );
+          live[keep++] = q;
+        }
+      }
+      nlive = keep;
+    }
+  }
+  return found;
+}
+
 /*
   Insert an item with the selected key
 
@@ -143,33 +228,42 @@ hs_find (hs_table* hstab, void *key )
 */
 int hs_insert (hs_table* hstab, void* key, void* val)
 {
-  unsigned h = hstab->hash ( key ) % hstab->capacity;
+  unsigned code = hstab->hash ( key );
+  unsigned h = code % hstab->capacity;
   hs_node* new;
   void* dupkey;
   void* dupval;
-  void* prev_val;
-  
-  if( ( prev_val = hs_find( hstab, key )) != NULL) {
-      hstab->valrel(prev_val);
-      prev_val = hstab->valdup(val);
-      return 1;
+
+  /* An existing key takes a copy of the new item */
+  if ( hstab->table[h] != NULL ) {
+    hs_node *it = hstab->table[h]->first;
+    for ( ; it != NULL; it = it->next ) {
+      if ( it->code == code && hstab->cmp ( key, it->key ) == 0 ) {
+        hstab->valrel ( it->val );
+        it->val = hstab->valdup ( val );
+        return 1;
+      }
+    }
   }
   /* Attempt to create a new item */
   dupkey = hstab->keydup ( key );
   dupval = hstab->valdup ( val );
 
-  new = new_node ( dupkey, dupval, NULL );
+  new = new_node ( hstab, dupkey, dupval, code, NULL );
 
-  if ( new == NULL )
+  if ( new == NULL ) {
+    hstab->keyrel ( dupkey );
+    hstab->valrel ( dupval );
     return 0;
+  }
 
   /* Create a chain if the bucket is empty */
   if ( hstab->table[h] == NULL ) {
-    hstab->table[h] = new_chain();
+    hstab->table[h] = new_chain ( hstab );
     if ( hstab->table[h] == NULL ) {
       hstab->keyrel ( new->key );
       hstab->valrel ( new->val );
-      free ( new );
+      mem_free ( &hstab->alloc, &hstab->mem, new, sizeof ( hs_node ) );
       return 0;
     }
   }
@@ -180,6 +274,12 @@ int hs_insert (hs_table* hstab, void* key, void* val)
 
   ++hstab->table[h]->size;
   ++hstab->size;
+
+  /* Keep the chains short, the item is in either way */
+  if ( hstab->maxload > 0 &&
+       hstab->size > hstab->capacity * hstab->maxload )
+    hs_resize ( hstab, hstab->capacity * HS_GROWTH );
+
   return 1;
 }
 
@@ -204,10 +304,11 @@ int hs_erase (hs_table* hstab, void *key )
     /* Release the node's memory */
     hstab->keyrel ( it->key );
     hstab->valrel ( it->val );
-    free ( it );
+    mem_free ( &hstab->alloc, &hstab->mem, it, sizeof ( hs_node ) );
     /* Remove the chain if it's empty */
     if ( hstab->table[h]->first == NULL ) {
-      free ( hstab->table[h] );
+      mem_free ( &hstab->alloc, &hstab->mem, hstab->table[h],
+                 sizeof ( hs_head ) );
       hstab->table[h] = NULL;
     }
     else
@@ -232,7 +333,7 @@ int hs_erase (hs_table* hstab, void *key )
     /* Release the node's memory */
     hstab->keyrel ( save->key );
     hstab->valrel ( save->val );
-    free ( save );
+    mem_free ( &hstab->alloc, &hstab->mem, save, sizeof ( hs_node ) );
 
     --hstab->table[h]->size;
   }
@@ -242,6 +343,13 @@ int hs_erase (hs_table* hstab, void *key )
 
   --hstab->size;
 
+  /* Give back buckets, though not below the starting size */
+  if ( hstab->size < hstab->capacity * hstab->minload &&
+       hstab->capacity > hstab->mincap ) {
+    size_t size = hstab->capacity / HS_GROWTH;
+    hs_resize ( hstab, size > hstab->mincap ? size : hstab->mincap );
+  }
+
   return 1;
 }
 
@@ -252,32 +360,76 @@ int hs_erase (hs_table* hstab, void *key )
 */
 int hs_resize (hs_table* hstab, size_t new_size )
 {
-  hs_table *new_hstab;
-  hs_node *it;
+  hs_head **table;
+  hs_head *chain;
+  hs_node *it, *next;
   size_t i;
+  unsigned h;
 
-  /* Build a new hash table, then assign it to the old one */
-  new_hstab = hs_new ( new_size, hstab->hash, hstab->cmp,
-    hstab->keydup, hstab->valdup, hstab->keyrel, hstab->valrel );
+  if ( new_size == 0 )
+    return 0;
 
-  if ( new_hstab == NULL )
+  table = (hs_head **)mem_calloc ( &hstab->alloc, &hstab->mem,
+                                   sizeof ( hs_head* ) * new_size );
+  if ( table == NULL )
     return 0;
 
+  /* Make every chain the nodes need first, so a failure leaves
+     the table as it was. The buckets come from the hash codes
+     the nodes keep, the user hash is not called again */
   for ( i = 0; i < hstab->capacity; i++ ) {
     if ( hstab->table[i] == NULL )
       continue;
 
-    for ( it = hstab->table[i]->first; it != NULL; it = it->next )
-      hs_insert ( new_hstab, it->key, it->val );
+    for ( it = hstab->table[i]->first; it != NULL; it = it->next ) {
+      h = it->code % new_size;
+      if ( table[h] == NULL &&
+           ( table[h] = new_chain ( hstab ) ) == NULL ) {
+        for ( h = 0; h < new_size; h++ )
+          mem_free ( &hstab->alloc, &hstab->mem, table[h],
+                     sizeof ( hs_head ) );
+        mem_free ( &hstab->alloc, &hstab->mem, table,
+                   sizeof ( hs_head* ) * new_size );
+        return 0;
+      }
+    }
   }
 
-  /* A hash table holds copies, so release the old table */
-  hs_delete ( hstab );
-  hstab = new_hstab;
+  /* Then move the nodes over, the keys and items are not copied
+     and the handle stays the same */
+  for ( i = 0; i < hstab->capacity; i++ ) {
+    chain = hstab->table[i];
+    if ( chain == NULL )
+      continue;
+
+    for ( it = chain->first; it != NULL; it = next ) {
+      next = it->next;
+      h = it->code % new_size;
+      it->next = table[h]->first;
+      table[h]->first = it;
+      ++table[h]->size;
+    }
+    mem_free ( &hstab->alloc, &hstab->mem, chain, sizeof ( hs_head ) );
+  }
+
+  mem_free ( &hstab->alloc, &hstab->mem, hstab->table,
+             sizeof ( hs_head* ) * hstab->capacity );
+  hstab->table = table;
+  hstab->capacity = new_size;
+
+  /* Resizing invalidates traversal markers */
+  hs_reset ( hstab );
 
   return 1;
 }
 
+/* Set the load factors that grow and shrink the table */
+void hs_set_load ( hs_table *hstab, double maxload, double minload )
+{
+  hstab->maxload = maxload;
+  hstab->minload = minload;
+}
+
 /* Reset the traversal markers to the beginning */
 void hs_reset ( hs_table* hstab )
 {
@@ -332,6 +484,12 @@ void *hs_item ( hs_table *hstab )
   return hstab->currl != NULL ? hstab->currl->val : NULL;
 }
 
+/* Live bytes and blocks of the table */
+void hs_mem ( hs_table *hstab, memstat *mem )
+{
+  *mem = hstab->mem;
+}
+
 /* Current number of items in the table */
 size_t hs_size (hs_table* hstab )
 {
@@ -344,43 +502,48 @@ size_t hs_capacity (hs_table* hstab )
   return hstab->capacity;
 }
 
-#if 0
 /* Get statistics for the hash table */
-hs_stat_t *hs_stat ( hs_table *hstab )
+void hs_stat ( hs_table *hstab, hs_stat_t *stat, size_t sample )
 {
-  hs_stat_t *stat;
-  double sum = 0, used = 0;
-  size_t i;
-
-  /* No stats for an empty table */
-  if ( hstab->size == 0 )
-    return NULL;
-
-  stat = (hs_stat_t *)malloc ( sizeof *stat );
-
-  if ( stat == NULL )
-    return NULL;
-
-  stat->lchain = 0;
-  stat->schain = (size_t)-1;
-
-  for ( i = 0; i < hstab->capacity; i++ ) {
-    if ( hstab->table[i] != NULL ) {
-      sum += hstab->table[i]->size;
+  double sum = 0, hits = 0, used = 0;
+  size_t i, b, len;
+
+  memset ( stat, 0, sizeof *stat );
+  if ( sample == 0 || sample > hstab->capacity )
+    sample = hstab->capacity;
+
+  /* A sample walks a golden ratio sequence over the buckets, a fixed
+     stride could line up with a pattern in the keys */
+  for ( i = 0; i < sample; i++ ) {
+    b = sample == hstab->capacity ? i :
+      (size_t)( ( (unsigned long long)(unsigned)( i * 2654435769u ) *
+                  hstab->capacity ) >> 32 );
+    len = hstab->table[b] != NULL ? hstab->table[b]->size : 0;
+    ++stat->sampled;
+    ++stat->chains[len < HS_STAT_CHAINS ? len : HS_STAT_CHAINS - 1];
+
+    if ( len == 0 )
+      continue;
 
-      ++used; /* Non-empty buckets */
+    sum += len;
+    /* The i-th node of a chain is found after i compares */
+    hits += (double)len * ( len + 1 ) / 2;
+    ++used; /* Non-empty buckets */
 
-      if ( hstab->table[i]->size > stat->lchain )
-        stat->lchain = hstab->table[i]->size;
+    if ( len > stat->lchain )
+      stat->lchain = len;
 
-      if ( hstab->table[i]->size < stat->schain )
-        stat->schain = hstab->table[i]->size;
-    }
+    if ( stat->schain == 0 || len < stat->schain )
+      stat->schain = len;
   }
 
-  stat->load = used / hstab->capacity;
-  stat->achain = sum / used;
-
-  return stat;
+  stat->load = (double)hstab->size / hstab->capacity;
+  stat->achain = used ? sum / used : 0;
+  stat->empty = ( stat->sampled - used ) / stat->sampled;
+  stat->hit_probe = sum ? hits / sum : 0;
+  stat->miss_probe = sum / stat->sampled;
+  /* Chain heads estimated from the sampled share in use */
+  stat->bytes = sizeof *hstab + hstab->capacity * sizeof ( hs_head* ) +
+    (size_t)( used / stat->sampled * hstab->capacity ) * sizeof ( hs_head ) +
+    hstab->size * sizeof ( hs_node );
 }
-#endif 
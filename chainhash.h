@@ -5,6 +5,8 @@
   Hash table library using separate chaining
 
 */
+#include "alloc.h"
+
 #ifdef __cplusplus
 #include <cstddef>
 
@@ -35,14 +37,24 @@ typedef void     (*keyrel_f) ( void *key );
 /* Application specific data deletion function */
 typedef void     (*valrel_f) ( void *item );
 
-#if 0
+#define HS_STAT_CHAINS 16 /* Chain length bins, the last for longer */
+
+#define HS_MAX_LOAD  1.0   /* Grow when items per bucket pass this */
+#define HS_MIN_LOAD  0.125 /* Shrink when they fall below this */
+#define HS_GROWTH    2     /* Table size factor per resize */
+
 typedef struct jsw_hstat {
-  double load;            /* Table load factor: (M chains)/(table size) */
-  double achain;          /* Average chain length */
+  double load;            /* Table load factor: (N items)/(table size) */
+  double achain;          /* Average non-empty chain length */
   size_t lchain;          /* Longest chain */
-  size_t schain;          /* Shortest non-empty chain */
-} jsw_hstat_t;
-#endif
+  size_t schain;          /* Shortest non-empty chain, 0 if none */
+  double empty;           /* Share of empty buckets */
+  double hit_probe;       /* Average compares of a find that hits */
+  double miss_probe;      /* Average compares of a find that misses */
+  size_t sampled;         /* Buckets looked at */
+  size_t chains[HS_STAT_CHAINS]; /* Sampled buckets by chain length */
+  size_t bytes;           /* Table, chain and node memory */
+} hs_stat_t;
 /*
   Create a new hash table with a capacity of size, and
   user defined functions for handling keys and items.
@@ -53,6 +65,17 @@ hs_table* hs_new ( size_t size, hash_f hash, cmp_f cmp,
                        keydup_f keydup, valdup_f valdup,
                        keyrel_f keyrel, valrel_f valrel );
 
+/*
+  Same as hs_new, with the table, chain and node memory taken
+  from alloc, or from malloc if alloc is NULL
+
+  Returns: An empty hash table, or NULL on failure.
+*/
+hs_table* hs_new_alloc ( size_t size, hash_f hash, cmp_f cmp,
+                         keydup_f keydup, valdup_f valdup,
+                         keyrel_f keyrel, valrel_f valrel,
+                         const allocator *alloc );
+
 /* Release all memory used by the hash table */
 void         hs_delete ( hs_table *hstab );
 
@@ -64,26 +87,49 @@ void         hs_delete ( hs_table *hstab );
 void        *hs_find ( hs_table *hstab, void *key );
 
 /*
-  Insert an item with the selected key
+  Find the items of n keys at once, vals[i] for keys[i] or NULL,
+  with the cache misses of the lookups overlapped
+
+  Returns: The number of keys found
+*/
+size_t       hs_find_batch ( hs_table *hstab, void **keys, size_t n,
+                             void **vals );
+
+/*
+  Insert an item with the selected key. An insert that grows the
+  table resets the traversal markers
 
   Returns: non-zero for success, zero for failure
 */
 int          hs_insert ( hs_table *hstab, void *key, void *item );
 
 /*
-  Remove an item with the selected key
+  Remove an item with the selected key. This resets the traversal
+  markers, and it may shrink the table, so a traversal that erases
+  as it goes starts over from the first bucket: collect the keys
+  and erase them after the traversal instead
 
   Returns: non-zero for success, zero for failure
 */
 int          hs_erase ( hs_table *hstab, void *key );
 
 /*
-  Grow or shrink the table, this is a slow operation
+  Grow or shrink the table, this is a slow operation. The nodes
+  are moved, not copied, and hstab stays valid. Inserts and erases
+  call it on their own as the load factor crosses its bounds
   
   Returns: non-zero for success, zero for failure
 */
 int          hs_resize ( hs_table *hstab, size_t new_size );
 
+/*
+  Set the items per bucket past which an insert doubles the table,
+  and below which an erase halves it, down to the size hs_new was
+  given. 0 turns either off, HS_MAX_LOAD and HS_MIN_LOAD by default
+*/
+void         hs_set_load ( hs_table *hstab, double maxload,
+                           double minload );
+
 /* Reset the traversal markers to the beginning */
 void         hs_reset ( hs_table *hstab );
 
@@ -102,8 +148,18 @@ size_t       hs_size ( hs_table *hstab );
 /* Total allowable number of items without resizing */
 size_t       hs_capacity ( hs_table *hstab );
 
-/* Get statistics for the hash table */
-//hs_stat_t *jsw_hstat ( hs_table *hstab );
+/*
+  Live bytes and blocks the table holds of its allocator, not
+  counting what keydup and valdup hand it
+*/
+void         hs_mem ( hs_table *hstab, memstat *mem );
+
+/*
+  Get statistics for the hash table from sample buckets spread over
+  it, all of them for 0. Chain lengths are kept in the chain
+  heads, so no node is visited and the table is only read
+*/
+void         hs_stat ( hs_table *hstab, hs_stat_t *stat, size_t sample );
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,85 @@
+// @Name   : chainhash_bench.c
+//
+// @Brief  : random lookups one at a time against hs_find_batch, on a
+//           table meant to be well beyond the last level cache.
+//           build with: make CFLAGS=-O2 chainhash_bench
+//           usage: chainhash_bench [keys]
+
+#include "chainhash.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef unsigned int u32;
+typedef unsigned long long u64;
+
+#define NOPS 4000000
+
+/* keys are the pointer values themselves, nothing is dupped */
+static unsigned id_hash(const void* a)
+{
+    u32 key = (u32)(uintptr_t)a;
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static int   id_cmp(const void* a, const void* b) { return a != b; }
+static void* id_dup(const void* key) { return (void*)key; }
+static void  id_rel(void* key) { (void)key; }
+
+static u64 now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    static const u32 sizes[] = {1, 16, 64, 256};
+    u32 n = argc > 1 ? (u32)atol(argv[1]) : 16000000;
+    hs_table* hs = hs_new(n, &id_hash, &id_cmp, &id_dup, &id_dup,
+                          &id_rel, &id_rel);
+    void** keys = (void**)malloc(sizeof(void*) * NOPS);
+    void** vals = (void**)malloc(sizeof(void*) * NOPS);
+    u32 k, s, seed = 1;
+    size_t found;
+    u64 t;
+    assert(n > 0 && hs && keys && vals);
+    for(k=1; k<=n; k++)
+        hs_insert(hs, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+    /* three quarters hits */
+    for(k=0; k<NOPS; k++) {
+        seed = seed * 1103515245 + 12345;
+        keys[k] = (void*)(uintptr_t)((seed >> 2) % (n + n / 3) + 1);
+    }
+
+    printf("%u keys in %zu buckets\n", n, hs_capacity(hs));
+    printf("%-8s %10s %10s\n", "batch", "Mfind/s", "ns/find");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        found = 0;
+        t = now_ns();
+        if(sizes[s] == 1) {
+            for(k=0; k<NOPS; k++)
+                found += (vals[k] = hs_find(hs, keys[k])) != NULL;
+        } else {
+            for(k=0; k<NOPS; k+=sizes[s])
+                found += hs_find_batch(hs, keys + k, sizes[s], vals + k);
+        }
+        t = now_ns() - t;
+        printf("%-8u %10.2f %10.1f\n", sizes[s], NOPS / (t / 1e9) / 1e6,
+               (double)t / NOPS);
+        assert(found > NOPS / 2);
+    }
+    hs_delete(hs);
+    free(keys);
+    free(vals);
+    return 0;
+}
@@ -74,6 +74,150 @@ void int_rel(void* key)
     free((int*)key);
 }
 
+/* malloc with its own count of the live bytes and blocks */
+typedef struct {
+    size_t bytes;
+    size_t blocks;
+}counter;
+
+static void* count_alloc(void* ctx, size_t size)
+{
+    counter* c = (counter*)ctx;
+    c->bytes += size;
+    c->blocks++;
+    return malloc(size);
+}
+
+static void count_free(void* ctx, void* ptr, size_t size)
+{
+    counter* c = (counter*)ctx;
+    c->bytes -= size;
+    c->blocks--;
+    free(ptr);
+}
+
+/* every block goes through the allocator and is counted */
+static void test_alloc()
+{
+    counter c = {0, 0};
+    allocator alloc = {count_alloc, NULL, count_free, &c};
+    hs_table* hs = hs_new_alloc(64, &int_hash2, &int_cmp, &int_dup,
+                                &int_dup, &int_rel, &int_rel, &alloc);
+    memstat mem;
+    int k;
+    assert(hs);
+    /* a fixed size, so every bucket gets a chain */
+    hs_set_load(hs, 0, 0);
+    hs_mem(hs, &mem);
+    assert(mem.bytes == c.bytes && mem.blocks == 2 && mem.allocs == 2);
+    for(k=0; k<1000; k++)
+        assert(hs_insert(hs, &k, &k));
+    hs_mem(hs, &mem);
+    assert(mem.bytes == c.bytes && mem.blocks == c.blocks);
+    assert(mem.blocks == 2 + 1000 + 64 && mem.allocs == mem.blocks);
+    for(k=0; k<1000; k += 2)
+        assert(hs_erase(hs, &k));
+    hs_mem(hs, &mem);
+    assert(mem.bytes == c.bytes && mem.blocks == c.blocks);
+    assert(mem.allocs == 2 + 1000 + 64);
+    hs_delete(hs);
+    assert(c.bytes == 0 && c.blocks == 0);
+}
+
+static size_t dups, hashes;
+
+void* count_dup(const void* key)
+{
+    dups++;
+    return int_dup(key);
+}
+
+unsigned count_hash(const void* a)
+{
+    hashes++;
+    return int_hash2(a);
+}
+
+/* chains in use, one block each */
+static size_t chains(hs_table* hs)
+{
+    hs_stat_t st;
+    hs_stat(hs, &st, 0);
+    return st.sampled - st.chains[0];
+}
+
+/* the table follows the load factor and moves its nodes */
+static void test_resize()
+{
+    hs_table* hs = hs_new(100, &count_hash, &int_cmp, &count_dup,
+                          &count_dup, &int_rel, &int_rel);
+    hs_table* same = hs;
+    memstat mem;
+    size_t n;
+    int k;
+    assert(hs);
+    for(k=0; k<100000; k++) {
+        assert(hs_insert(hs, &k, &k));
+        assert(hs_size(hs) <= hs_capacity(hs) * HS_MAX_LOAD);
+    }
+    assert(hs == same && hs_capacity(hs) == 100 << 10);
+    assert(dups == 2 * 100000);
+    for(k=0; k<100000; k++)
+        assert(*(int*)hs_find(hs, &k) == k);
+    hs_mem(hs, &mem);
+    assert(mem.blocks == 2 + 100000 + chains(hs));
+
+    /* by hand, nothing is copied or rehashed and the traversal sees
+       it all */
+    n = hashes;
+    assert(hs_resize(hs, 77777) && hs_capacity(hs) == 77777);
+    assert(dups == 2 * 100000 && hs_size(hs) == 100000);
+    assert(hashes == n);
+    for(n=0, hs_reset(hs); hs_key(hs) != NULL; hs_next(hs), n++)
+        assert(*(int*)hs_item(hs) == *(const int*)hs_key(hs));
+    assert(n == 100000);
+    assert(hs_resize(hs, 0) == 0 && hs_capacity(hs) == 77777);
+
+    /* erasing shrinks it back to where it started */
+    for(k=0; k<100000; k++) {
+        assert(hs_erase(hs, &k));
+        assert(hs_size(hs) >= hs_capacity(hs) * HS_MIN_LOAD ||
+               hs_capacity(hs) == 100);
+    }
+    assert(hs_capacity(hs) == 100);
+    hs_mem(hs, &mem);
+    assert(mem.blocks == 2 && chains(hs) == 0);
+    hs_delete(hs);
+}
+
+/* an insert of a present key replaces the item, with one hash and
+   no new node */
+static void test_update()
+{
+    hs_table* hs = hs_new(100, &count_hash, &int_cmp, &int_dup,
+                          &int_dup, &int_rel, &int_rel);
+    memstat mem;
+    size_t blocks;
+    int k, v;
+    assert(hs);
+    for(k=0; k<1000; k++)
+        assert(hs_insert(hs, &k, &k));
+    hs_mem(hs, &mem);
+    blocks = mem.blocks;
+    hashes = 0;
+    for(k=0; k<1000; k++) {
+        v = -k;
+        assert(hs_insert(hs, &k, &v));
+        assert(*(int*)hs_find(hs, &k) == -k);
+    }
+    assert(hashes == 2 * 1000 && hs_size(hs) == 1000);
+    hs_mem(hs, &mem);
+    assert(mem.blocks == blocks);
+    for(k=0; k<1000; k++)
+        assert(*(int*)hs_find(hs, &k) == -k);
+    hs_delete(hs);
+}
+
 int main()
 {
     hs_table* hs = hs_new(100, &int_hash2, &int_cmp, &int_dup, &int_dup,
@@ -81,6 +225,51 @@ int main()
 
     assert(hs);
     int k;
+
+    test_alloc();
+    test_resize();
+    test_update();
+
+    /* the stat checks want the 100 buckets */
+    hs_set_load(hs, 0, 0);
+
+    /* batched lookups, hits and misses */
+    int keys[1000];
+    void* ptrs[1000];
+    void* vals[1000];
+    for(k=0; k<500; k++)
+        hs_insert(hs, &k, &k);
+    for(k=0; k<1000; k++) {
+        keys[k] = (k * 7919) % 1000;
+        ptrs[k] = &keys[k];
+    }
+    assert(hs_find_batch(hs, ptrs, 1000, vals) == 500);
+    for(k=0; k<1000; k++) {
+        assert(vals[k] == hs_find(hs, &keys[k]));
+        assert(keys[k] < 500 ? *(int*)vals[k] == keys[k] : vals[k] == NULL);
+    }
+
+    /* 500 items in 100 buckets */
+    hs_stat_t st;
+    size_t n = 0, items = 0;
+    hs_stat(hs, &st, 0);
+    assert(st.sampled == 100 && st.load == 5.0);
+    for(k=0; k<HS_STAT_CHAINS; k++) {
+        n += st.chains[k];
+        items += k * st.chains[k];
+    }
+    assert(n == 100 && st.lchain >= st.schain && st.schain > 0);
+    assert(st.lchain >= HS_STAT_CHAINS - 1 || items == 500);
+    assert(st.hit_probe >= 1.0 && st.miss_probe == 5.0);
+    hs_stat(hs, &st, 10);
+    assert(st.sampled == 10);
+
+    for(k=0; k<500; k++)
+        hs_erase(hs, &k);
+    assert(hs_size(hs) == 0);
+    hs_stat(hs, &st, 0);
+    assert(st.empty == 1.0 && st.lchain == 0 && st.hit_probe == 0);
+
     srand(time(NULL));
     for(k=0; k<100000000; k++)
     {
@@ -0,0 +1,537 @@
+
+// @Name   : FLAT_HASH_MAP_H
+//
+// @Brief  : dsc::flat_hash_map, the hashmap.c layout as a C++ template.
+//           a power of two array of bucket heads points into one array
+//           of items, each chained to the next of its bucket by index
+//           and carrying its cached hash code. keys and values are
+//           stored inline in the items and moved, not copied, when the
+//           table grows. hash and equality are template parameters so
+//           they inline, and find/count/contains/erase take any type
+//           both accept when they define is_transparent.
+//           erase moves the last item into the hole, which keeps the
+//           items packed and iteration a walk over one array. as with
+//           a rehash, insert and erase invalidate iterators and
+//           references.
+
+#if !defined(FLAT_HASH_MAP_H)
+#define FLAT_HASH_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace dsc {
+
+namespace detail {
+
+template <class T, class = void>
+struct is_transparent : std::false_type {};
+
+template <class T>
+struct is_transparent<T, typename std::conditional<
+    true, void, typename T::is_transparent>::type> : std::true_type {};
+
+/* depends on the key type Q, so a lookup template is left out of
+   overloading rather than failing to compile */
+template <class Hash, class Eq, class Q>
+struct transparent : std::integral_constant<bool,
+    is_transparent<Hash>::value && is_transparent<Eq>::value> {};
+
+}
+
+template <class K, class V,
+          class Hash  = std::hash<K>,
+          class Eq    = std::equal_to<K>,
+          class Alloc = std::allocator<std::pair<K, V> > >
+class flat_hash_map {
+public:
+    typedef K                key_type;
+    typedef V                mapped_type;
+    /* the key of an item must not be changed through an iterator */
+    typedef std::pair<K, V>  value_type;
+    typedef std::size_t      size_type;
+    typedef Hash             hasher;
+    typedef Eq               key_equal;
+    typedef Alloc            allocator_type;
+
+    static const std::uint32_t MIN_SHIFT = 4;   /* at least 16 buckets */
+
+private:
+    typedef std::uint32_t u32;
+
+    struct item {
+        u32 next;
+        u32 code;
+        alignas(value_type) unsigned char kv[sizeof(value_type)];
+
+        /* storage for construct, get once it holds a value */
+        value_type* raw() { return reinterpret_cast<value_type*>(kv); }
+        value_type* get()
+        { return std::launder(reinterpret_cast<value_type*>(kv)); }
+        const value_type* get() const
+        { return std::launder(reinterpret_cast<const value_type*>(kv)); }
+    };
+
+    typedef std::allocator_traits<Alloc> traits;
+    typedef typename traits::template rebind_alloc<item> item_alloc;
+    typedef typename traits::template rebind_alloc<u32>  code_alloc;
+    typedef std::allocator_traits<item_alloc> item_traits;
+    typedef std::allocator_traits<code_alloc> code_traits;
+
+    template <class Q, class R>
+    using if_transparent = typename std::enable_if<
+        detail::transparent<Hash, Eq, Q>::value, R>::type;
+
+    template <bool Const>
+    class iter {
+        typedef typename std::conditional<Const, const item*, item*>::type
+            item_ptr;
+        item_ptr p;
+        friend class flat_hash_map;
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef flat_hash_map::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const value_type*,
+                                          value_type*>::type pointer;
+        typedef typename std::conditional<Const, const value_type&,
+                                          value_type&>::type reference;
+
+        iter() : p(nullptr) {}
+        explicit iter(item_ptr p) : p(p) {}
+        /* iterator to const_iterator */
+        template <bool C, class = typename std::enable_if<Const && !C>::type>
+        iter(const iter<C>& other) : p(other.p) {}
+
+        reference operator*() const { return *p->get(); }
+        pointer operator->() const { return p->get(); }
+        iter& operator++() { ++p; return *this; }
+        iter operator++(int) { iter t = *this; ++p; return t; }
+        bool operator==(const iter& o) const { return p == o.p; }
+        bool operator!=(const iter& o) const { return p != o.p; }
+    };
+
+public:
+    typedef iter<false> iterator;
+    typedef iter<true>  const_iterator;
+
+    flat_hash_map() : flat_hash_map(0) {}
+
+    explicit flat_hash_map(size_type n, const Hash& hash = Hash(),
+                           const Eq& eq = Eq(), const Alloc& alloc = Alloc())
+        : hash_(hash), eq_(eq), items_alloc_(alloc), codes_alloc_(alloc),
+          codelist_(nullptr), items_(nullptr), size_(0), capacity_(0),
+          shift_(0)
+    {
+        rebuild(shift_for(n));
+    }
+
+    /* delegates, so the map is built before the items are copied and
+       the destructor frees what there is if a copy throws */
+    flat_hash_map(const flat_hash_map& other)
+        : flat_hash_map(other.size_, other.hash_, other.eq_,
+              Alloc(item_traits::select_on_container_copy_construction(
+                        other.items_alloc_)))
+    {
+        for(const_iterator it = other.begin(); it != other.end(); ++it)
+            add(it.p->code, it->first, it->second);
+    }
+
+    flat_hash_map(flat_hash_map&& other) noexcept
+        : hash_(std::move(other.hash_)), eq_(std::move(other.eq_)),
+          items_alloc_(std::move(other.items_alloc_)),
+          codes_alloc_(std::move(other.codes_alloc_)),
+          codelist_(other.codelist_), items_(other.items_),
+          size_(other.size_), capacity_(other.capacity_),
+          shift_(other.shift_)
+    {
+        other.codelist_ = nullptr;
+        other.items_    = nullptr;
+        other.size_     = other.capacity_ = other.shift_ = 0;
+    }
+
+    flat_hash_map& operator=(flat_hash_map other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    /* a moved-from map is empty and can be used again */
+    ~flat_hash_map() { release(); }
+
+    void swap(flat_hash_map& other) noexcept
+    {
+        using std::swap;
+        swap(hash_, other.hash_);
+        swap(eq_, other.eq_);
+        swap(items_alloc_, other.items_alloc_);
+        swap(codes_alloc_, other.codes_alloc_);
+        swap(codelist_, other.codelist_);
+        swap(items_, other.items_);
+        swap(size_, other.size_);
+        swap(capacity_, other.capacity_);
+        swap(shift_, other.shift_);
+    }
+
+    iterator begin() { return iterator(items_ + 1); }
+    iterator end() { return iterator(items_ + 1 + size_); }
+    const_iterator begin() const { return const_iterator(items_ + 1); }
+    const_iterator end() const { return const_iterator(items_ + 1 + size_); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    size_type size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_type bucket_count() const { return codesize(); }
+    /* items that fit before the next rebuild */
+    size_type capacity() const { return capacity_; }
+    float load_factor() const { return float(size_) / codesize(); }
+
+    hasher hash_function() const { return hash_; }
+    key_equal key_eq() const { return eq_; }
+    allocator_type get_allocator() const { return Alloc(items_alloc_); }
+
+    void clear()
+    {
+        destroy_items();
+        if( codelist_ )
+            std::memset(codelist_, 0, sizeof(u32) * codesize());
+    }
+
+    /* room for n items without a rebuild */
+    void reserve(size_type n)
+    {
+        if( n > capacity_ )
+            rebuild(shift_for(n));
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args)
+    {
+        return emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args)
+    {
+        return emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        value_type kv(std::forward<Args>(args)...);
+        return emplace_key(std::move(kv.first), std::move(kv.second));
+    }
+
+    std::pair<iterator, bool> insert(const value_type& kv)
+    {
+        return emplace_key(kv.first, kv.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type&& kv)
+    {
+        return emplace_key(std::move(kv.first), std::move(kv.second));
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const K& key, M&& val)
+    {
+        std::pair<iterator, bool> res = emplace_key(key, std::forward<M>(val));
+        if( !res.second )
+            res.first->second = std::forward<M>(val);
+        return res;
+    }
+
+    V& operator[](const K& key) { return emplace_key(key).first->second; }
+    V& operator[](K&& key)
+    {
+        return emplace_key(std::move(key)).first->second;
+    }
+
+    V& at(const K& key)
+    {
+        u32 idx = lookup(key);
+        if( idx == 0 )
+            throw std::out_of_range("dsc::flat_hash_map::at");
+        return items_[idx].get()->second;
+    }
+
+    const V& at(const K& key) const
+    {
+        return const_cast<flat_hash_map*>(this)->at(key);
+    }
+
+    iterator find(const K& key) { return to_iter(lookup(key)); }
+    const_iterator find(const K& key) const
+    {
+        return to_citer(lookup(key));
+    }
+    size_type count(const K& key) const { return lookup(key) != 0; }
+    bool contains(const K& key) const { return lookup(key) != 0; }
+    size_type erase(const K& key) { return erase_key(key); }
+
+    /* heterogeneous lookup, without building a K */
+    template <class Q>
+    if_transparent<Q, iterator> find(const Q& key)
+    {
+        return to_iter(lookup(key));
+    }
+    template <class Q>
+    if_transparent<Q, const_iterator> find(const Q& key) const
+    {
+        return to_citer(lookup(key));
+    }
+    template <class Q>
+    if_transparent<Q, size_type> count(const Q& key) const
+    {
+        return lookup(key) != 0;
+    }
+    template <class Q>
+    if_transparent<Q, bool> contains(const Q& key) const
+    {
+        return lookup(key) != 0;
+    }
+    template <class Q>
+    if_transparent<Q, size_type> erase(const Q& key) { return erase_key(key); }
+
+    /* the item after pos, which is the one moved into its place */
+    iterator erase(const_iterator pos)
+    {
+        u32 idx = u32(pos.p - items_);
+        u32* link = &codelist_[bucket_of(items_[idx].code)];
+        while( *link != idx )
+            link = &items_[*link].next;
+        *link = items_[idx].next;
+        remove(idx);
+        return iterator(items_ + idx);
+    }
+
+    iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+
+private:
+    Hash hash_;
+    Eq   eq_;
+    item_alloc items_alloc_;
+    code_alloc codes_alloc_;
+    u32*  codelist_;    /* bucket heads, 0 ends a chain */
+    item* items_;       /* items_[1..size_], slot 0 is never used */
+    u32   size_;
+    u32   capacity_;    /* half the buckets */
+    u32   shift_;       /* log2 of the buckets */
+
+    size_type codesize() const { return size_type(1) << shift_; }
+
+    /* fold size_t hashes to the 32-bit code kept in the item */
+    template <class Q>
+    u32 code_of(const Q& key) const
+    {
+        std::uint64_t h = hash_(key);
+        return u32(h ^ (h >> 32));
+    }
+
+    /* fibonacci hashing, as HASH_INDEX_FIB, weak low bits of the
+       hash still spread over the buckets */
+    u32 bucket_of(u32 code) const { return bucket_of(code, shift_); }
+
+    static u32 bucket_of(u32 code, u32 shift)
+    {
+        return (code * 2654435769u) >> (32 - shift);
+    }
+
+    static u32 shift_for(size_type n)
+    {
+        u32 shift = MIN_SHIFT;
+        while( (size_type(1) << shift) / 2 < n )
+            shift++;
+        if( shift > 32 )
+            throw std::length_error("dsc::flat_hash_map too large");
+        return shift;
+    }
+
+    iterator to_iter(u32 idx)
+    {
+        return idx ? iterator(items_ + idx) : end();
+    }
+
+    const_iterator to_citer(u32 idx) const
+    {
+        return idx ? const_iterator(items_ + idx) : end();
+    }
+
+    template <class Q>
+    u32 lookup(const Q& key) const
+    {
+        if( size_ == 0 )
+            return 0;
+        u32 code = code_of(key);
+        u32 idx = codelist_[bucket_of(code)];
+        while( idx ) {
+            const item& it = items_[idx];
+            if( it.code == code && eq_(it.get()->first, key) )
+                return idx;
+            idx = it.next;
+        }
+        return 0;
+    }
+
+    template <class KK, class... Args>
+    std::pair<iterator, bool> emplace_key(KK&& key, Args&&... args)
+    {
+        u32 code = code_of(key);
+        u32 idx = size_ ? codelist_[bucket_of(code)] : 0;
+        for( ; idx; idx = items_[idx].next ) {
+            const item& it = items_[idx];
+            if( it.code == code && eq_(it.get()->first, key) )
+                return std::make_pair(iterator(items_ + idx), false);
+        }
+        idx = add(code, std::forward<KK>(key), std::forward<Args>(args)...);
+        return std::make_pair(iterator(items_ + idx), true);
+    }
+
+    /* a new item of code at the head of its bucket, the key is known
+       to be absent */
+    template <class KK, class... Args>
+    u32 add(u32 code, KK&& key, Args&&... args)
+    {
+        if( size_ == capacity_ )
+            rebuild(shift_ < MIN_SHIFT ? MIN_SHIFT : shift_ + 1);
+        u32 idx = size_ + 1;
+        item& it = items_[idx];
+        item_traits::construct(items_alloc_, it.raw(),
+            std::piecewise_construct,
+            std::forward_as_tuple(std::forward<KK>(key)),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        u32 b = bucket_of(code);
+        it.code = code;
+        it.next = codelist_[b];
+        codelist_[b] = idx;
+        size_++;
+        return idx;
+    }
+
+    template <class Q>
+    size_type erase_key(const Q& key)
+    {
+        if( size_ == 0 )
+            return 0;
+        u32 code = code_of(key);
+        u32* link = &codelist_[bucket_of(code)];
+        while( *link ) {
+            u32 idx = *link;
+            item& it = items_[idx];
+            if( it.code == code && eq_(it.get()->first, key) ) {
+                *link = it.next;
+                remove(idx);
+                return 1;
+            }
+            link = &it.next;
+        }
+        return 0;
+    }
+
+    /* idx is unlinked already, the last item moves into it */
+    void remove(u32 idx)
+    {
+        u32 last = size_;
+        item_traits::destroy(items_alloc_, items_[idx].get());
+        if( idx != last ) {
+            item& from = items_[last];
+            u32* link = &codelist_[bucket_of(from.code)];
+            while( *link != last )
+                link = &items_[*link].next;
+            *link = idx;
+            item_traits::construct(items_alloc_, items_[idx].raw(),
+                                   std::move(*from.get()));
+            items_[idx].code = from.code;
+            items_[idx].next = from.next;
+            item_traits::destroy(items_alloc_, from.get());
+        }
+        size_--;
+    }
+
+    /* new arrays for 2^shift buckets, the items are moved over in
+       order and chained again from their cached codes. a type whose
+       move may throw is copied instead, and if a copy throws the new
+       arrays are dropped and the map is left as it was */
+    void rebuild(u32 shift)
+    {
+        size_type nbucket = size_type(1) << shift;
+        u32 capacity = u32(nbucket / 2);
+        u32* codelist = code_traits::allocate(codes_alloc_, nbucket);
+        item* items;
+        try {
+            items = item_traits::allocate(items_alloc_, capacity + 1);
+        } catch(...) {
+            code_traits::deallocate(codes_alloc_, codelist, nbucket);
+            throw;
+        }
+        std::memset(codelist, 0, sizeof(u32) * nbucket);
+
+        u32 idx = 1;
+        try {
+            for( ; idx <= size_; idx++)
+                item_traits::construct(items_alloc_, items[idx].raw(),
+                    std::move_if_noexcept(*items_[idx].get()));
+        } catch(...) {
+            while( --idx )
+                item_traits::destroy(items_alloc_, items[idx].get());
+            item_traits::deallocate(items_alloc_, items, capacity + 1);
+            code_traits::deallocate(codes_alloc_, codelist, nbucket);
+            throw;
+        }
+        for(idx = 1; idx <= size_; idx++) {
+            item& from = items_[idx];
+            u32 b = bucket_of(from.code, shift);
+            items[idx].code = from.code;
+            items[idx].next = codelist[b];
+            codelist[b] = idx;
+            item_traits::destroy(items_alloc_, from.get());
+        }
+        if( codelist_ ) {
+            code_traits::deallocate(codes_alloc_, codelist_, codesize());
+            item_traits::deallocate(items_alloc_, items_, capacity_ + 1);
+        }
+        codelist_ = codelist;
+        items_    = items;
+        capacity_ = capacity;
+        shift_    = shift;
+    }
+
+    void destroy_items()
+    {
+        for(u32 idx = 1; idx <= size_; idx++)
+            item_traits::destroy(items_alloc_, items_[idx].get());
+        size_ = 0;
+    }
+
+    void release()
+    {
+        if( codelist_ == nullptr )
+            return;
+        destroy_items();
+        code_traits::deallocate(codes_alloc_, codelist_, codesize());
+        item_traits::deallocate(items_alloc_, items_, capacity_ + 1);
+        codelist_ = nullptr;
+        items_ = nullptr;
+    }
+};
+
+template <class K, class V, class H, class E, class A>
+void swap(flat_hash_map<K, V, H, E, A>& a, flat_hash_map<K, V, H, E, A>& b)
+    noexcept
+{
+    a.swap(b);
+}
+
+}
+
+#endif
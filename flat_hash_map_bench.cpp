@@ -0,0 +1,108 @@
+// @Name   : flat_hash_map_bench.cpp
+//
+// @Brief  : dsc::flat_hash_map against std::unordered_map with the
+//           same hasher, integer and string keys: inserts, hits,
+//           misses, a full iteration and erases.
+//           build with: make CFLAGS=-O2 flat_hash_map_bench
+//           usage: flat_hash_map_bench [keys]
+
+#include "flat_hash_map.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef unsigned int u32;
+
+struct mix_hash {
+    size_t operator()(u32 key) const
+    {
+        key = (key+0x7ed55d16) + (key<<12);
+        key = (key^0xc761c23c) ^ (key>>19);
+        key = (key+0x165667b1) + (key<<5);
+        key = (key+0xd3a2646c) ^ (key<<9);
+        key = (key+0xfd7046c5) + (key<<3);
+        key = (key^0xb55a4f09) ^ (key>>16);
+        return key;
+    }
+};
+
+struct fnv_hash {
+    size_t operator()(const std::string& s) const
+    {
+        u32 h = 2166136261u;
+        for(size_t k = 0; k < s.size(); k++)
+            h = (h ^ (unsigned char)s[k]) * 16777619u;
+        return h;
+    }
+};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* million operations per second for each phase, keys[0..n) are
+   inserted and keys[n..2n) are misses */
+template <class Map, class Key>
+static void run(const char* name, const std::vector<Key>& keys)
+{
+    size_t n = keys.size() / 2, k, sum = 0;
+    double t[5];
+    Map map;
+
+    t[0] = now_sec();
+    for(k = 0; k < n; k++)
+        map.emplace(keys[k], (u32)k);
+    t[1] = now_sec();
+    for(k = 0; k < n; k++)
+        sum += map.find(keys[k])->second;
+    t[2] = now_sec();
+    for(k = n; k < 2 * n; k++)
+        sum += map.find(keys[k]) != map.end();
+    t[3] = now_sec();
+    for(auto it = map.begin(); it != map.end(); ++it)
+        sum += it->second;
+    t[4] = now_sec();
+    for(k = 0; k < n; k++)
+        map.erase(keys[k]);
+    double end = now_sec();
+    assert(map.empty() && sum);
+
+    printf("%-22s %8.2f %8.2f %8.2f %8.1f %8.2f\n", name,
+           n / (t[1] - t[0]) / 1e6, n / (t[2] - t[1]) / 1e6,
+           n / (t[3] - t[2]) / 1e6, n / (t[4] - t[3]) / 1e6,
+           n / (end - t[4]) / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? (size_t)atol(argv[1]) : 4000000, k;
+    std::vector<u32> ints(2 * n);
+    std::vector<std::string> strs(2 * n);
+    char buf[64];
+    assert(n > 0);
+    /* distinct scattered ints, strings longer than the SSO buffer */
+    for(k = 0; k < 2 * n; k++) {
+        ints[k] = (u32)k * 2654435761u;
+        sprintf(buf, "some/common/prefix/%010u", ints[k]);
+        strs[k] = buf;
+    }
+
+    printf("%zu keys, Mops/s\n", n);
+    printf("%-22s %8s %8s %8s %8s %8s\n", "map", "insert", "hit", "miss",
+           "iterate", "erase");
+    run<std::unordered_map<u32, u32, mix_hash>, u32>("std u32", ints);
+    run<dsc::flat_hash_map<u32, u32, mix_hash>, u32>("dsc u32", ints);
+    run<std::unordered_map<std::string, u32, fnv_hash>, std::string>(
+        "std string", strs);
+    run<dsc::flat_hash_map<std::string, u32, fnv_hash>, std::string>(
+        "dsc string", strs);
+    return 0;
+}
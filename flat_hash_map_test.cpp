@@ -0,0 +1,231 @@
+// @Name   : flat_hash_map_test.cpp
+//
+// @Brief  :
+
+#include "flat_hash_map.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/* values that count themselves, to catch leaks and double frees */
+static int live;
+
+struct counted {
+    int v;
+    explicit counted(int v = 0) : v(v) { live++; }
+    counted(const counted& o) : v(o.v) { live++; }
+    counted(counted&& o) noexcept : v(o.v) { o.v = -1; live++; }
+    counted& operator=(const counted& o) { v = o.v; return *this; }
+    ~counted() { live--; }
+};
+
+/* a move that may throw, so a rebuild copies, and a copy that
+   throws once armed */
+static int copies_left = -1;
+
+struct fragile {
+    int v;
+    explicit fragile(int v = 0) : v(v) { live++; }
+    fragile(const fragile& o) : v(o.v)
+    {
+        if( copies_left == 0 )
+            throw std::runtime_error("copy");
+        if( copies_left > 0 )
+            copies_left--;
+        live++;
+    }
+    fragile(fragile&& o) noexcept(false) : v(o.v) { live++; }
+    ~fragile() { live--; }
+};
+
+/* string keys looked up by string_view or char*, without a copy */
+struct str_hash {
+    typedef void is_transparent;
+    size_t operator()(std::string_view s) const
+    {
+        return std::hash<std::string_view>()(s);
+    }
+};
+
+struct str_eq {
+    typedef void is_transparent;
+    bool operator()(std::string_view a, std::string_view b) const
+    {
+        return a == b;
+    }
+};
+
+/* random inserts, updates and erases against std::unordered_map */
+static void test_random()
+{
+    dsc::flat_hash_map<int, counted> map;
+    std::unordered_map<int, int> ref;
+    int k;
+    srand(1);
+    for(k=0; k<200000; k++) {
+        int key = rand() % 5000, op = rand() % 4;
+        if(op == 0) {
+            assert(map.erase(key) == ref.erase(key));
+        } else if(op == 1) {
+            map.insert_or_assign(key, counted(k));
+            ref[key] = k;
+        } else {
+            bool added = map.try_emplace(key, k).second;
+            assert(added == ref.emplace(key, k).second);
+        }
+        assert(map.size() == ref.size());
+    }
+    for(k=0; k<5000; k++) {
+        auto it = map.find(k);
+        assert(it == map.end() ? ref.count(k) == 0
+                               : ref.at(k) == it->second.v);
+        assert(map.contains(k) == (ref.count(k) == 1));
+    }
+    size_t n = 0;
+    for(auto& kv : map) {
+        assert(ref.at(kv.first) == kv.second.v);
+        n++;
+    }
+    assert(n == ref.size());
+
+    /* erase through iterators, the moved-in item is not skipped */
+    for(auto it = map.begin(); it != map.end(); ) {
+        if(it->first % 2)
+            it = map.erase(it);
+        else
+            ++it;
+    }
+    for(auto& kv : ref)
+        assert(map.contains(kv.first) == (kv.first % 2 == 0));
+    map.clear();
+    assert(map.empty() && map.begin() == map.end());
+    assert(live == 0);
+}
+
+static void test_strings()
+{
+    dsc::flat_hash_map<std::string, int, str_hash, str_eq> map;
+    char buf[32];
+    int k;
+    for(k=0; k<10000; k++) {
+        sprintf(buf, "key-%d", k);
+        map[buf] = k;
+    }
+    for(k=0; k<20000; k++) {
+        sprintf(buf, "key-%d", k);
+        std::string_view sv(buf);
+        auto it = map.find(sv);
+        assert(k < 10000 ? it != map.end() && it->second == k
+                         : it == map.end());
+        assert(map.count((const char*)buf) == (k < 10000));
+    }
+    assert(map.erase(std::string_view("key-7")) == 1);
+    assert(!map.contains("key-7") && map.size() == 9999);
+    assert(map.at("key-8") == 8);
+    bool threw = false;
+    try {
+        map.at("key-7");
+    } catch(const std::out_of_range&) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+static void test_copy_move()
+{
+    {
+        dsc::flat_hash_map<int, std::unique_ptr<int> > a;
+        int k;
+        for(k=0; k<1000; k++)
+            a.emplace(k, std::unique_ptr<int>(new int(k)));
+        dsc::flat_hash_map<int, std::unique_ptr<int> > b(std::move(a));
+        assert(b.size() == 1000 && *b.at(999) == 999);
+        assert(a.empty() && !a.contains(1) && a.erase(1) == 0);
+        a[5].reset(new int(5));
+        assert(a.size() == 1 && *a.at(5) == 5);
+        a = std::move(b);
+        assert(a.size() == 1000 && *a.at(5) == 5);
+    }
+    {
+        dsc::flat_hash_map<int, counted> a(100);
+        size_t cap = a.capacity();
+        int k;
+        for(k=0; k<100; k++)
+            a.try_emplace(k, k);
+        assert(cap >= 100 && a.capacity() == cap);
+        dsc::flat_hash_map<int, counted> b(a);
+        b.erase(3);
+        a = b;
+        assert(a.size() == 99 && !a.contains(3) && a.at(4).v == 4);
+        assert(live == 198);
+    }
+    assert(live == 0);
+}
+
+/* a copy throwing halfway through a rebuild leaves the map as it
+   was, nothing leaks and nothing is destroyed twice */
+static void test_rebuild_throws()
+{
+    {
+        dsc::flat_hash_map<int, fragile> map;
+        int k;
+        while( map.size() < map.capacity() )
+            map.try_emplace(int(map.size()), int(map.size()));
+        size_t n = map.size(), cap = map.capacity();
+        bool threw = false;
+        copies_left = int(n / 2);
+        try {
+            map.try_emplace(-1, -1);
+        } catch(const std::runtime_error&) {
+            threw = true;
+        }
+        copies_left = -1;
+        assert(threw && map.size() == n && map.capacity() == cap);
+        assert(live == int(n) && !map.contains(-1));
+        for(k=0; k<int(n); k++)
+            assert(map.at(k).v == k);
+        map.try_emplace(-1, -1);
+        assert(map.size() == n + 1 && map.capacity() > cap);
+        assert(live == int(n) + 1 && map.at(-1).v == -1);
+    }
+    assert(live == 0);
+}
+
+/* a copy of the map that throws on the fifth item destroys the four
+   it made, the source is untouched */
+static void test_copy_throws()
+{
+    {
+        dsc::flat_hash_map<int, fragile> map;
+        int k;
+        for(k=0; k<10; k++)
+            map.try_emplace(k, k);
+        bool threw = false;
+        copies_left = 4;
+        try {
+            dsc::flat_hash_map<int, fragile> copy(map);
+        } catch(const std::runtime_error&) {
+            threw = true;
+        }
+        copies_left = -1;
+        assert(threw && live == 10 && map.size() == 10);
+        for(k=0; k<10; k++)
+            assert(map.at(k).v == k);
+    }
+    assert(live == 0);
+}
+
+int main()
+{
+    test_random();
+    test_strings();
+    test_copy_move();
+    test_rebuild_throws();
+    test_copy_throws();
+    printf("flat_hash_map test ok\n");
+    return 0;
+}
@@ -0,0 +1,214 @@
+
+// @Name   : hash.c
+//
+// @Brief  : integer, string and batch hash functions
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "hash.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HASH_X86 1
+#endif
+
+#define P0 0xa0761d6478bd642fULL
+#define P1 0xe7037ed1a0b428dbULL
+#define P2 0x8ebc6af09c88c6e3ULL
+#define P3 0x589965cc75374cc3ULL
+
+#define C1 0xbf58476d1ce4e5b9ULL
+#define C2 0x94d049bb133111ebULL
+
+typedef void (*batch_f)(const u64* keys, u32 n, u64* out);
+
+static u64 str_seed = 0x2d358dccaa6c78a5ULL;
+
+static inline u64 read64(const unsigned char* p)
+{
+    u64 v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline u64 read32(const unsigned char* p)
+{
+    u32 v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/* both halves of the 128-bit product folded together */
+static inline u64 mum(u64 a, u64 b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+    return (u64)r ^ (u64)(r >> 64);
+}
+
+/* up to 16 bytes are read as two overlapping words, longer inputs
+   in 16 byte steps, three independent lanes of them past 48 */
+u64 hash_bytes(const void* data, size_t len, u64 seed)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    u64 a, b;
+    seed ^= P0;
+    if(len <= 16) {
+        if(len >= 4) {
+            size_t mid = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + mid);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+        } else if(len > 0) {
+            a = ((u64)p[0] << 16) | ((u64)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if(i > 48) {
+            u64 s1 = seed, s2 = seed;
+            do {
+                seed = mum(read64(p) ^ P1, read64(p + 8) ^ seed);
+                s1 = mum(read64(p + 16) ^ P2, read64(p + 24) ^ s1);
+                s2 = mum(read64(p + 32) ^ P3, read64(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= s1 ^ s2;
+        }
+        while(i > 16) {
+            seed = mum(read64(p) ^ P1, read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    return mum(P1 ^ len, mum(a ^ P1, b ^ seed));
+}
+
+static void
+batch_scalar(const u64* keys, u32 n, u64* out)
+{
+    u32 i;
+    for(i = 0; i < n; i++)
+        out[i] = hash_u64(keys[i]);
+}
+
+#if defined(HASH_X86)
+
+/* without a 64-bit low multiply, three 32x32->64 ones: the low
+   halves, plus both cross products shifted up */
+#define MULLO64(mul, add, sll, srl, x, c, chi)                          \
+    add(mul(x, c), sll(add(mul(srl(x, 32), c), mul(x, chi)), 32))
+
+static __attribute__((target("sse2"))) void
+batch_sse2(const u64* keys, u32 n, u64* out)
+{
+    const __m128i c1 = _mm_set1_epi64x(C1), c1h = _mm_set1_epi64x(C1 >> 32);
+    const __m128i c2 = _mm_set1_epi64x(C2), c2h = _mm_set1_epi64x(C2 >> 32);
+    u32 i;
+    for(i = 0; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(keys + i));
+        x = _mm_xor_si128(x, _mm_srli_epi64(x, 30));
+        x = MULLO64(_mm_mul_epu32, _mm_add_epi64, _mm_slli_epi64,
+                    _mm_srli_epi64, x, c1, c1h);
+        x = _mm_xor_si128(x, _mm_srli_epi64(x, 27));
+        x = MULLO64(_mm_mul_epu32, _mm_add_epi64, _mm_slli_epi64,
+                    _mm_srli_epi64, x, c2, c2h);
+        x = _mm_xor_si128(x, _mm_srli_epi64(x, 31));
+        _mm_storeu_si128((__m128i*)(out + i), x);
+    }
+    batch_scalar(keys + i, n - i, out + i);
+}
+
+static __attribute__((target("avx2"))) void
+batch_avx2(const u64* keys, u32 n, u64* out)
+{
+    const __m256i c1 = _mm256_set1_epi64x(C1);
+    const __m256i c1h = _mm256_set1_epi64x(C1 >> 32);
+    const __m256i c2 = _mm256_set1_epi64x(C2);
+    const __m256i c2h = _mm256_set1_epi64x(C2 >> 32);
+    u32 i;
+    for(i = 0; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(keys + i));
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 30));
+        x = MULLO64(_mm256_mul_epu32, _mm256_add_epi64, _mm256_slli_epi64,
+                    _mm256_srli_epi64, x, c1, c1h);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 27));
+        x = MULLO64(_mm256_mul_epu32, _mm256_add_epi64, _mm256_slli_epi64,
+                    _mm256_srli_epi64, x, c2, c2h);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 31));
+        _mm256_storeu_si256((__m256i*)(out + i), x);
+    }
+    batch_scalar(keys + i, n - i, out + i);
+}
+
+/* avx512dq has the 64-bit low multiply */
+static __attribute__((target("avx512f,avx512dq"))) void
+batch_avx512(const u64* keys, u32 n, u64* out)
+{
+    const __m512i c1 = _mm512_set1_epi64(C1);
+    const __m512i c2 = _mm512_set1_epi64(C2);
+    u32 i;
+    for(i = 0; i + 8 <= n; i += 8) {
+        __m512i x = _mm512_loadu_si512((const void*)(keys + i));
+        x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 30));
+        x = _mm512_mullo_epi64(x, c1);
+        x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 27));
+        x = _mm512_mullo_epi64(x, c2);
+        x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 31));
+        _mm512_storeu_si512((void*)(out + i), x);
+    }
+    batch_scalar(keys + i, n - i, out + i);
+}
+
+#endif
+
+static batch_f batch_kernel;
+
+static void
+batch_init()
+{
+    batch_f batch = batch_scalar;
+#if defined(HASH_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512dq"))
+        batch = batch_avx512;
+    else if(__builtin_cpu_supports("avx2"))
+        batch = batch_avx2;
+    else if(__builtin_cpu_supports("sse2"))
+        batch = batch_sse2;
+#endif
+    batch_kernel = batch;
+}
+
+static pthread_once_t batch_ctl = PTHREAD_ONCE_INIT;
+
+void hash_batch(const u64* keys, u32 n, u64* out)
+{
+    pthread_once(&batch_ctl, batch_init);
+    batch_kernel(keys, n, out);
+}
+
+void hash_seed(u64 seed)
+{
+    str_seed = seed;
+}
+
+unsigned hash_int(const void* key)
+{
+    return (unsigned)hash_u64((u32)*(const int*)key);
+}
+
+unsigned hash_ptr(const void* key)
+{
+    return (unsigned)hash_u64((u64)(uintptr_t)key);
+}
+
+unsigned hash_str(const void* key)
+{
+    const char* s = (const char*)key;
+    return (unsigned)hash_bytes(s, strlen(s), str_seed);
+}
@@ -0,0 +1,54 @@
+
+// @Name   : HASH_H
+//
+// @Brief  : hash functions for the maps. hash_u64 is the splitmix64
+//           finalizer, every input bit reaches every output bit.
+//           hash_bytes is a seeded string hash that eats 16 bytes per
+//           64x64->128 bit multiply, in the style of wyhash; it is
+//           fast, not cryptographic. hash_batch runs hash_u64 over an
+//           array several lanes at a time. hash_int, hash_ptr and
+//           hash_str have the hash_f shape that hsmap_new and hs_new
+//           take.
+
+#if !defined(HASH_H)
+#define HASH_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned int u32;
+typedef unsigned long long u64;
+
+static inline u64 hash_u64(u64 x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+u64  hash_bytes(const void* data, size_t len, u64 seed);
+
+/* out[i] = hash_u64(keys[i]), out may be keys */
+void hash_batch(const u64* keys, u32 n, u64* out);
+
+/* seed of hash_str, set it before any map uses it */
+void hash_seed(u64 seed);
+
+/* key points to an int */
+unsigned hash_int(const void* key);
+/* the pointer value is the key, for maps of ids */
+unsigned hash_ptr(const void* key);
+/* key is a NUL-terminated string */
+unsigned hash_str(const void* key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,182 @@
+// @Name   : hash_bench.c
+//
+// @Brief  : hash throughput, integers one at a time and in batches,
+//           strings by length against FNV-1a, and avalanche: how
+//           often each output bit flips when one input bit does,
+//           ideally half the time. bias is the distance from a half,
+//           worst over all input/output bit pairs and on average.
+//           build with: make CFLAGS=-O2 hash_bench
+//           usage: hash_bench [rounds]
+
+#include "hash.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NKEYS    (1u << 14)  /* in cache, the hash is measured */
+#define NSAMPLE  20000       /* random inputs per avalanche test */
+
+static volatile u64 sink;
+
+/* the mixer the tests use for int keys */
+static u64 int_hash(u64 x)
+{
+    u32 key = (u32)x;
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static u64 fnv1a(const void* data, size_t len)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    u32 h = 2166136261u;
+    while(len--)
+        h = (h ^ *p++) * 16777619u;
+    return h;
+}
+
+static u64 hash_8(u64 x) { return hash_bytes(&x, 8, 0); }
+static u64 fnv_8(u64 x) { return fnv1a(&x, 8); }
+
+/* the key in the middle of a 32 byte string */
+static u64 hash_32(u64 x)
+{
+    unsigned char buf[32];
+    memset(buf, 'x', sizeof(buf));
+    memcpy(buf + 12, &x, 8);
+    return hash_bytes(buf, sizeof(buf), 0);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static u64 rand64(u64* s)
+{
+    *s += 0x9e3779b97f4a7c15ULL;
+    return hash_u64(*s);
+}
+
+static void integers(u32 rounds)
+{
+    static u64 keys[NKEYS], out[NKEYS];
+    u64 seed = 1, acc = 0;
+    u32 r, k;
+    double t;
+    for(k = 0; k < NKEYS; k++)
+        keys[k] = rand64(&seed);
+
+    printf("%-16s %10s\n", "integers", "Mkeys/s");
+    t = now_sec();
+    for(r = 0; r < rounds; r++)
+        for(k = 0; k < NKEYS; k++)
+            acc += int_hash(keys[k] + r);
+    t = now_sec() - t;
+    printf("%-16s %10.1f\n", "int_hash", (double)rounds * NKEYS / t / 1e6);
+
+    t = now_sec();
+    for(r = 0; r < rounds; r++)
+        for(k = 0; k < NKEYS; k++)
+            out[k] = hash_u64(keys[k] + r);
+    t = now_sec() - t;
+    acc += out[r % NKEYS];
+    printf("%-16s %10.1f\n", "hash_u64", (double)rounds * NKEYS / t / 1e6);
+
+    t = now_sec();
+    for(r = 0; r < rounds; r++) {
+        hash_batch(keys, NKEYS, out);
+        acc += out[r % NKEYS];
+    }
+    t = now_sec() - t;
+    printf("%-16s %10.1f\n", "hash_batch", (double)rounds * NKEYS / t / 1e6);
+    sink = acc;
+}
+
+static void strings(u32 rounds)
+{
+    static const u32 lens[] = {4, 8, 16, 32, 64, 256, 4096};
+    static unsigned char buf[4096 + 8];
+    u32 l, k, n;
+    u64 acc = 0;
+    double t, t2;
+    for(k = 0; k < sizeof(buf); k++)
+        buf[k] = (unsigned char)rand();
+
+    printf("\n%-8s %12s %12s %12s %12s\n", "bytes", "hash Mh/s",
+           "hash GB/s", "fnv Mh/s", "fnv GB/s");
+    for(l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        n = rounds * NKEYS / (lens[l] / 4 + 1);
+        t = now_sec();
+        for(k = 0; k < n; k++)
+            acc += hash_bytes(buf + (k & 7), lens[l], 0);
+        t = now_sec() - t;
+        t2 = now_sec();
+        for(k = 0; k < n; k++)
+            acc += fnv1a(buf + (k & 7), lens[l]);
+        t2 = now_sec() - t2;
+        printf("%-8u %12.1f %12.2f %12.1f %12.2f\n", lens[l], n / t / 1e6,
+               (double)n * lens[l] / t / 1e9, n / t2 / 1e6,
+               (double)n * lens[l] / t2 / 1e9);
+    }
+    sink = acc;
+}
+
+/* flips[i][o]: times output bit o changed with input bit i flipped */
+static void avalanche(const char* name, u64 (*fn)(u64), u32 inbits,
+                      u32 outbits)
+{
+    static u32 flips[64][64];
+    u64 seed = 7;
+    u32 s, i, o;
+    double worst = 0, sum = 0;
+    memset(flips, 0, sizeof(flips));
+    for(s = 0; s < NSAMPLE; s++) {
+        u64 x = rand64(&seed);
+        if(inbits < 64)
+            x &= (1ULL << inbits) - 1;
+        u64 h = fn(x);
+        for(i = 0; i < inbits; i++) {
+            u64 d = h ^ fn(x ^ (1ULL << i));
+            for(o = 0; o < outbits; o++)
+                flips[i][o] += (d >> o) & 1;
+        }
+    }
+    for(i = 0; i < inbits; i++)
+        for(o = 0; o < outbits; o++) {
+            double bias = fabs((double)flips[i][o] / NSAMPLE - 0.5);
+            sum += bias;
+            if(bias > worst)
+                worst = bias;
+        }
+    printf("%-16s %6u %6u %12.4f %12.4f\n", name, inbits, outbits, worst,
+           sum / (inbits * outbits));
+}
+
+int main(int argc, char** argv)
+{
+    u32 rounds = argc > 1 ? (u32)atoi(argv[1]) : 10000;
+    assert(rounds > 0);
+    integers(rounds);
+    strings(rounds / 10 + 1);
+
+    /* a random function has a worst bias near 0.01 at this sample */
+    printf("\n%-16s %6s %6s %12s %12s\n", "avalanche", "in", "out",
+           "worst bias", "mean bias");
+    avalanche("int_hash", int_hash, 32, 32);
+    avalanche("hash_u64", hash_u64, 64, 64);
+    avalanche("hash_bytes 8", hash_8, 64, 64);
+    avalanche("hash_bytes 32", hash_32, 64, 64);
+    avalanche("fnv1a 8", fnv_8, 64, 32);
+    return 0;
+}
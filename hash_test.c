@@ -0,0 +1,125 @@
+// @Name   : hash_test.c
+//
+// @Brief  :
+
+#include "hash.h"
+#include "hashmap.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int str_cmp(const void* a, const void* b)
+{
+    return strcmp((const char*)a, (const char*)b);
+}
+
+static void* str_dup(const void* s)
+{
+    return strdup((const char*)s);
+}
+
+static void str_rel(const void* s)
+{
+    free((void*)s);
+}
+
+static int int_cmp(const void* a, const void* b)
+{
+    return *(int*)a - *(int*)b;
+}
+
+static void* int_dup(const void* key)
+{
+    int* res = (int*)malloc(sizeof(int));
+    *res = *(int*)key;
+    return res;
+}
+
+static void int_rel(const void* key)
+{
+    free((int*)key);
+}
+
+/* every length and alignment of one buffer */
+static void test_bytes()
+{
+    static unsigned char buf[600];
+    static u64 seen[301];
+    u32 k, i, len;
+    for(k=0; k<sizeof(buf); k++)
+        buf[k] = (unsigned char)(k * 131 + 7);
+
+    for(len=0; len<=300; len++) {
+        u64 h = hash_bytes(buf, len, 1);
+        seen[len] = h;
+        /* no prefix of the buffer collides with another */
+        for(k=0; k<len; k++)
+            assert(seen[k] != h);
+        assert(hash_bytes(buf, len, 1) == h && hash_bytes(buf, len, 2) != h);
+        for(i=1; i<8; i++) {
+            memmove(buf + i, buf, len);
+            assert(hash_bytes(buf + i, len, 1) == h);
+            memmove(buf, buf + i, len);
+        }
+        /* any flipped bit changes the hash */
+        for(k=0; k<len*8; k+=7) {
+            buf[k/8] ^= 1 << (k%8);
+            assert(hash_bytes(buf, len, 1) != h);
+            buf[k/8] ^= 1 << (k%8);
+        }
+    }
+}
+
+static void test_batch()
+{
+    u64 keys[100], out[100];
+    u32 n, k;
+    for(n=0; n<=100; n++) {
+        for(k=0; k<n; k++)
+            keys[k] = (u64)k * 0x9e3779b97f4a7c15ULL + n;
+        hash_batch(keys, n, out);
+        for(k=0; k<n; k++)
+            assert(out[k] == hash_u64(keys[k]));
+        hash_batch(keys, n, keys);
+        assert(n == 0 || memcmp(keys, out, n * sizeof(u64)) == 0);
+    }
+    /* a bijection, 0 stays 0 and nothing else maps there */
+    assert(hash_u64(0) == 0 && hash_u64(1) != 0);
+}
+
+/* the callbacks drive a hashmap */
+static void test_callbacks()
+{
+    hashmap* strs = hsmap_new(&hash_str, &str_cmp, &str_dup, &str_dup,
+                              &str_rel, &str_rel);
+    hashmap* ints = hsmap_new(&hash_int, &int_cmp, &int_dup, &int_dup,
+                              &int_rel, &int_rel);
+    char buf[32];
+    int k;
+    assert(strs && ints);
+    hash_seed(12345);
+    for(k=0; k<10000; k++) {
+        sprintf(buf, "key-%d", k);
+        assert(hsmap_insert(strs, buf, buf) && hsmap_insert(ints, &k, &k));
+    }
+    for(k=0; k<20000; k++) {
+        sprintf(buf, "key-%d", k);
+        char* v = (char*)hsmap_find(strs, buf);
+        int* w = (int*)hsmap_find(ints, &k);
+        assert(k < 10000 ? v && strcmp(v, buf) == 0 : v == NULL);
+        assert(k < 10000 ? w && *w == k : w == NULL);
+    }
+    assert(hash_ptr((void*)1) != hash_ptr((void*)2));
+    hsmap_del(strs);
+    hsmap_del(ints);
+}
+
+int main()
+{
+    test_bytes();
+    test_batch();
+    test_callbacks();
+    printf("hash test ok\n");
+    return 0;
+}
@@ -2,8 +2,11 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "hashmap.h"
 
+#define BATCH 16   /* keys whose lookups overlap */
+
 #if 0
 static int32_t get_code(void* key, int32_t size, int32_t keysize)
 {
@@ -26,79 +29,164 @@ static int32_t get_code(void* key, int32_t size, int32_t keysize)
 #endif
 
 
+static void
+hashtable_free(hashmap* hsmap, hashtable* thiz)
+{
+    mem_free(&hsmap->alloc, &hsmap->mem, thiz->hashlist,
+             ((size_t)thiz->hashsize+1) * sizeof(hashitem));
+    mem_free(&hsmap->alloc, &hsmap->mem, thiz->codelist,
+             (size_t)thiz->codesize * sizeof(u32));
+    thiz->hashlist = NULL;
+    thiz->codelist = NULL;
+    thiz->count    = 0;
+}
+
 /* return true if success, false error happened*/
 static int
-hashtable_init(hashmap* thiz, u32 hashsize){
-    u32 n;
+hashtable_init(hashmap* hsmap, hashtable* thiz, u32 hashsize, float load){
+    /* a power of two buckets, enough for hashsize-1 items at load */
+    double want = (hashsize-1) / load;
     thiz->hashsize = hashsize;
-    thiz->codesize = HASH_OPTIMAL_RATE * hashsize;
+    thiz->codesize = 1 << HASH_MIN_SHIFT;
+    thiz->shift    = HASH_MIN_SHIFT;
+    while( thiz->codesize < want && thiz->shift < 31 ) {
+        thiz->codesize <<= 1;
+        thiz->shift++;
+    }
     thiz->count    = 0;
-    thiz->emptyidx = 1;
+    thiz->emptyidx = 0;
+    thiz->top      = 1;
 
-    thiz->codelist = (u32*)calloc(thiz->codesize, sizeof(u32));
-    thiz->hashlist = (hashitem*)calloc(thiz->hashsize+1,
-                                     sizeof(hashitem));
+    /* zeroed memory is an empty table, so a big one costs no
+       pass over its slots here */
+    thiz->codelist = (u32*)mem_calloc(&hsmap->alloc, &hsmap->mem,
+                         (size_t)thiz->codesize * sizeof(u32));
+    thiz->hashlist = (hashitem*)mem_calloc(&hsmap->alloc, &hsmap->mem,
+                         ((size_t)thiz->hashsize+1) * sizeof(hashitem));
     
     if( thiz->hashlist == NULL ||
         thiz->codelist == NULL ) {
-        free(thiz->hashlist);
-        free(thiz->codelist);
+        hashtable_free(hsmap, thiz);
         return 0;
     }
-
-    u32 end = thiz->hashsize;
-    for(n=0; n < end; n++) {
-        thiz->hashlist[n].key   = NULL;
-        thiz->hashlist[n].val   = NULL;
-        thiz->hashlist[n].next  = n+1;
-    }
-    thiz->hashlist[end-1].next = 0;
-    
-    for(n=0; n < thiz->codesize; n++)
-        thiz->codelist[n] = 0;
     return 1;
 }
 
-/* return true iff add success
-   return false iff key and value all be found in hashtable
-*/
-static int
-internal_add(hashmap* thiz, void* key, void* val)
-{
-    u32 idx, empty;
-
-    idx = (thiz->hash(key)) % (thiz->codesize-1) + 1;
-    if(thiz->codelist[idx] == 0) {
-        empty = thiz->emptyidx;
-        thiz->hashlist[empty].key = thiz->keydup(key);
-        thiz->hashlist[empty].val = thiz->valdup(val);
-        thiz->codelist[idx]       = thiz->emptyidx;
-        thiz->emptyidx            = thiz->hashlist[empty].next;
-        thiz->hashlist[empty].next = 0;
-        return 1;
+/* mask keeps the low bits of the code, fibonacci multiplies by
+   2^32/phi and keeps the high ones, so weak low bits still spread */
+static inline u32
+bucket_of(const hashmap* hsmap, const hashtable* thiz, u32 code)
+{
+    if( hsmap->index == HASH_INDEX_FIB )
+        return (code * 2654435769u) >> (32 - thiz->shift);
+    return code & (thiz->codesize-1);
+}
+
+/* put key and val, already dupped, at the head of their bucket */
+static void
+internal_add(const hashmap* hsmap, hashtable* thiz, u32 code,
+             void* key, void* val)
+{
+    u32 idx = bucket_of(hsmap, thiz, code);
+    u32 empty = thiz->emptyidx;
+    if( empty )
+        thiz->emptyidx = thiz->hashlist[empty].next;
+    else
+        empty = thiz->top++;
+    assert(empty < thiz->hashsize && "hash table full");
+
+    thiz->hashlist[empty].key  = key;
+    thiz->hashlist[empty].val  = val;
+    thiz->hashlist[empty].code = code;
+    thiz->hashlist[empty].next = thiz->codelist[idx];
+    thiz->codelist[idx]        = empty;
+    thiz->count++;
+}
+
+static hashitem*
+internal_find(const hashmap* hsmap, hashtable* thiz, u32 code,
+              const void* key)
+{
+    if(thiz->codelist == NULL)
+        return NULL;
+    u32 idx = thiz->codelist[bucket_of(hsmap, thiz, code)];
+    while( idx ) {
+        assert(idx < thiz->hashsize
+               && "hash find: idx <= hashsize");
+        if( thiz->hashlist[idx].code == code &&
+            hsmap->cmp(thiz->hashlist[idx].key, key) == 0 )
+            return &thiz->hashlist[idx];
+        idx = thiz->hashlist[idx].next;
     }
+    return NULL;
+}
 
-    idx = thiz->codelist[idx];
-    assert( idx>=0 );
-    while( idx < thiz->hashsize ) {
-        if( thiz->hashlist[idx].next == 0) {
-            empty = thiz->emptyidx;
-            thiz->emptyidx            = thiz->hashlist[empty].next;
-            thiz->hashlist[empty].next = thiz->hashlist[idx].next;
-            thiz->hashlist[idx].next  = empty;
-            thiz->hashlist[empty].key = thiz->keydup(key);
-            thiz->hashlist[empty].val = thiz->valdup(val);
+/* unlink the item of key, give its slot back to the free list
+   return true iff key was there */
+static int
+internal_erase(hashmap* hsmap, hashtable* thiz, u32 code, const void* key)
+{
+    if(thiz->codelist == NULL)
+        return 0;
+    u32* link = &thiz->codelist[bucket_of(hsmap, thiz, code)];
+    while( *link ) {
+        u32 idx = *link;
+        hashitem* item = &thiz->hashlist[idx];
+        if( item->code == code && hsmap->cmp(item->key, key) == 0 ) {
+            *link = item->next;
+            hsmap->keyrel(item->key);
+            hsmap->valrel(item->val);
+            item->key  = NULL;
+            item->val  = NULL;
+            item->next = thiz->emptyidx;
+            thiz->emptyidx = idx;
+            thiz->count--;
             return 1;
-        } else {
-            idx = thiz->hashlist[idx].next;
-            assert(idx > 0);
         }
-            
+        link = &item->next;
     }
     return 0;
 }
 
-static int expand_cnt = 0;
+/* move up to n buckets of the old table into the new one, the
+   items keep their key and val pointers and their cached code */
+static void
+rehash_step(hashmap* hsmap, u32 n)
+{
+    hashtable* old = &hsmap->old;
+    while( n-- && old->codelist ) {
+        u32 idx = old->codelist[hsmap->rehashidx];
+        while( idx ) {
+            hashitem* item = &old->hashlist[idx];
+            internal_add(hsmap, &hsmap->tab, item->code,
+                         item->key, item->val);
+            item->key = NULL;
+            item->val = NULL;
+            idx = item->next;
+            old->count--;
+        }
+        old->codelist[hsmap->rehashidx] = 0;
+        if( ++hsmap->rehashidx == old->codesize )
+            hashtable_free(hsmap, old);
+    }
+}
+
+/* make tab a fresh table of hashsize and start draining the current
+   one into it, there is no rehash running
+   return false iff error happened */
+static int
+table_grow(hashmap* hsmap, u32 hashsize)
+{
+    hashtable fresh;
+    assert(hsmap->old.codelist == NULL);
+    if( !hashtable_init(hsmap, &fresh, hashsize, hsmap->load) )
+        return 0;
+    hsmap->old = hsmap->tab;
+    hsmap->tab = fresh;
+    hsmap->rehashidx = 0;
+    return 1;
+}
+
 /* check hash table space, expand it iff neccessary
    return true success,
    return false iff error happened
@@ -106,86 +194,96 @@ static int expand_cnt = 0;
 static int
 check_full(hashmap* hsmap)
 {
-    if(hsmap->count < hsmap->hashsize-1 )
+    if(hsmap->tab.count < hsmap->tab.hashsize-1 )
         return 1;
 
-    u32 n, step;
-    hashmap* new_hash = (hashmap*)malloc(sizeof(hashmap));
-    assert(hsmap);
-    new_hash->hash   = hsmap->hash;
-    new_hash->cmp    = hsmap->cmp;
-    new_hash->keydup = hsmap->keydup;
-    new_hash->valdup = hsmap->valdup;
-    new_hash->keyrel = hsmap->keyrel;
-    new_hash->valrel = hsmap->valrel;
+    /* rehashstep drains the old table before this point */
+    assert(hsmap->old.codelist == NULL);
 
-
-    step = hsmap->count * HASH_STEP_RATE;
-    step = step<HASH_STEP_MIN ? HASH_STEP_MIN :
-        (step>HASH_STEP_MAX ? HASH_STEP_MAX : step);
-
-    new_hash->hashsize = hsmap->hashsize + step;
-    hashtable_init(new_hash, new_hash->hashsize);
-    //printf("expand: %d, hsmap->hashsize: %d\n", ++expand_cnt, new_hash->hashsize);
-    
-    for(n=1; n<hsmap->hashsize; n++){
-        if(hsmap->hashlist[n].key == NULL)
-            continue;
-        if(internal_add(new_hash, hsmap->hashlist[n].key,
-                        hsmap->hashlist[n].val))
-            new_hash->count++;
+    u64 size = (u64)(hsmap->tab.hashsize * (double)hsmap->growth);
+    if( size < (u64)hsmap->tab.hashsize + HASH_GROW_MIN )
+        size = (u64)hsmap->tab.hashsize + HASH_GROW_MIN;
+    if( size > 0xFFFFFFFFULL )
+        size = 0xFFFFFFFFULL;
+    if( size == hsmap->tab.hashsize ||
+        !table_grow(hsmap, (u32)size) )
+        return 0;
+    if( !hsmap->incremental ) {
+        rehash_step(hsmap, ~0u);
+        return 1;
     }
 
-    for(n=0; n<hsmap->hashsize; n++) {
-        hsmap->keyrel(hsmap->hashlist[n].key);
-        hsmap->valrel(hsmap->hashlist[n].val);
-    }
-    free(hsmap->hashlist);
-    free(hsmap->codelist);
-    hsmap->hashlist = new_hash->hashlist;
-    hsmap->codelist = new_hash->codelist;
-    hsmap->hashsize = new_hash->hashsize;
-    hsmap->count    = new_hash->count;
-    hsmap->emptyidx    = new_hash->emptyidx;
-    free(new_hash);
+    /* enough buckets per call to drain the old table before the
+       inserts use up the room left in the new one */
+    hsmap->rehashstep = hsmap->old.codesize /
+        (hsmap->tab.hashsize - 1 - hsmap->old.count) + 1;
+    if( hsmap->rehashstep < HASH_REHASH_MIN )
+        hsmap->rehashstep = HASH_REHASH_MIN;
     return 1;
 }
 
+static void
+hashtable_release(hashmap* hsmap, hashtable* thiz)
+{
+    u32 k;
+    if( thiz->hashlist == NULL )
+        return;
+    for(k=0; k<thiz->hashsize; k++) {
+        hsmap->keyrel(thiz->hashlist[k].key);
+        hsmap->valrel(thiz->hashlist[k].val);
+    }
+    hashtable_free(hsmap, thiz);
+}
+
 /* release the memory for a hashtable*/
 void
 hsmap_del(hashmap* hsmap)
 {
+    allocator alloc;
     if(hsmap == NULL) return;
-    u32 k;
-    for(k=0; k<hsmap->hashsize; k++) {
-        hsmap->keyrel(hsmap->hashlist[k].key);
-        hsmap->valrel(hsmap->hashlist[k].val);
-    }
-    free(hsmap->hashlist);
-    free(hsmap->codelist);
-    free(hsmap);
+    hashtable_release(hsmap, &hsmap->tab);
+    hashtable_release(hsmap, &hsmap->old);
+    alloc = hsmap->alloc;
+    mem_free(&alloc, &hsmap->mem, hsmap, sizeof(hashmap));
     hsmap = NULL;
 }
 
+static hashitem*
+hsmap_lookup(hashmap* hsmap, u32 code, const void* key)
+{
+    hashitem* item;
+    if( hsmap->old.codelist )
+        rehash_step(hsmap, hsmap->rehashstep);
+    item = internal_find(hsmap, &hsmap->tab, code, key);
+    if( item == NULL )
+        item = internal_find(hsmap, &hsmap->old, code, key);
+    return item;
+}
+
 /* @ 0 : add failed
    @ 1 : add success */
 int
 hsmap_insert(hashmap* hsmap, void* key, void* value)
 {
-    void* val = hsmap_find(hsmap, key);
-    if(val) {
-        hsmap->valrel(val);
-        val = hsmap->valdup(value);
+    assert(hsmap);
+    return hsmap_insert_code(hsmap, hsmap->hash(key), key, value);
+}
+
+int
+hsmap_insert_code(hashmap* hsmap, u32 code, void* key, void* value)
+{
+    assert(hsmap);
+    hashitem* item = hsmap_lookup(hsmap, code, key);
+    if(item) {
+        hsmap->valrel(item->val);
+        item->val = hsmap->valdup(value);
         return 1;
     }
-    else {
-        if(check_full(hsmap) &&
-           internal_add(hsmap, key, value)){
-            hsmap->count++;
-            return 1;
-        }
-    }
-    return 0;
+    if(!check_full(hsmap))
+        return 0;
+    internal_add(hsmap, &hsmap->tab, code, hsmap->keydup(key),
+                 hsmap->valdup(value));
+    return 1;
 }
 
 /* @ NULL : no found
@@ -193,41 +291,251 @@ hsmap_insert(hashmap* hsmap, void* key, void* value)
 void* hsmap_find(hashmap* hsmap, void* key)
 {
     assert(hsmap);
-    u32 idx = hsmap->hash(key) % (hsmap->codesize -1 ) + 1;
-    
-    assert( idx >= 0 );
-    if( hsmap->codelist[idx] == 0)
-        return NULL;
+    return hsmap_find_code(hsmap, hsmap->hash(key), key);
+}
 
-    idx = hsmap->codelist[idx];
-    while( idx < hsmap->hashsize ) {
-        assert(idx < hsmap->hashsize
-               && "hash find: idx <= hashsize");
-        
-        if( hsmap->cmp(hsmap->hashlist[idx].key,
-                       key) == 0 ) {
-            return hsmap->hashlist[idx].val;
+void* hsmap_find_code(hashmap* hsmap, u32 code, void* key)
+{
+    assert(hsmap);
+    hashitem* item = hsmap_lookup(hsmap, code, key);
+    return item ? item->val : NULL;
+}
+
+/* hash a group of keys and prefetch their buckets, then their first
+   items, then take one step down every unresolved chain per round,
+   so the misses of the group overlap instead of queueing */
+u32 hsmap_find_batch(hashmap* hsmap, void** keys, u32 n, void** vals)
+{
+    u32 code[BATCH], idx[BATCH], live[BATCH];
+    hashtable* thiz = &hsmap->tab;
+    u32 i, j, m, nlive, found = 0;
+    assert(hsmap);
+    if( hsmap->old.codelist )
+        rehash_step(hsmap, hsmap->rehashstep);
+
+    for(i = 0; i < n; i += m) {
+        m = n - i < BATCH ? n - i : BATCH;
+        for(j = 0; j < m; j++) {
+            code[j] = hsmap->hash(keys[i + j]);
+            idx[j]  = bucket_of(hsmap, thiz, code[j]);
+            __builtin_prefetch(&thiz->codelist[idx[j]]);
+        }
+        nlive = 0;
+        for(j = 0; j < m; j++) {
+            vals[i + j] = NULL;
+            idx[j] = thiz->codelist[idx[j]];
+            if( idx[j] ) {
+                __builtin_prefetch(&thiz->hashlist[idx[j]]);
+                live[nlive++] = j;
+            }
+        }
+        while( nlive ) {
+            u32 keep = 0;
+            for(j = 0; j < nlive; j++) {
+                u32 q = live[j];
+                hashitem* item = &thiz->hashlist[idx[q]];
+                if( item->code == code[q] &&
+                    hsmap->cmp(item->key, keys[i + q]) == 0 ) {
+                    vals[i + q] = item->val;
+                    found++;
+                    continue;
+                }
+                idx[q] = item->next;
+                if( idx[q] ) {
+                    __builtin_prefetch(&thiz->hashlist[idx[q]]);
+                    live[keep++] = q;
+                }
+            }
+            nlive = keep;
+        }
+        /* mid rehash the rest may still sit in the old table */
+        if( hsmap->old.codelist ) {
+            for(j = 0; j < m; j++) {
+                hashitem* item;
+                if( vals[i + j] )
+                    continue;
+                item = internal_find(hsmap, &hsmap->old, code[j], keys[i + j]);
+                if( item ) {
+                    vals[i + j] = item->val;
+                    found++;
+                }
+            }
         }
-        if( hsmap->hashlist[idx].next == 0 )
-            break;
-        idx = hsmap->hashlist[idx].next;
     }
-    return NULL;
+    return found;
+}
+
+/* @ 0 : key not found
+   @ 1 : erased */
+int
+hsmap_erase(hashmap* hsmap, void* key)
+{
+    assert(hsmap);
+    return hsmap_erase_code(hsmap, hsmap->hash(key), key);
+}
+
+int
+hsmap_erase_code(hashmap* hsmap, u32 code, void* key)
+{
+    assert(hsmap);
+    if( hsmap->old.codelist )
+        rehash_step(hsmap, hsmap->rehashstep);
+    return internal_erase(hsmap, &hsmap->tab, code, key) ||
+        internal_erase(hsmap, &hsmap->old, code, key);
+}
+
+u32 hsmap_count(hashmap* hsmap)
+{
+    return hsmap->tab.count + hsmap->old.count;
+}
+
+void hsmap_incremental(hashmap* hsmap, int on)
+{
+    hsmap->incremental = on;
+    if( !on )
+        rehash_step(hsmap, ~0u);
+}
+
+void hsmap_growth(hashmap* hsmap, float factor, float load)
+{
+    assert(factor > 1 && load > 0);
+    hsmap->growth = factor;
+    hsmap->load   = load;
+}
+
+/* rebuild the table at hashsize, finishing any running rehash */
+static int
+table_rebuild(hashmap* hsmap, u32 hashsize)
+{
+    rehash_step(hsmap, ~0u);
+    if( !table_grow(hsmap, hashsize) )
+        return 0;
+    rehash_step(hsmap, ~0u);
+    return 1;
+}
+
+int hsmap_index(hashmap* hsmap, int index)
+{
+    assert(index == HASH_INDEX_MASK || index == HASH_INDEX_FIB);
+    if( index == hsmap->index )
+        return 1;
+    /* the old table drains by bucket number, not by code */
+    rehash_step(hsmap, ~0u);
+    hsmap->index = index;
+    return table_rebuild(hsmap, hsmap->tab.hashsize);
+}
+
+int hsmap_reserve(hashmap* hsmap, u32 n)
+{
+    assert(n < 0xFFFFFFFF);
+    rehash_step(hsmap, ~0u);
+    if( n < hsmap->tab.hashsize )
+        return 1;
+    return table_rebuild(hsmap, n + 1);
+}
+
+int hsmap_shrink_to_fit(hashmap* hsmap)
+{
+    rehash_step(hsmap, ~0u);
+    u32 size = hsmap->tab.count + 1;
+    if( size < HASH_GROW_MIN )
+        size = HASH_GROW_MIN;
+    if( size >= hsmap->tab.hashsize &&
+        hsmap->tab.top == hsmap->tab.count + 1 )
+        return 1;
+    /* the rebuild hands out slots from top, so items end up packed */
+    return table_rebuild(hsmap, size);
+}
+
+/* a sample of buckets walks a golden ratio sequence over the table,
+   a fixed stride could line up with a pattern in the keys */
+static void
+table_stat(const hashtable* thiz, u32 sample, hashstat* st,
+           u64* items, u64* hits)
+{
+    u32 i, b, idx, len;
+    if( thiz->codelist == NULL )
+        return;
+    if( sample == 0 || sample > thiz->codesize )
+        sample = thiz->codesize;
+    for(i = 0; i < sample; i++) {
+        b = sample == thiz->codesize ? i :
+            (u32)(((u64)(i * 2654435769u) * thiz->codesize) >> 32);
+        len = 0;
+        for(idx = thiz->codelist[b]; idx; idx = thiz->hashlist[idx].next)
+            len++;
+        st->chains[len < HASH_STAT_CHAINS ? len : HASH_STAT_CHAINS - 1]++;
+        st->sampled++;
+        if( len > st->max_probe )
+            st->max_probe = len;
+        *items += len;
+        /* the i-th item of a chain is found after i compares */
+        *hits += (u64)len * (len + 1) / 2;
+    }
+    st->buckets += thiz->codesize;
+}
+
+void hsmap_mem(hashmap* hsmap, memstat* st)
+{
+    assert(hsmap);
+    *st = hsmap->mem;
+}
+
+void hsmap_stat(hashmap* hsmap, hashstat* st, u32 sample)
+{
+    u64 items = 0, hits = 0;
+    assert(hsmap && st);
+    memset(st, 0, sizeof(*st));
+    /* split the sample between the tables by their size */
+    if( hsmap->old.codelist && sample ) {
+        u64 total = (u64)hsmap->tab.codesize + hsmap->old.codesize;
+        u32 part = (u32)((u64)sample * hsmap->tab.codesize / total);
+        table_stat(&hsmap->tab, part ? part : 1, st, &items, &hits);
+        table_stat(&hsmap->old, sample - part ? sample - part : 1, st,
+                   &items, &hits);
+    } else {
+        table_stat(&hsmap->tab, sample, st, &items, &hits);
+        table_stat(&hsmap->old, sample, st, &items, &hits);
+    }
+    st->count = hsmap_count(hsmap);
+    st->bytes = hsmap->mem.bytes;
+    st->load = (double)st->count / st->buckets;
+    st->empty = (double)st->chains[0] / st->sampled;
+    st->hit_probe = items ? (double)hits / items : 0;
+    st->miss_probe = (double)items / st->sampled;
 }
 
 hashmap*
 hsmap_new(hash_f hash, cmp_f cmp,
           keydup_f keydup, valdup_f valdup,
           keyrel_f keyrel, valrel_f valrel) {
-    
-    hashmap* hsmap = (hashmap*)malloc(sizeof(hashmap));
+    return hsmap_new_alloc(hash, cmp, keydup, valdup, keyrel, valrel,
+                           NULL);
+}
+
+hashmap*
+hsmap_new_alloc(hash_f hash, cmp_f cmp,
+                keydup_f keydup, valdup_f valdup,
+                keyrel_f keyrel, valrel_f valrel,
+                const allocator* alloc) {
+    allocator a;
+    memstat mem;
+    hashmap* hsmap;
+
+    mem_init(&a, &mem, alloc);
+    hsmap = (hashmap*)mem_calloc(&a, &mem, sizeof(hashmap));
     assert(hsmap);
+    hsmap->alloc  = a;
+    hsmap->mem    = mem;
     hsmap->hash   = hash;
     hsmap->cmp    = cmp;
     hsmap->keydup = keydup;
     hsmap->valdup = valdup;
     hsmap->keyrel = keyrel;
     hsmap->valrel = valrel;
-    hashtable_init(hsmap, 10);
+    hsmap->growth = HASH_GROWTH;
+    hsmap->load   = 1.0f / HASH_OPTIMAL_RATE;
+    hsmap->index  = HASH_INDEX_MASK;
+    hashtable_init(hsmap, &hsmap->tab, 10, hsmap->load);
     return hsmap;
 }
@@ -14,13 +14,25 @@
 #if !defined(HASHMAP_H)
 #define HASHMAP_H
 
+#include "alloc.h"
 
-#define HASH_OPTIMAL_RATE 2
-#define HASH_STEP_MIN     216
-#define HASH_STEP_RATE    1
-#define HASH_STEP_MAX     21600
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASH_OPTIMAL_RATE 2       /* buckets per item by default */
+#define HASH_GROWTH       2.0f    /* table size factor per expansion */
+#define HASH_GROW_MIN     16
+#define HASH_MIN_SHIFT    4       /* at least 16 buckets */
+#define HASH_REHASH_MIN   16
+
+#define HASH_STAT_CHAINS  16      /* chain length bins, the last for longer */
+
+#define HASH_INDEX_MASK   0       /* code & (codesize-1) */
+#define HASH_INDEX_FIB    1       /* fibonacci hashing, top bits */
 
 typedef unsigned int u32;
+typedef unsigned long long u64;
 
 typedef unsigned (*hash_f) (const void* key);
 typedef int      (*cmp_f)  (const void* a, const void* b);
@@ -33,16 +45,34 @@ typedef struct {
     void* key;
     void* val;
     u32 next;
+    u32 code;           /* hash of key, checked before cmp */
 }hashitem;
 
 
 typedef struct {
-    u32 hashsize;
-    u32 codesize;
+    u32 hashsize;       /* item slots, slot 0 is never used */
+    u32 codesize;       /* buckets, a power of two */
+    u32 shift;          /* log2 of codesize */
     u32 count;
-    u32 emptyidx;
+    u32 emptyidx;       /* free list of released slots */
+    u32 top;            /* slots from top on were never used */
     u32* codelist;
     hashitem* hashlist;
+}hashtable;
+
+typedef struct {
+    hashtable tab;
+
+    /* incremental rehash: the table being drained into tab, a few
+       buckets per insert/find, codelist is NULL when none is */
+    hashtable old;
+    u32 rehashidx;      /* next bucket of old to move */
+    u32 rehashstep;     /* buckets moved per call */
+    int incremental;
+
+    float growth;       /* hashsize factor per expansion */
+    float load;         /* most items per bucket */
+    int   index;        /* HASH_INDEX_MASK or HASH_INDEX_FIB */
 
     hash_f hash;
     cmp_f  cmp;
@@ -51,15 +81,71 @@ typedef struct {
     valdup_f valdup;
     keyrel_f keyrel;
     valrel_f valrel;
+
+    allocator alloc;    /* the map, its slots and buckets come from it */
+    memstat   mem;
 }hashmap;
 
+typedef struct {
+    u32 count;          /* items in the map */
+    u32 buckets;        /* in both tables during a rehash */
+    u32 sampled;        /* buckets looked at, chains[] adds up to it */
+    u32 chains[HASH_STAT_CHAINS];   /* sampled buckets by chain length */
+    u32 max_probe;      /* longest sampled chain */
+    double load;        /* items per bucket */
+    double empty;       /* share of sampled buckets that are empty */
+    double hit_probe;   /* items a find that hits compares, on average */
+    double miss_probe;  /* and one that misses, the mean chain length */
+    u64 bytes;          /* the map, slots and buckets, not the keys
+                           and values, as hsmap_mem has it */
+}hashstat;
+
 hashmap* hsmap_new(hash_f hash, cmp_f cmp,
                    keydup_f keydup, valdup_f valdup,
                    keyrel_f keyrel, valrel_f valrel);
+/* same, with the memory of the map taken from alloc, NULL for malloc */
+hashmap* hsmap_new_alloc(hash_f hash, cmp_f cmp,
+                         keydup_f keydup, valdup_f valdup,
+                         keyrel_f keyrel, valrel_f valrel,
+                         const allocator* alloc);
 void hsmap_del(hashmap* hsmap);
 
 int   hsmap_insert(hashmap* hsmap, void* key, void* val);
 void* hsmap_find(hashmap* hsmap, void* key);
+/* vals[i] is the value of keys[i] or NULL, lookups of the batch are
+   interleaved to overlap their cache misses. returns the hits */
+u32   hsmap_find_batch(hashmap* hsmap, void** keys, u32 n, void** vals);
+int   hsmap_erase(hashmap* hsmap, void* key);
+u32   hsmap_count(hashmap* hsmap);
+/* same, for a caller that already has the hash of the key, code must
+   be what the hash function gives for it */
+int   hsmap_insert_code(hashmap* hsmap, u32 code, void* key, void* val);
+void* hsmap_find_code(hashmap* hsmap, u32 code, void* key);
+int   hsmap_erase_code(hashmap* hsmap, u32 code, void* key);
 
+/* on: grow by moving buckets a few at a time on later inserts and
+   finds instead of all at once, lookups see both tables meanwhile */
+void  hsmap_incremental(hashmap* hsmap, int on);
+
+/* grow the item slots by factor when they run out, with a power of
+   two buckets for at most load items each, from the next expansion */
+void  hsmap_growth(hashmap* hsmap, float factor, float load);
+/* bucket indexing, rebuilds the table when it changes */
+int   hsmap_index(hashmap* hsmap, int index);
+/* room for n items without further expansion */
+int   hsmap_reserve(hashmap* hsmap, u32 n);
+/* rebuild at the current count, packing the items after erases */
+int   hsmap_shrink_to_fit(hashmap* hsmap);
+/* chain statistics from sample buckets spread over the table, all of
+   them for 0. it only reads the map, unlike finds in the middle of a
+   rehash, so it can run under the same read lock as lookups */
+void  hsmap_stat(hashmap* hsmap, hashstat* st, u32 sample);
+/* live bytes and blocks of the map itself, keys and values are the
+   business of keydup and valdup */
+void  hsmap_mem(hashmap* hsmap, memstat* st);
+
+#ifdef __cplusplus
+}
 #endif
 
+#endif
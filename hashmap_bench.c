@@ -0,0 +1,407 @@
+
+// @Name   : hashmap_bench.c
+//
+// @Brief  : insert latency percentiles with the table grown all at
+//           once against incremental rehashing, and bulk insert
+//           rates over growth policies and bucket indexing.
+//           build with: make CFLAGS=-O2 hashmap_bench
+//           usage: hashmap_bench latency [keys]
+//                  hashmap_bench bulk [keys ...]
+//                  hashmap_bench churn [keys]
+//                  hashmap_bench strings [keys]
+//                  hashmap_bench batch [keys]
+//                  hashmap_bench stats [keys]
+//           100M bulk keys need about 6GB, presized about 3GB.
+
+#include "hashmap.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned int_hash(const void* a)
+{
+    u32 key = (u32)(*(int*)a);
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static int int_cmp(const void* a, const void* b)
+{
+    return *(int*)a - *(int*)b;
+}
+
+static void* int_dup(const void* key)
+{
+    int* res = (int*)malloc(sizeof(int));
+    *res = *(int*)key;
+    return res;
+}
+
+static void int_rel(const void* key)
+{
+    free((int*)key);
+}
+
+/* bulk keys are the pointer values themselves, nothing is dupped */
+static unsigned id_hash(const void* a)
+{
+    u32 key = (u32)(uintptr_t)a;
+    return int_hash(&key);
+}
+
+static int id_cmp(const void* a, const void* b)
+{
+    return a != b;
+}
+
+static void* id_dup(const void* key)
+{
+    return (void*)key;
+}
+
+static void id_rel(const void* key)
+{
+    (void)key;
+}
+
+static u64 now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u32(const void* a, const void* b)
+{
+    u32 x = *(const u32*)a, y = *(const u32*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void latency(const char* name, int incremental, int n, u32* lat)
+{
+    hashmap* hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                               &int_rel, &int_rel);
+    u64 t, total = 0;
+    int k;
+    assert(hsmap);
+    hsmap_incremental(hsmap, incremental);
+    for(k=0; k<n; k++) {
+        t = now_ns();
+        hsmap_insert(hsmap, &k, &k);
+        t = now_ns() - t;
+        lat[k] = t > 0xFFFFFFFFULL ? 0xFFFFFFFF : (u32)t;
+        total += t;
+    }
+    hsmap_del(hsmap);
+
+    qsort(lat, n, sizeof(u32), cmp_u32);
+    printf("%-12s %8.1f %8u %8u %8u %8u %10u\n", name,
+           (double)total / n, lat[n / 2], lat[(u64)n * 99 / 100],
+           lat[(u64)n * 999 / 1000], lat[(u64)n * 9999 / 10000], lat[n - 1]);
+}
+
+/* long string keys sharing a prefix, counting hash and cmp calls */
+static u64 nhash, ncmp;
+
+static unsigned str_hash(const void* a)
+{
+    const unsigned char* s = (const unsigned char*)a;
+    u32 h = 2166136261u;
+    nhash++;
+    while(*s)
+        h = (h ^ *s++) * 16777619u;
+    return h;
+}
+
+static int str_cmp(const void* a, const void* b)
+{
+    ncmp++;
+    return strcmp((const char*)a, (const char*)b);
+}
+
+static char* make_str(u32 k)
+{
+    char* s = (char*)malloc(256);
+    assert(s);
+    memset(s, 'x', 200);
+    sprintf(s + 200, "/%010u", k);
+    return s;
+}
+
+static void strings(u32 n)
+{
+    hashmap* hsmap = hsmap_new(&str_hash, &str_cmp, &id_dup, &id_dup,
+                               &id_rel, &id_rel);
+    char** keys = (char**)malloc(sizeof(char*) * 2 * n);
+    u64 t;
+    u32 k, found = 0;
+    assert(hsmap && keys);
+    for(k=0; k<2*n; k++)
+        keys[k] = make_str(k);
+
+    printf("%u keys of %zu bytes\n", n, strlen(keys[0]));
+    printf("%-8s %10s %14s %14s\n", "op", "Mops/s", "hash calls", "cmp calls");
+    nhash = ncmp = 0;
+    t = now_ns();
+    for(k=0; k<n; k++)
+        hsmap_insert(hsmap, keys[k], keys[k]);
+    t = now_ns() - t;
+    printf("%-8s %10.2f %14llu %14llu\n", "insert", n / (t / 1e9) / 1e6,
+           nhash, ncmp);
+
+    nhash = ncmp = 0;
+    t = now_ns();
+    for(k=0; k<n; k++)
+        found += hsmap_find(hsmap, keys[k]) != NULL;
+    t = now_ns() - t;
+    printf("%-8s %10.2f %14llu %14llu\n", "hit", n / (t / 1e9) / 1e6,
+           nhash, ncmp);
+
+    nhash = ncmp = 0;
+    t = now_ns();
+    for(k=n; k<2*n; k++)
+        found += hsmap_find(hsmap, keys[k]) != NULL;
+    t = now_ns() - t;
+    printf("%-8s %10.2f %14llu %14llu\n", "miss", n / (t / 1e9) / 1e6,
+           nhash, ncmp);
+    assert(found == n);
+
+    hsmap_del(hsmap);
+    for(k=0; k<2*n; k++)
+        free(keys[k]);
+    free(keys);
+}
+
+/* resident set size in MB */
+static double rss_mb()
+{
+    long pages = 0, rss = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if(f == NULL)
+        return 0;
+    if(fscanf(f, "%ld %ld", &pages, &rss) != 2)
+        rss = 0;
+    fclose(f);
+    return (double)rss * sysconf(_SC_PAGESIZE) / 1048576.0;
+}
+
+/* erase the oldest key and insert a new one at a steady size, then
+   drop to a tenth of it and shrink */
+static void churn(u32 n)
+{
+    hashmap* hsmap = hsmap_new(&id_hash, &id_cmp, &id_dup, &id_dup,
+                               &id_rel, &id_rel);
+    u32 k, round;
+    u64 t;
+    assert(hsmap);
+    printf("%-10s %12s %10s %10s\n", "ops", "Mops/s", "slots", "rss MB");
+    for(k=1; k<=n; k++)
+        hsmap_insert(hsmap, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+    printf("%-10u %12s %10u %10.1f\n", 0, "-", hsmap->tab.hashsize, rss_mb());
+
+    for(round=0; round<10; round++) {
+        t = now_ns();
+        for(k=0; k<n; k++) {
+            u32 key = round * n + k + 1;
+            hsmap_erase(hsmap, (void*)(uintptr_t)key);
+            key += n;
+            hsmap_insert(hsmap, (void*)(uintptr_t)key, (void*)(uintptr_t)key);
+        }
+        t = now_ns() - t;
+        assert(hsmap_count(hsmap) == n);
+        printf("%-10llu %12.2f %10u %10.1f\n", (u64)(round+1) * n,
+               n / (t / 1e9) / 1e6, hsmap->tab.hashsize, rss_mb());
+    }
+
+    for(k=0; k<n - n/10; k++) {
+        u32 key = 10 * n + k + 1;
+        hsmap_erase(hsmap, (void*)(uintptr_t)key);
+    }
+    printf("%-10s %12s %10u %10.1f\n", "erase 90%", "-", hsmap->tab.hashsize,
+           rss_mb());
+    hsmap_shrink_to_fit(hsmap);
+    printf("%-10s %12s %10u %10.1f\n", "shrink", "-", hsmap->tab.hashsize,
+           rss_mb());
+    hsmap_del(hsmap);
+}
+
+static void bulk(const char* name, u32 n, float growth, float load,
+                 int index, int reserve)
+{
+    hashmap* hsmap = hsmap_new(&id_hash, &id_cmp, &id_dup, &id_dup,
+                               &id_rel, &id_rel);
+    u64 t;
+    u32 k;
+    assert(hsmap);
+    hsmap_growth(hsmap, growth, load);
+    hsmap_index(hsmap, index);
+    t = now_ns();
+    if(reserve)
+        hsmap_reserve(hsmap, n);
+    for(k=1; k<=n; k++)
+        hsmap_insert(hsmap, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+    t = now_ns() - t;
+    double sec = t / 1e9;
+    double mb = ((double)hsmap->tab.hashsize * sizeof(hashitem) +
+                 (double)hsmap->tab.codesize * sizeof(u32)) / 1048576.0;
+
+    t = now_ns();
+    for(k=1; k<=n; k++)
+        assert(hsmap_find(hsmap, (void*)(uintptr_t)k));
+    double find = n / ((now_ns() - t) / 1e9) / 1e6;
+    printf("%-11u %-16s %8.2f %10.2f %10.2f %10.1f\n", n, name, sec,
+           n / sec / 1e6, find, mb);
+    hsmap_del(hsmap);
+}
+
+/* random lookups one at a time against hsmap_find_batch, on a table
+   meant to be well beyond the last level cache */
+static void batch(u32 n)
+{
+    static const u32 sizes[] = {1, 16, 64, 256};
+    const u32 nops = 4000000;
+    hashmap* hsmap = hsmap_new(&id_hash, &id_cmp, &id_dup, &id_dup,
+                               &id_rel, &id_rel);
+    void** keys = (void**)malloc(sizeof(void*) * nops);
+    void** vals = (void**)malloc(sizeof(void*) * nops);
+    u32 k, s, seed = 1, found;
+    u64 t;
+    assert(hsmap && keys && vals && hsmap_reserve(hsmap, n));
+    for(k=1; k<=n; k++)
+        hsmap_insert(hsmap, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+    /* three quarters hits */
+    for(k=0; k<nops; k++) {
+        seed = seed * 1103515245 + 12345;
+        keys[k] = (void*)(uintptr_t)((seed >> 2) % (n + n / 3) + 1);
+    }
+
+    printf("%u keys, table %.1f MB\n", n,
+           ((double)hsmap->tab.hashsize * sizeof(hashitem) +
+            (double)hsmap->tab.codesize * sizeof(u32)) / 1048576.0);
+    printf("%-8s %10s %10s\n", "batch", "Mfind/s", "ns/find");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        found = 0;
+        t = now_ns();
+        if(sizes[s] == 1) {
+            for(k=0; k<nops; k++)
+                found += (vals[k] = hsmap_find(hsmap, keys[k])) != NULL;
+        } else {
+            for(k=0; k<nops; k+=sizes[s])
+                found += hsmap_find_batch(hsmap, keys + k, sizes[s], vals + k);
+        }
+        t = now_ns() - t;
+        printf("%-8u %10.2f %10.1f\n", sizes[s], nops / (t / 1e9) / 1e6,
+               (double)t / nops);
+        assert(found > nops / 2);
+    }
+    hsmap_del(hsmap);
+    free(keys);
+    free(vals);
+}
+
+/* the key itself, which strided keys turn into long chains */
+static unsigned weak_hash(const void* a)
+{
+    return (u32)(uintptr_t)a;
+}
+
+/* what hsmap_stat shows for a good hash, a weak one and an overfull
+   table, and what a whole or sampled stat costs. ~empty is the empty
+   share seen by the sample */
+static void stats(u32 n)
+{
+    static const char* names[] = {"good", "weak", "weak fib", "load 8"};
+    hashstat st, part;
+    u32 k, m;
+    u64 t, full, sampled;
+
+    printf("%u keys, strided by 1024\n", n);
+    printf("%-10s %6s %6s %6s %6s %6s %8s %10s %10s\n", "table", "load",
+           "empty", "hit", "miss", "max", "~empty", "full us", "4096 us");
+    for(m = 0; m < 4; m++) {
+        hashmap* hsmap = hsmap_new(m == 1 || m == 2 ? &weak_hash : &id_hash,
+                                   &id_cmp, &id_dup, &id_dup,
+                                   &id_rel, &id_rel);
+        assert(hsmap);
+        if(m == 2)
+            hsmap_index(hsmap, HASH_INDEX_FIB);
+        if(m == 3)
+            hsmap_growth(hsmap, 2.0f, 8.0f);
+        for(k = 1; k <= n; k++)
+            hsmap_insert(hsmap, (void*)(uintptr_t)(k * 1024),
+                         (void*)(uintptr_t)k);
+        t = now_ns();
+        hsmap_stat(hsmap, &st, 0);
+        full = now_ns() - t;
+        t = now_ns();
+        hsmap_stat(hsmap, &part, 4096);
+        sampled = now_ns() - t;
+        printf("%-10s %6.2f %6.2f %6.2f %6.2f %6u %8.2f %10.1f %10.1f\n",
+               names[m], st.load, st.empty, st.hit_probe, st.miss_probe,
+               st.max_probe, part.empty, full / 1e3, sampled / 1e3);
+        hsmap_del(hsmap);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* mode = argc > 1 ? argv[1] : "";
+    int k;
+
+    if(strcmp(mode, "strings") == 0) {
+        strings(argc > 2 ? (u32)atol(argv[2]) : 1000000);
+        return 0;
+    }
+    if(strcmp(mode, "stats") == 0) {
+        stats(argc > 2 ? (u32)atol(argv[2]) : 1000000);
+        return 0;
+    }
+    if(strcmp(mode, "batch") == 0) {
+        batch(argc > 2 ? (u32)atol(argv[2]) : 16000000);
+        return 0;
+    }
+    if(strcmp(mode, "churn") == 0) {
+        churn(argc > 2 ? (u32)atol(argv[2]) : 1000000);
+        return 0;
+    }
+    if(strcmp(mode, "bulk") != 0) {
+        int n = argc > 2 ? atoi(argv[2]) : 2000000;
+        u32* lat = (u32*)malloc(sizeof(u32) * n);
+        assert(n > 0 && lat);
+        printf("%d inserts, ns per insert\n", n);
+        printf("%-12s %8s %8s %8s %8s %8s %10s\n", "mode", "mean", "p50",
+               "p99", "p99.9", "p99.99", "max");
+        latency("all-at-once", 0, n, lat);
+        latency("incremental", 1, n, lat);
+        free(lat);
+        if(strcmp(mode, "latency") == 0)
+            return 0;
+        printf("\n");
+    }
+
+    static const char* defaults[] = {"1000000", "10000000"};
+    const char** sizes = argc > 2 && strcmp(mode, "bulk") == 0 ?
+        (const char**)argv + 2 : defaults;
+    int nsize = argc > 2 && strcmp(mode, "bulk") == 0 ? argc - 2 : 2;
+    printf("%-11s %-16s %8s %10s %10s %10s\n", "keys", "policy", "sec",
+           "ins Mk/s", "find Mk/s", "table MB");
+    for(k=0; k<nsize; k++) {
+        u32 n = (u32)atol(sizes[k]);
+        assert(n > 0);
+        bulk("x2 mask", n, 2.0f, 0.5f, HASH_INDEX_MASK, 0);
+        bulk("x2 fib", n, 2.0f, 0.5f, HASH_INDEX_FIB, 0);
+        bulk("x1.5 mask", n, 1.5f, 0.5f, HASH_INDEX_MASK, 0);
+        bulk("x2 mask load 1", n, 2.0f, 1.0f, HASH_INDEX_MASK, 0);
+        bulk("reserved mask", n, 2.0f, 0.5f, HASH_INDEX_MASK, 1);
+    }
+    return 0;
+}
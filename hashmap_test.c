@@ -64,13 +64,24 @@ void int_rel(const void* key)
     free((int*)key);
 }
 
-int main()
+/* run finds until no incremental rehash is pending */
+static void rehash_done(hashmap* hsmap)
+{
+    int k = 0;
+    while(hsmap->old.codelist)
+        hsmap_find(hsmap, &k);
+}
+
+static void test_map(int incremental, int index, float growth, float load)
 {
     hashmap* hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
                                &int_rel, &int_rel);
 
     assert(hsmap);
-    int k;
+    hsmap_incremental(hsmap, incremental);
+    hsmap_growth(hsmap, growth, load);
+    assert(hsmap_index(hsmap, index));
+    int k, draining = 0;
     for(k=0; k<100000; k++)
     {
         int val = k+1;
@@ -79,13 +90,235 @@ int main()
         assert( v );
         assert(*(int*)v == val);
 
-#if 0
         val = k-1;
         assert(hsmap_insert(hsmap, &k, &val));
         v = hsmap_find(hsmap, &k);
         assert(v);
         assert(( *(int*)v == val));
-#endif
+        draining += hsmap->old.codelist != NULL;
+    }
+    assert(incremental ? draining > 0 : draining == 0);
+    assert(hsmap_count(hsmap) == 100000);
+
+    /* every key is visible in the middle of a rehash too */
+    for(k=0; k<100000; k++) {
+        void* v = hsmap_find(hsmap, &k);
+        assert(v && *(int*)v == k-1);
+        int miss = -k-1;
+        assert(hsmap_find(hsmap, &miss) == NULL);
+    }
+    assert((hsmap->tab.codesize & (hsmap->tab.codesize-1)) == 0);
+    assert(hsmap->tab.count <= hsmap->tab.codesize * load);
+
+    /* erase the odd keys, their slots are reused by new keys */
+    for(k=1; k<100000; k+=2)
+        assert(hsmap_erase(hsmap, &k));
+    k = 1;
+    assert(!hsmap_erase(hsmap, &k));
+    assert(hsmap_count(hsmap) == 50000);
+    for(k=0; k<100000; k++) {
+        void* v = hsmap_find(hsmap, &k);
+        assert(k % 2 ? v == NULL : v && *(int*)v == k-1);
+    }
+    rehash_done(hsmap);
+    u32 size = hsmap->tab.hashsize;
+    for(k=100001; k<200000; k+=2)
+        assert(hsmap_insert(hsmap, &k, &k));
+    assert(hsmap->tab.hashsize == size);
+    assert(hsmap_count(hsmap) == 100000);
+
+    /* keep one key in ten and pack them */
+    for(k=0; k<200000; k++)
+        if(k % 10)
+            hsmap_erase(hsmap, &k);
+    assert(hsmap_count(hsmap) == 10000);
+    assert(hsmap_shrink_to_fit(hsmap));
+    assert(hsmap->tab.hashsize == 10001 && hsmap->tab.top == 10001);
+    for(k=0; k<200000; k++) {
+        void* v = hsmap_find(hsmap, &k);
+        assert(k % 10 || k >= 100000 ? v == NULL : v && *(int*)v == k-1);
+    }
+    k = 5;
+    assert(hsmap_insert(hsmap, &k, &k) && hsmap_find(hsmap, &k));
+    hsmap_del(hsmap);
+}
+
+/* presized tables do not expand, switching index keeps the items */
+static void test_reserve()
+{
+    hashmap* hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                               &int_rel, &int_rel);
+    int k;
+    assert(hsmap && hsmap_reserve(hsmap, 50000));
+    u32 size = hsmap->tab.hashsize;
+    hashitem* items = hsmap->tab.hashlist;
+    for(k=0; k<50000; k++)
+        assert(hsmap_insert(hsmap, &k, &k));
+    assert(hsmap->tab.hashsize == size && hsmap->tab.hashlist == items);
+    assert(hsmap_reserve(hsmap, 100) && hsmap->tab.hashsize == size);
+
+    assert(hsmap_index(hsmap, HASH_INDEX_FIB));
+    assert(hsmap_count(hsmap) == 50000);
+    for(k=0; k<50000; k++) {
+        void* v = hsmap_find(hsmap, &k);
+        assert(v && *(int*)v == k);
+    }
+    hsmap_del(hsmap);
+}
+
+/* batched lookups agree with single ones, also in the middle of an
+   incremental rehash with keys in both tables */
+static void test_find_batch(int incremental)
+{
+    hashmap* hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                               &int_rel, &int_rel);
+    int keys[1000], k, round;
+    void* ptrs[1000];
+    void* vals[1000];
+    assert(hsmap);
+    hsmap_incremental(hsmap, incremental);
+    for(round=0; round<50; round++) {
+        for(k=0; k<1000; k++) {
+            int key = round * 1000 + k;
+            assert(hsmap_insert(hsmap, &key, &key));
+        }
+        /* half hits, half misses, in a scattered order */
+        for(k=0; k<1000; k++) {
+            keys[k] = (k * 7919) % ((round + 1) * 2000);
+            ptrs[k] = &keys[k];
+        }
+        u32 found = hsmap_find_batch(hsmap, ptrs, 1000, vals), hits = 0;
+        for(k=0; k<1000; k++) {
+            void* v = hsmap_find(hsmap, &keys[k]);
+            assert(vals[k] == v);
+            assert(keys[k] < (round + 1) * 1000 ? v && *(int*)v == keys[k]
+                                                : v == NULL);
+            hits += v != NULL;
+        }
+        assert(found == hits);
     }
+    assert(hsmap_find_batch(hsmap, ptrs, 0, vals) == 0);
+    hsmap_del(hsmap);
+}
+
+/* chain statistics, exact on the whole table and close when sampled */
+static void test_stat()
+{
+    hashmap* hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                               &int_rel, &int_rel);
+    hashstat st, part;
+    u32 k, n = 0;
+    u64 items = 0;
+    assert(hsmap);
+    hsmap_stat(hsmap, &st, 0);
+    assert(st.count == 0 && st.chains[0] == st.sampled && st.empty == 1.0);
+    assert(st.max_probe == 0 && st.hit_probe == 0 && st.bytes > 0);
+
+    for(k=0; k<100000; k++)
+        assert(hsmap_insert(hsmap, &k, &k));
+    hsmap_stat(hsmap, &st, 0);
+    assert(st.count == 100000 && st.sampled == st.buckets);
+    assert(st.load == (double)st.count / st.buckets);
+    for(k=0; k<HASH_STAT_CHAINS; k++) {
+        n += st.chains[k];
+        items += (u64)k * st.chains[k];
+    }
+    /* no chain is longer than the bins here */
+    assert(n == st.sampled && items == st.count);
+    assert(st.max_probe < HASH_STAT_CHAINS && st.hit_probe >= 1.0);
+    assert(st.miss_probe == st.load);
+
+    hsmap_stat(hsmap, &part, 1024);
+    assert(part.sampled == 1024);
+    assert(part.count == st.count && part.bytes == st.bytes);
+    assert(part.empty > st.empty - 0.1 && part.empty < st.empty + 0.1);
+
+    /* in the middle of a rehash both tables count */
+    hsmap_incremental(hsmap, 1);
+    for(k=100000; k<200000 && !hsmap->old.codelist; k++)
+        assert(hsmap_insert(hsmap, &k, &k));
+    assert(hsmap->old.codelist);
+    hsmap_stat(hsmap, &st, 0);
+    assert(st.count == hsmap_count(hsmap));
+    assert(st.buckets == hsmap->tab.codesize + hsmap->old.codesize);
+    hsmap_del(hsmap);
+}
+
+/* malloc with its own count of the live bytes and blocks */
+typedef struct {
+    size_t bytes;
+    size_t blocks;
+}counter;
+
+static void* count_alloc(void* ctx, size_t size)
+{
+    counter* c = (counter*)ctx;
+    c->bytes += size;
+    c->blocks++;
+    return malloc(size);
+}
+
+static void count_free(void* ctx, void* ptr, size_t size)
+{
+    counter* c = (counter*)ctx;
+    c->bytes -= size;
+    c->blocks--;
+    free(ptr);
+}
+
+/* every block goes through the allocator and is counted */
+static void test_alloc()
+{
+    counter c = {0, 0};
+    allocator alloc = {count_alloc, NULL, count_free, &c};
+    hashmap* hsmap = hsmap_new_alloc(&int_hash, &int_cmp, &int_dup,
+                                     &int_dup, &int_rel, &int_rel, &alloc);
+    memstat mem;
+    hashstat st;
+    u32 k;
+    assert(hsmap);
+    hsmap_mem(hsmap, &mem);
+    assert(mem.bytes == c.bytes && mem.blocks == 3 && mem.allocs == 3);
+
+    hsmap_incremental(hsmap, 1);
+    for(k=0; k<100000; k++) {
+        assert(hsmap_insert(hsmap, &k, &k));
+        hsmap_mem(hsmap, &mem);
+        assert(mem.bytes == c.bytes && mem.blocks == c.blocks);
+    }
+    rehash_done(hsmap);
+    hsmap_mem(hsmap, &mem);
+    hsmap_stat(hsmap, &st, 0);
+    assert(mem.bytes == c.bytes && mem.blocks == 3 && mem.allocs > 3);
+    assert(mem.bytes == st.bytes);
+
+    for(k=0; k<100000; k++)
+        assert(hsmap_erase(hsmap, &k));
+    assert(hsmap_shrink_to_fit(hsmap));
+    hsmap_mem(hsmap, &mem);
+    assert(mem.bytes == c.bytes && mem.blocks == 3);
+    hsmap_del(hsmap);
+    assert(c.bytes == 0 && c.blocks == 0);
+
+    /* the default allocator counts the same way */
+    hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                      &int_rel, &int_rel);
+    hsmap_mem(hsmap, &mem);
+    hsmap_stat(hsmap, &st, 0);
+    assert(mem.blocks == 3 && mem.bytes == st.bytes);
+    hsmap_del(hsmap);
+}
+
+int main()
+{
+    test_map(0, HASH_INDEX_MASK, HASH_GROWTH, 1.0f / HASH_OPTIMAL_RATE);
+    test_map(1, HASH_INDEX_MASK, HASH_GROWTH, 1.0f / HASH_OPTIMAL_RATE);
+    test_map(0, HASH_INDEX_FIB, 1.25f, 2.0f);
+    test_map(1, HASH_INDEX_FIB, 1.5f, 1.0f);
+    test_reserve();
+    test_find_batch(0);
+    test_find_batch(1);
+    test_stat();
+    test_alloc();
     return 0;  
 }
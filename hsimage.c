@@ -0,0 +1,259 @@
+
+// @Name   : hsimage.c
+//
+// @Brief  : flat mmap-able hashmap image
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hsimage.h"
+
+#define ALIGN8(n) (((u64)(n) + 7) & ~7ULL)
+
+#define OUTBUF (1 << 16)
+
+static const char pad[8];
+
+/* items and data are written a few bytes at a time, a buffer of our
+   own keeps that from going through stdio call by call */
+typedef struct {
+    FILE* f;
+    int ok;
+    u32 n;
+    char buf[OUTBUF];
+}output;
+
+static void
+flush(output* out)
+{
+    if( out->n && fwrite(out->buf, 1, out->n, out->f) != out->n )
+        out->ok = 0;
+    out->n = 0;
+}
+
+static void
+put(output* out, const void* p, u64 n)
+{
+    if( out->n + n > OUTBUF ) {
+        flush(out);
+        if( n > OUTBUF ) {
+            if( fwrite(p, 1, n, out->f) != n )
+                out->ok = 0;
+            return;
+        }
+    }
+    memcpy(out->buf + out->n, p, n);
+    out->n += n;
+}
+
+/* same indexing as the hashmap the image was saved from */
+static inline u32
+bucket_of(const hsimage_header* head, u32 code)
+{
+    if( head->index == HASH_INDEX_FIB )
+        return (code * 2654435769u) >> (32 - head->shift);
+    return code & (head->codesize - 1);
+}
+
+/* bytes of key and val in the data section, 0 stands for NULL */
+static u64
+data_size(const void* p, size_f size)
+{
+    return p ? ALIGN8(size(p)) : 0;
+}
+
+static void
+put_data(output* out, const void* p, size_f size)
+{
+    u32 n;
+    if( p == NULL )
+        return;
+    n = size(p);
+    put(out, p, n);
+    put(out, pad, ALIGN8(n) - n);
+}
+
+/* the items go out bucket by bucket with each chain in a row, then
+   the data in the same order, so offsets are known before it is
+   written */
+static int
+write_image(output* out, const hashtable* t, u32 index,
+            size_f keysize, size_f valsize)
+{
+    hsimage_header head;
+    hsimage_item item;
+    u32* codelist = (u32*)calloc(t->codesize, sizeof(u32));
+    u32 b, idx, n = 1;
+    u64 data;
+    if( codelist == NULL )
+        return 0;
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, HSIMAGE_MAGIC, sizeof(head.magic));
+    head.codesize = t->codesize;
+    head.shift    = t->shift;
+    head.index    = index;
+    head.count    = t->count;
+    head.codeoff  = ALIGN8(sizeof(head));
+    head.itemoff  = ALIGN8(head.codeoff + (u64)t->codesize * sizeof(u32));
+    head.dataoff  = head.itemoff + (u64)(t->count + 1) * sizeof(item);
+
+    data = head.dataoff;
+    for(b = 0; b < t->codesize; b++) {
+        if( t->codelist[b] )
+            codelist[b] = n;
+        for(idx = t->codelist[b]; idx; idx = t->hashlist[idx].next, n++)
+            data += data_size(t->hashlist[idx].key, keysize) +
+                data_size(t->hashlist[idx].val, valsize);
+    }
+    head.size = data;
+
+    put(out, &head, sizeof(head));
+    put(out, pad, head.codeoff - sizeof(head));
+    put(out, codelist, (u64)t->codesize * sizeof(u32));
+    put(out, pad, head.itemoff - head.codeoff -
+        (u64)t->codesize * sizeof(u32));
+
+    memset(&item, 0, sizeof(item));
+    put(out, &item, sizeof(item));
+    data = head.dataoff;
+    for(b = 0; b < t->codesize; b++) {
+        n = codelist[b];
+        for(idx = t->codelist[b]; idx; idx = t->hashlist[idx].next) {
+            const hashitem* it = &t->hashlist[idx];
+            item.code = it->code;
+            item.next = it->next ? ++n : 0;
+            item.key  = it->key ? data : 0;
+            data += data_size(it->key, keysize);
+            item.val  = it->val ? data : 0;
+            data += data_size(it->val, valsize);
+            put(out, &item, sizeof(item));
+        }
+    }
+    free(codelist);
+
+    for(b = 0; b < t->codesize; b++)
+        for(idx = t->codelist[b]; idx; idx = t->hashlist[idx].next) {
+            put_data(out, t->hashlist[idx].key, keysize);
+            put_data(out, t->hashlist[idx].val, valsize);
+        }
+    flush(out);
+    return out->ok;
+}
+
+int hsmap_save(hashmap* hsmap, const char* path,
+               size_f keysize, size_f valsize)
+{
+    char* tmp = (char*)malloc(strlen(path) + 5);
+    output* out = (output*)malloc(sizeof(output));
+    int ok, incremental = hsmap->incremental;
+    if( tmp == NULL || out == NULL ) {
+        free(tmp);
+        free(out);
+        return 0;
+    }
+    /* one table to walk */
+    hsmap_incremental(hsmap, 0);
+    hsmap_incremental(hsmap, incremental);
+
+    sprintf(tmp, "%s.tmp", path);
+    out->f  = fopen(tmp, "wb");
+    out->ok = 1;
+    out->n  = 0;
+    if( out->f == NULL ) {
+        free(tmp);
+        free(out);
+        return 0;
+    }
+    ok = write_image(out, &hsmap->tab, hsmap->index, keysize, valsize);
+    ok = fclose(out->f) == 0 && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if( !ok )
+        unlink(tmp);
+    free(tmp);
+    free(out);
+    return ok;
+}
+
+hsimage* hsmap_map(const char* path, hash_f hash, cmp_f cmp)
+{
+    const hsimage_header* head;
+    hsimage* img;
+    struct stat st;
+    void* base;
+    int fd = open(path, O_RDONLY);
+    if( fd < 0 )
+        return NULL;
+    if( fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(hsimage_header) ) {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if( base == MAP_FAILED )
+        return NULL;
+
+    /* the sections must lie inside the file, the items are trusted.
+       the shift is bounded before it is used and the offsets are
+       ordered first, so none of the sums below can wrap */
+    head = (const hsimage_header*)base;
+    if( memcmp(head->magic, HSIMAGE_MAGIC, sizeof(head->magic)) != 0 ||
+        head->size != (u64)st.st_size ||
+        head->shift == 0 || head->shift > 31 ||
+        head->codesize != 1u << head->shift ||
+        head->codeoff > head->itemoff || head->itemoff > head->dataoff ||
+        head->dataoff > head->size ||
+        head->codeoff + (u64)head->codesize * sizeof(u32) > head->itemoff ||
+        head->itemoff + ((u64)head->count + 1) * sizeof(hsimage_item) >
+            head->dataoff ) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    img = (hsimage*)malloc(sizeof(hsimage));
+    if( img == NULL ) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    img->base     = (const char*)base;
+    img->size     = st.st_size;
+    img->head     = head;
+    img->codelist = (const u32*)(img->base + head->codeoff);
+    img->items    = (const hsimage_item*)(img->base + head->itemoff);
+    img->hash     = hash;
+    img->cmp      = cmp;
+    return img;
+}
+
+void hsimage_unmap(hsimage* img)
+{
+    if( img == NULL )
+        return;
+    munmap((void*)img->base, img->size);
+    free(img);
+}
+
+const void* hsimage_find(const hsimage* img, const void* key)
+{
+    assert(img);
+    u32 code = img->hash(key);
+    u32 idx = img->codelist[bucket_of(img->head, code)];
+    while( idx ) {
+        const hsimage_item* item = &img->items[idx];
+        if( item->code == code &&
+            img->cmp(img->base + item->key, key) == 0 )
+            return item->val ? img->base + item->val : NULL;
+        idx = item->next;
+    }
+    return NULL;
+}
+
+u32 hsimage_count(const hsimage* img)
+{
+    return img->head->count;
+}
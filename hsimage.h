@@ -0,0 +1,78 @@
+
+// @Name   : HSIMAGE_H
+//
+// @Brief  : flat image of a hashmap for a warm start without any
+//           inserts. hsmap_save writes the buckets, the items and the
+//           key and value bytes, linked by file offsets instead of
+//           pointers. hsmap_map maps such a file read-only, so it
+//           can be looked up at once, no per-entry work, and the
+//           pages are shared by every process mapping it. the image
+//           keeps the hash codes and the bucket indexing, so it must
+//           be read back with the same hash function.
+
+#if !defined(HSIMAGE_H)
+#define HSIMAGE_H
+
+#include <stddef.h>
+#include "hashmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HSIMAGE_MAGIC "HSIMAGE1"
+
+/* bytes of a key or value to copy into the image */
+typedef u32 (*size_f)(const void* p);
+
+/* offsets are from the start of the file, 0 stands for NULL */
+typedef struct {
+    char magic[8];
+    u32 codesize;       /* buckets, a power of two */
+    u32 shift;
+    u32 index;          /* HASH_INDEX_MASK or HASH_INDEX_FIB */
+    u32 count;          /* items, slot 0 is not one of them */
+    u64 codeoff;        /* u32 codelist[codesize] */
+    u64 itemoff;        /* hsimage_item items[count + 1] */
+    u64 dataoff;        /* key and value bytes, 8-byte aligned */
+    u64 size;           /* of the whole file */
+}hsimage_header;
+
+typedef struct {
+    u64 key;
+    u64 val;
+    u32 next;           /* items of a chain are stored in a row */
+    u32 code;
+}hsimage_item;
+
+typedef struct {
+    const char* base;
+    size_t size;
+    const hsimage_header* head;
+    const u32* codelist;
+    const hsimage_item* items;
+    hash_f hash;
+    cmp_f  cmp;
+}hsimage;
+
+/* write hsmap to path, through a temporary file renamed over it so
+   processes that mapped the old image keep a valid one. a running
+   incremental rehash is finished first.
+   @ 0 : failed
+   @ 1 : saved */
+int hsmap_save(hashmap* hsmap, const char* path,
+               size_f keysize, size_f valsize);
+
+/* NULL if path cannot be mapped or is not a valid image */
+hsimage* hsmap_map(const char* path, hash_f hash, cmp_f cmp);
+void     hsimage_unmap(hsimage* img);
+
+/* value of key inside the mapping, read-only, NULL if not found */
+const void* hsimage_find(const hsimage* img, const void* key);
+u32         hsimage_count(const hsimage* img);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+// @Name   : hsimage_test.c
+//
+// @Brief  :
+
+#include "hsimage.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PATH "hsimage_test.img"
+
+static unsigned int_hash(const void* a)
+{
+    u32 key = (u32)(*(int*)a);
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static int int_cmp(const void* a, const void* b)
+{
+    return *(int*)a - *(int*)b;
+}
+
+static void* int_dup(const void* key)
+{
+    int* res = (int*)malloc(sizeof(int));
+    *res = *(int*)key;
+    return res;
+}
+
+static void int_rel(const void* key)
+{
+    free((int*)key);
+}
+
+static u32 int_size(const void* p)
+{
+    (void)p;
+    return sizeof(int);
+}
+
+static void* str_dup(const void* s)
+{
+    return strdup((const char*)s);
+}
+
+static void str_rel(const void* s)
+{
+    free((char*)s);
+}
+
+static u32 str_size(const void* s)
+{
+    return strlen((const char*)s) + 1;
+}
+
+/* int keys to strings of varying length, some erased, saved in the
+   middle of an incremental rehash */
+static void test_image(int incremental, int index)
+{
+    hashmap* hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &str_dup,
+                               &int_rel, &str_rel);
+    hsimage* img;
+    char buf[64];
+    int k;
+    assert(hsmap && hsmap_index(hsmap, index));
+    hsmap_incremental(hsmap, incremental);
+    for(k=0; k<100000; k++) {
+        sprintf(buf, "v%.*d", k % 40, k);
+        assert(hsmap_insert(hsmap, &k, buf));
+    }
+    for(k=0; k<100000; k+=3)
+        assert(hsmap_erase(hsmap, &k));
+    assert(hsmap_save(hsmap, PATH, &int_size, &str_size));
+    /* the map itself is unchanged */
+    assert(hsmap_count(hsmap) == 66666);
+
+    img = hsmap_map(PATH, &int_hash, &int_cmp);
+    assert(img && hsimage_count(img) == 66666);
+    for(k=-10; k<110000; k++) {
+        const char* v = (const char*)hsimage_find(img, &k);
+        const char* w = (const char*)hsmap_find(hsmap, &k);
+        assert(v == NULL ? w == NULL : w && strcmp(v, w) == 0);
+        if(v) {
+            sprintf(buf, "v%.*d", k % 40, k);
+            assert(strcmp(v, buf) == 0);
+        }
+    }
+
+    /* another process shares the same pages */
+    if(fork() == 0) {
+        hsimage* other = hsmap_map(PATH, &int_hash, &int_cmp);
+        k = 4;
+        _exit(other && strcmp((const char*)hsimage_find(other, &k),
+                              "v0004") == 0 ? 0 : 1);
+    }
+    wait(&k);
+    assert(WIFEXITED(k) && WEXITSTATUS(k) == 0);
+
+    /* saving over a mapped image leaves the mapping intact */
+    k = 1;
+    assert(hsmap_insert(hsmap, &k, "changed"));
+    assert(hsmap_save(hsmap, PATH, &int_size, &str_size));
+    assert(strcmp((const char*)hsimage_find(img, &k), "v1") == 0);
+    hsimage_unmap(img);
+    img = hsmap_map(PATH, &int_hash, &int_cmp);
+    assert(img && strcmp((const char*)hsimage_find(img, &k), "changed") == 0);
+    hsimage_unmap(img);
+    hsmap_del(hsmap);
+}
+
+/* save hsmap and rewrite one field of the header, the map must
+   refuse the image */
+static void expect_bad_header(hashmap* hsmap, size_t off, u32 val)
+{
+    FILE* f;
+    assert(hsmap_save(hsmap, PATH, &int_size, &int_size));
+    f = fopen(PATH, "r+b");
+    assert(f && fseek(f, (long)off, SEEK_SET) == 0);
+    assert(fwrite(&val, sizeof(val), 1, f) == 1);
+    fclose(f);
+    assert(hsmap_map(PATH, &int_hash, &int_cmp) == NULL);
+}
+
+/* empty maps and files that are not images */
+static void test_invalid()
+{
+    hashmap* hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                               &int_rel, &int_rel);
+    hsimage* img;
+    FILE* f;
+    int k = 7;
+    assert(hsmap_save(hsmap, PATH, &int_size, &int_size));
+    img = hsmap_map(PATH, &int_hash, &int_cmp);
+    assert(img && hsimage_count(img) == 0 && !hsimage_find(img, &k));
+    hsimage_unmap(img);
+    expect_bad_header(hsmap, offsetof(hsimage_header, shift), 32);
+    expect_bad_header(hsmap, offsetof(hsimage_header, shift), 40);
+    expect_bad_header(hsmap, offsetof(hsimage_header, count), 0xFFFFFFFF);
+    assert(hsmap_save(hsmap, PATH, &int_size, &int_size));
+    hsmap_del(hsmap);
+
+    f = fopen(PATH, "r+b");
+    assert(f && fputc('X', f) != EOF);
+    fclose(f);
+    assert(hsmap_map(PATH, &int_hash, &int_cmp) == NULL);
+    assert(truncate(PATH, 16) == 0);
+    assert(hsmap_map(PATH, &int_hash, &int_cmp) == NULL);
+    assert(hsmap_map("no/such/file", &int_hash, &int_cmp) == NULL);
+    unlink(PATH);
+}
+
+int main()
+{
+    test_image(0, HASH_INDEX_MASK);
+    test_image(1, HASH_INDEX_FIB);
+    test_invalid();
+    printf("hsimage test ok\n");
+    return 0;
+}
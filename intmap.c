@@ -0,0 +1,165 @@
+
+// @Name   : intmap.c
+//
+// @Brief  : integer hashmap with inline keys and values
+
+#include <assert.h>
+#include <stdlib.h>
+#include "intmap.h"
+
+/* splitmix64 finalizer, every key bit reaches the low bits */
+static inline u64
+mix64(u64 x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline u32
+home_of(const intmap* imap, u64 key)
+{
+    return (u32)mix64(key) & (imap->capacity - 1);
+}
+
+/* slot of key, or of the empty slot ending its run */
+static inline u32
+probe(const intmap* imap, u64 key)
+{
+    u32 mask = imap->capacity - 1;
+    u32 idx = home_of(imap, key);
+    while(imap->slots[idx].key != 0 && imap->slots[idx].key != key)
+        idx = (idx + 1) & mask;
+    return idx;
+}
+
+static int
+rehash(intmap* imap, u32 capacity)
+{
+    imslot* old = imap->slots;
+    u32 n, size = imap->capacity;
+
+    imap->slots = (imslot*)calloc(capacity, sizeof(imslot));
+    if(imap->slots == NULL) {
+        imap->slots = old;
+        return 0;
+    }
+    imap->capacity = capacity;
+    for(n = 0; n < size; n++)
+        if(old[n].key != 0)
+            imap->slots[probe(imap, old[n].key)] = old[n];
+    free(old);
+    return 1;
+}
+
+intmap* imap_new()
+{
+    intmap* imap = (intmap*)calloc(1, sizeof(intmap));
+    if(imap == NULL)
+        return NULL;
+    imap->capacity = IMAP_MIN_CAPACITY;
+    imap->slots = (imslot*)calloc(imap->capacity, sizeof(imslot));
+    if(imap->slots == NULL) {
+        free(imap);
+        return NULL;
+    }
+    return imap;
+}
+
+void imap_del(intmap* imap)
+{
+    if(imap == NULL)
+        return;
+    free(imap->slots);
+    free(imap);
+}
+
+int imap_insert(intmap* imap, u64 key, u64 val)
+{
+    assert(imap);
+    if(key == 0) {
+        imap->zero_used = 1;
+        imap->zero_val  = val;
+        return 1;
+    }
+    u32 idx = probe(imap, key);
+    if(imap->slots[idx].key == key) {
+        imap->slots[idx].val = val;
+        return 1;
+    }
+    if((u64)(imap->count + 1) * IMAP_LOAD_DEN >
+       (u64)imap->capacity * IMAP_LOAD_NUM) {
+        if(imap->capacity == IMAP_MAX_CAPACITY ||
+           !rehash(imap, imap->capacity * 2))
+            return 0;
+        idx = probe(imap, key);
+    }
+    imap->slots[idx].key = key;
+    imap->slots[idx].val = val;
+    imap->count++;
+    return 1;
+}
+
+u64* imap_find(intmap* imap, u64 key)
+{
+    assert(imap);
+    if(key == 0)
+        return imap->zero_used ? &imap->zero_val : NULL;
+    u32 idx = probe(imap, key);
+    return imap->slots[idx].key == key ? &imap->slots[idx].val : NULL;
+}
+
+/* pull back every later key of the run whose home does not lie
+   between the hole and itself, so probes never meet a gap */
+int imap_erase(intmap* imap, u64 key)
+{
+    assert(imap);
+    if(key == 0) {
+        int was = imap->zero_used;
+        imap->zero_used = 0;
+        return was;
+    }
+    u32 mask = imap->capacity - 1;
+    u32 hole = probe(imap, key), idx;
+    if(imap->slots[hole].key != key)
+        return 0;
+    for(idx = (hole + 1) & mask; imap->slots[idx].key != 0;
+        idx = (idx + 1) & mask) {
+        u32 home = home_of(imap, imap->slots[idx].key);
+        if(((idx - home) & mask) >= ((idx - hole) & mask)) {
+            imap->slots[hole] = imap->slots[idx];
+            hole = idx;
+        }
+    }
+    imap->slots[hole].key = 0;
+    imap->slots[hole].val = 0;
+    imap->count--;
+    return 1;
+}
+
+u32 imap_count(intmap* imap)
+{
+    return imap->count + (imap->zero_used ? 1 : 0);
+}
+
+int imap_reserve(intmap* imap, u32 n)
+{
+    u32 capacity = imap->capacity;
+    while((u64)capacity * IMAP_LOAD_NUM < (u64)n * IMAP_LOAD_DEN) {
+        /* the slots are counted in a u32 */
+        if(capacity == IMAP_MAX_CAPACITY)
+            return 0;
+        capacity *= 2;
+    }
+    if(capacity == imap->capacity)
+        return 1;
+    return rehash(imap, capacity);
+}
+
+size_t imap_bytes(intmap* imap)
+{
+    return sizeof(intmap) + (size_t)imap->capacity * sizeof(imslot);
+}
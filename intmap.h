@@ -0,0 +1,62 @@
+
+// @Name   : INTMAP_H
+//
+// @Brief  : hashmap for 64-bit integer keys and values, both stored
+//           inline in one slot array, no callbacks and no per-entry
+//           allocation. linear probing on a mixed key, erase shifts
+//           the following run back so there are no tombstones. key 0
+//           marks empty slots and is kept aside in the map itself.
+//           32-bit keys and values fit as they are.
+
+#if !defined(INTMAP_H)
+#define INTMAP_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned int u32;
+typedef unsigned long long u64;
+
+#define IMAP_MIN_CAPACITY 16
+#define IMAP_LOAD_NUM     3       /* at most 3/4 full */
+#define IMAP_LOAD_DEN     4
+#define IMAP_MAX_CAPACITY (1u << 31)
+
+typedef struct {
+    u64 key;
+    u64 val;
+}imslot;
+
+typedef struct {
+    u32 capacity;           /* slots, a power of two */
+    u32 count;              /* keys in slots, key 0 not included */
+    imslot* slots;
+    int zero_used;          /* key 0 is present */
+    u64 zero_val;
+}intmap;
+
+intmap* imap_new();
+void    imap_del(intmap* imap);
+
+/* @ 0 : add failed
+   @ 1 : added or updated */
+int     imap_insert(intmap* imap, u64 key, u64 val);
+/* pointer to the value of key, NULL if not found, valid until the
+   next insert or erase */
+u64*    imap_find(intmap* imap, u64 key);
+int     imap_erase(intmap* imap, u64 key);
+u32     imap_count(intmap* imap);
+/* room for n keys without a rehash, 0 when n would need more than
+   IMAP_MAX_CAPACITY slots or the memory runs out */
+int     imap_reserve(intmap* imap, u32 n);
+/* heap bytes held by the map */
+size_t  imap_bytes(intmap* imap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
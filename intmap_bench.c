@@ -0,0 +1,147 @@
+
+// @Name   : intmap_bench.c
+//
+// @Brief  : int keys and values in intmap against the generic
+//           hashmap path of hashmap_test.c (a malloc'd copy of each
+//           key and value), entries/sec and bytes/entry from RSS.
+//           build with: make CFLAGS=-O2 intmap_bench
+//           usage: intmap_bench [keys]
+
+#include "intmap.h"
+#include "hashmap.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static unsigned int_hash(const void* a)
+{
+    u32 key = (u32)(*(int*)a);
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static int int_cmp(const void* a, const void* b)
+{
+    return *(int*)a - *(int*)b;
+}
+
+static void* int_dup(const void* key)
+{
+    int* res = (int*)malloc(sizeof(int));
+    *res = *(int*)key;
+    return res;
+}
+
+static void int_rel(const void* key)
+{
+    free((int*)key);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double rss_bytes()
+{
+    long pages = 0, rss = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if(f == NULL)
+        return 0;
+    if(fscanf(f, "%ld %ld", &pages, &rss) != 2)
+        rss = 0;
+    fclose(f);
+    return (double)rss * sysconf(_SC_PAGESIZE);
+}
+
+static void report(const char* name, int n, double ins, double find,
+                   double erase, double bytes)
+{
+    printf("%-10s %12.2f %12.2f %12.2f %12.1f\n", name, n / ins / 1e6,
+           n / find / 1e6, n / erase / 1e6, bytes / n);
+}
+
+static void run_hashmap(int n)
+{
+    double t0, t1, t2, t3, rss = rss_bytes();
+    long sum = 0;
+    int k;
+    hashmap* hsmap = hsmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                               &int_rel, &int_rel);
+    assert(hsmap);
+    t0 = now_sec();
+    for(k=0; k<n; k++)
+        hsmap_insert(hsmap, &k, &k);
+    t1 = now_sec();
+    rss = rss_bytes() - rss;
+    for(k=0; k<n; k++)
+        sum += *(int*)hsmap_find(hsmap, &k);
+    t2 = now_sec();
+    for(k=0; k<n; k++)
+        hsmap_erase(hsmap, &k);
+    t3 = now_sec();
+    assert(sum == (long)n * (n - 1) / 2);
+    report("hashmap", n, t1 - t0, t2 - t1, t3 - t2, rss);
+    hsmap_del(hsmap);
+}
+
+static void run_intmap(int n)
+{
+    double t0, t1, t2, t3, rss = rss_bytes();
+    long sum = 0;
+    int k;
+    intmap* imap = imap_new();
+    assert(imap);
+    t0 = now_sec();
+    for(k=0; k<n; k++)
+        imap_insert(imap, k, k);
+    t1 = now_sec();
+    rss = rss_bytes() - rss;
+    for(k=0; k<n; k++)
+        sum += (long)*imap_find(imap, k);
+    t2 = now_sec();
+    for(k=0; k<n; k++)
+        imap_erase(imap, k);
+    t3 = now_sec();
+    assert(sum == (long)n * (n - 1) / 2);
+    report("intmap", n, t1 - t0, t2 - t1, t3 - t2, rss);
+    imap_del(imap);
+}
+
+/* each map in its own process, so freed heap does not hide the
+   memory of the next one */
+static void run(void (*fn)(int), int n)
+{
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if(pid == 0) {
+        fn(n);
+        fflush(stdout);
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char** argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 5000000;
+    assert(n > 0);
+
+    printf("%d int keys\n", n);
+    printf("%-10s %12s %12s %12s %12s\n", "", "insert M/s", "find M/s",
+           "erase M/s", "bytes/entry");
+    fflush(stdout);
+    run(run_hashmap, n);
+    run(run_intmap, n);
+    return 0;
+}
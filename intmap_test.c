@@ -0,0 +1,87 @@
+// @Name   : intmap_test.c
+//
+// @Brief  :
+
+#include "intmap.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RANGE 50000
+
+static u64  ref[RANGE];
+static char has[RANGE];
+
+/* keys spread over the u64 range, 0 included */
+static u64 key_of(u32 k)
+{
+    return k == 0 ? 0 : (u64)k * 0x9E3779B97F4A7C15ULL;
+}
+
+int main()
+{
+    intmap* imap = imap_new();
+    u32 k, n = 0, it;
+    assert(imap);
+
+    for(k=0; k<100000; k++) {
+        assert(imap_insert(imap, k, k+1));
+        assert(*imap_find(imap, k) == k+1);
+        assert(imap_insert(imap, k, (u64)k-1));
+        assert(*imap_find(imap, k) == (u64)k-1);
+    }
+    assert(imap_count(imap) == 100000);
+    assert(imap_find(imap, 100000) == NULL);
+    for(k=0; k<100000; k+=2)
+        assert(imap_erase(imap, k));
+    assert(!imap_erase(imap, 0) && !imap_erase(imap, 2));
+    for(k=0; k<100000; k++)
+        assert(k % 2 ? *imap_find(imap, k) == (u64)k-1 : imap_find(imap, k) == NULL);
+    assert(imap_count(imap) == 50000);
+    imap_del(imap);
+
+    /* random insert/erase against a plain array */
+    imap = imap_new();
+    srand(5);
+    for(it=0; it<2000000; it++) {
+        k = rand() % RANGE;
+        if(rand() % 3) {
+            u64 v = rand();
+            assert(imap_insert(imap, key_of(k), v));
+            n += !has[k];
+            has[k] = 1;
+            ref[k] = v;
+        } else {
+            assert(imap_erase(imap, key_of(k)) == has[k]);
+            n -= has[k];
+            has[k] = 0;
+        }
+        if(it % 1000 == 0) {
+            k = rand() % RANGE;
+            u64* v = imap_find(imap, key_of(k));
+            assert(has[k] ? v && *v == ref[k] : v == NULL);
+        }
+    }
+    assert(imap_count(imap) == n);
+    for(k=0; k<RANGE; k++) {
+        u64* v = imap_find(imap, key_of(k));
+        assert(has[k] ? v && *v == ref[k] : v == NULL);
+    }
+    imap_del(imap);
+
+    imap = imap_new();
+    assert(imap && imap_reserve(imap, 100000));
+    u32 capacity = imap->capacity;
+    for(k=1; k<=100000; k++)
+        assert(imap_insert(imap, k, k));
+    assert(imap->capacity == capacity);
+    assert(imap_bytes(imap) >= capacity * sizeof(imslot));
+    /* beyond what a u32 of slots can hold, it fails untouched */
+    assert(imap_reserve(imap, 0xFFFFFFFF) == 0);
+    assert(imap_reserve(imap, (u32)(1u << 31) + 1) == 0);
+    assert(imap->capacity == capacity && imap_count(imap) == 100000);
+    imap_del(imap);
+
+    printf("intmap test ok\n");
+    return 0;
+}
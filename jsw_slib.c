@@ -7,14 +7,10 @@
 
 #ifdef __cplusplus
 #include <climits>
-#include <cstdlib>
 
-using std::malloc;
-using std::free;
 using std::size_t;
 #else
 #include <limits.h>
-#include <stdlib.h>
 #endif
 
 typedef struct jsw_node {
@@ -33,6 +29,8 @@ struct jsw_skip {
   cmp_f        cmp;  /* User defined item compare function */
   dup_f        dup;  /* User defined item copy function */
   rel_f        rel;  /* User defined delete function */
+  allocator    alloc; /* Source of the list and node memory */
+  memstat      mem;   /* What the list holds of it */
 };
 
 /*
@@ -49,8 +47,10 @@ static size_t rlevel ( size_t max )
 
   for ( h = 0; !found; h++ ) {
     if ( reset == 0 ) {
+      /* jsw_rand gives 32 bits, the zeros above them would make
+         every few columns full height */
       bits = jsw_rand();
-      reset = sizeof ( size_t ) * CHAR_BIT - 1;
+      reset = 32 - 1;
     }
 
     /*
@@ -71,18 +71,20 @@ static size_t rlevel ( size_t max )
 }
 
 /* This function does not make a copy of the item */
-static jsw_node_t *new_node ( void *item, size_t height )
+static jsw_node_t *new_node ( jsw_skip_t *skip, void *item, size_t height )
 {
-  jsw_node_t *node = (jsw_node_t *)malloc ( sizeof *node );
+  jsw_node_t *node = (jsw_node_t *)mem_alloc ( &skip->alloc, &skip->mem,
+                                               sizeof *node );
   size_t i;
 
   if ( node == NULL )
     return NULL;
 
-  node->next = (jsw_node_t **)malloc ( height * sizeof *node->next );
+  node->next = (jsw_node_t **)mem_alloc ( &skip->alloc, &skip->mem,
+                                          height * sizeof *node->next );
 
   if ( node->next == NULL ) {
-    free ( node );
+    mem_free ( &skip->alloc, &skip->mem, node, sizeof *node );
     return NULL;
   }
 
@@ -96,10 +98,11 @@ static jsw_node_t *new_node ( void *item, size_t height )
 }
 
 /* This function does not release an item's memory */
-static void delete_node ( jsw_node_t *node )
+static void delete_node ( jsw_skip_t *skip, jsw_node_t *node )
 {
-  free ( node->next );
-  free ( node );
+  mem_free ( &skip->alloc, &skip->mem, node->next,
+             node->height * sizeof *node->next );
+  mem_free ( &skip->alloc, &skip->mem, node, sizeof *node );
 }
 
 /* Find an existing item, or the position before where it would be */
@@ -125,23 +128,37 @@ static jsw_node_t *locate ( jsw_skip_t *skip, void *item )
 /* Allocate and initialize a new skip list */
 jsw_skip_t *jsw_snew ( size_t max, cmp_f cmp, dup_f dup, rel_f rel )
 {
-  jsw_skip_t *skip = (jsw_skip_t *)malloc ( sizeof *skip );
+  return jsw_snew_alloc ( max, cmp, dup, rel, NULL );
+}
+
+jsw_skip_t *jsw_snew_alloc ( size_t max, cmp_f cmp, dup_f dup, rel_f rel,
+                             const allocator *alloc )
+{
+  allocator a;
+  memstat mem;
+  jsw_skip_t *skip;
+
+  mem_init ( &a, &mem, alloc );
+  skip = (jsw_skip_t *)mem_alloc ( &a, &mem, sizeof *skip );
 
   if ( skip == NULL )
     return NULL;
 
-  skip->head = new_node ( NULL, ++max );
+  skip->alloc = a;
+  skip->mem = mem;
+  skip->head = new_node ( skip, NULL, ++max );
 
   if ( skip->head == NULL ) {
-    free ( skip );
+    mem_free ( &a, &skip->mem, skip, sizeof *skip );
     return NULL;
   }
 
-  skip->fix = (jsw_node_t **)malloc ( max * sizeof *skip->fix );
+  skip->fix = (jsw_node_t **)mem_alloc ( &skip->alloc, &skip->mem,
+                                         max * sizeof *skip->fix );
 
   if ( skip->fix == NULL ) {
-    delete_node ( skip->head );
-    free ( skip );
+    delete_node ( skip, skip->head );
+    mem_free ( &a, &skip->mem, skip, sizeof *skip );
     return NULL;
   }
 
@@ -162,17 +179,18 @@ void jsw_sdelete ( jsw_skip_t *skip )
 {
   jsw_node_t *it = skip->head->next[0];
   jsw_node_t *save;
+  allocator a = skip->alloc;
 
   while ( it != NULL ) {
     save = it->next[0];
     skip->rel ( it->item );
-    delete_node ( it );
+    delete_node ( skip, it );
     it = save;
   }
 
-  delete_node ( skip->head );
-  free ( skip->fix );
-  free ( skip );
+  delete_node ( skip, skip->head );
+  mem_free ( &a, &skip->mem, skip->fix, skip->maxh * sizeof *skip->fix );
+  mem_free ( &a, &skip->mem, skip, sizeof *skip );
 }
 
 void *jsw_sfind ( jsw_skip_t *skip, void *item )
@@ -200,7 +218,7 @@ int jsw_sinsert ( jsw_skip_t *skip, void *item )
     if ( dup == NULL )
       return 0;
 
-    it = new_node ( dup, h );
+    it = new_node ( skip, dup, h );
 
     if ( it == NULL ) {
       skip->rel ( dup );
@@ -243,7 +261,7 @@ int jsw_serase ( jsw_skip_t *skip, void *item )
     }
 
     skip->rel ( p->item );
-    delete_node ( p );
+    delete_node ( skip, p );
 
     /* Lower height if necessary */
     while ( skip->curh > 0 ) {
@@ -267,6 +285,11 @@ size_t jsw_ssize ( jsw_skip_t *skip )
   return skip->size;
 }
 
+void jsw_smem ( jsw_skip_t *skip, memstat *mem )
+{
+  *mem = skip->mem;
+}
+
 void jsw_sreset ( jsw_skip_t *skip )
 {
   skip->curl = skip->head->next[0];
@@ -15,6 +15,8 @@
   anyone who has modified the code through
   a header comment, such as this one.
 */
+#include "alloc.h"
+
 #ifdef __cplusplus
 #include <cstddef>
 
@@ -43,6 +45,15 @@ typedef void  (*rel_f) ( void *item );
 */
 jsw_skip_t *jsw_snew ( size_t max, cmp_f cmp, dup_f dup, rel_f rel );
 
+/*
+  Same as jsw_snew, with the list and node memory taken
+  from alloc, or from malloc if alloc is NULL
+
+  Returns: An empty skip list, or NULL on failure
+*/
+jsw_skip_t *jsw_snew_alloc ( size_t max, cmp_f cmp, dup_f dup, rel_f rel,
+                             const allocator *alloc );
+
 /* Release all memory used by the skip list */
 void        jsw_sdelete ( jsw_skip_t *skip );
 
@@ -70,6 +81,12 @@ int         jsw_serase ( jsw_skip_t *skip, void *item );
 /* Current number of items at height 0 */
 size_t      jsw_ssize ( jsw_skip_t *skip );
 
+/*
+  Live bytes and blocks the list holds of its allocator,
+  the items made by dup are not counted
+*/
+void        jsw_smem ( jsw_skip_t *skip, memstat *mem );
+
 /* Reset the traversal markers to the beginning */
 void        jsw_sreset ( jsw_skip_t *skip );
 
@@ -0,0 +1,52 @@
+// @Name   : jsw_slib_test.c
+//
+// @Brief  :
+
+#include "jsw_slib.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define N 100000
+
+static int   id_cmp(const void* a, const void* b)
+{
+    return (uintptr_t)a < (uintptr_t)b ? -1 : (uintptr_t)a > (uintptr_t)b;
+}
+static void* id_dup(const void* item) { return (void*)item; }
+static void  id_rel(void* item) { (void)item; }
+
+/* half the columns are one high, a quarter two and so on, so the
+   mean height is 2. a node is three words and its column of links,
+   which the memory the list reports gives away */
+static void test_heights()
+{
+    jsw_skip_t* skip = jsw_snew(24, id_cmp, id_dup, id_rel);
+    memstat empty, mem;
+    double height;
+    uintptr_t k;
+    assert(skip);
+    jsw_smem(skip, &empty);
+    for(k=1; k<=N; k++)
+        assert(jsw_sinsert(skip, (void*)k));
+    assert(jsw_ssize(skip) == N);
+    jsw_smem(skip, &mem);
+    assert(mem.blocks == empty.blocks + 2 * N);
+    height = (double)(mem.bytes - empty.bytes) / N / sizeof(void*) - 3;
+    assert(height > 1.9 && height < 2.1);
+
+    for(k=1; k<=N; k++)
+        assert(jsw_sfind(skip, (void*)k) == (void*)k);
+    assert(jsw_sfind(skip, (void*)(uintptr_t)(N + 1)) == NULL);
+    for(k=1; k<=N; k += 2)
+        assert(jsw_serase(skip, (void*)k));
+    assert(jsw_ssize(skip) == N / 2 && jsw_sfind(skip, (void*)1) == NULL);
+    jsw_sdelete(skip);
+}
+
+int main()
+{
+    test_heights();
+    printf("jsw_slib test ok\n");
+    return 0;
+}
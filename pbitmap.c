@@ -0,0 +1,295 @@
+
+// @Name   : pbitmap.c
+//
+// @Brief  : paged bitmap over the u64 range
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "pbitmap.h"
+
+#define PAGE_BITS   (1u << PB_PAGE_SHIFT)
+#define FAN         PB_NODE_FAN
+#define MTST(m, i)  ((m)[(i) / 64] >> ((i) % 64) & 1)
+#define MSET(m, i)  ((m)[(i) / 64] |= 1ULL << ((i) % 64))
+#define MCLR(m, i)  ((m)[(i) / 64] &= ~(1ULL << ((i) % 64)))
+
+/* shift of the child slot in a node at level l, pages below level 1 */
+#define SHIFT(l)    (PB_PAGE_SHIFT + PB_NODE_SHIFT * ((l) - 1))
+#define SLOT(v, l)  ((u32)((v) >> SHIFT(l)) & (FAN - 1))
+
+static inline int
+covers(u32 height, u64 val)
+{
+    return height >= PB_MAX_HEIGHT || (val >> SHIFT(height + 1)) == 0;
+}
+
+/* first slot from on whose mask bit equals want, FAN if none */
+static inline u32
+mask_next(const u64* m, u32 from, int want)
+{
+    u32 w;
+    for(w = from / 64; w < FAN / 64; w++) {
+        u64 x = want ? m[w] : ~m[w];
+        if(w == from / 64)
+            x &= ~0ULL << (from % 64);
+        if(x)
+            return w * 64 + __builtin_ctzll(x);
+    }
+    return FAN;
+}
+
+static inline int
+node_full(const pb_node* n)
+{
+    u32 w;
+    for(w = 0; w < FAN / 64; w++)
+        if(~n->full[w])
+            return 0;
+    return 1;
+}
+
+static pb_node*
+node_new(pbitmap* pb)
+{
+    pb_node* n = (pb_node*)calloc(1, sizeof(pb_node));
+    assert(n);
+    pb->nnode++;
+    return n;
+}
+
+static pb_page*
+page_new(pbitmap* pb)
+{
+    pb_page* p = (pb_page*)calloc(1, sizeof(pb_page));
+    assert(p);
+    pb->npage++;
+    return p;
+}
+
+static void
+node_free(pb_node* n, u32 level)
+{
+    u32 s;
+    for(s = 0; s < FAN; s++) {
+        if(n->child[s] == NULL)
+            continue;
+        if(level == 1)
+            free(n->child[s]);
+        else
+            node_free((pb_node*)n->child[s], level - 1);
+    }
+    free(n);
+}
+
+pbitmap* pbitmap_new()
+{
+    pbitmap* pb = (pbitmap*)malloc(sizeof(pbitmap));
+    if(pb == NULL)
+        return NULL;
+    memset(pb, 0, sizeof(pbitmap));
+    return pb;
+}
+
+void pbitmap_del(pbitmap* pb)
+{
+    if(pb == NULL)
+        return;
+    if(pb->root)
+        node_free(pb->root, pb->height);
+    free(pb);
+}
+
+/* page holding val, its nodes and slots from level 1 up in path/slot,
+   NULL if it is not there and create is off */
+static pb_page*
+page_of(pbitmap* pb, u64 val, int create, pb_node** path, u32* slot)
+{
+    pb_node* n = pb->root;
+    u32 l, s;
+    for(l = pb->height; l >= 1; l--) {
+        s = SLOT(val, l);
+        path[l - 1] = n;
+        slot[l - 1] = s;
+        if(n->child[s] == NULL) {
+            if(!create)
+                return NULL;
+            n->child[s] = l == 1 ? (void*)page_new(pb) : (void*)node_new(pb);
+            MSET(n->used, s);
+            n->nchild++;
+        }
+        if(l > 1)
+            n = (pb_node*)n->child[s];
+    }
+    return (pb_page*)path[0]->child[slot[0]];
+}
+
+void pbitmap_set(pbitmap* pb, u64 val)
+{
+    pb_node* path[PB_MAX_HEIGHT];
+    u32 slot[PB_MAX_HEIGHT], l;
+
+    if(pb->root == NULL) {
+        pb->root = node_new(pb);
+        pb->height = 1;
+    }
+    /* grow upwards, the old root becomes child 0 */
+    while(!covers(pb->height, val)) {
+        pb_node* n = node_new(pb);
+        n->child[0] = pb->root;
+        n->nchild = 1;
+        MSET(n->used, 0);
+        if(node_full(pb->root))
+            MSET(n->full, 0);
+        pb->root = n;
+        pb->height++;
+    }
+
+    pb_page* p = page_of(pb, val, 1, path, slot);
+    u32 bit = (u32)(val % PAGE_BITS);
+    if(MTST(p->bits, bit))
+        return;
+    MSET(p->bits, bit);
+    p->ones++;
+    pb->ones++;
+    if(p->ones < PAGE_BITS)
+        return;
+    for(l = 0; l < pb->height; l++) {
+        MSET(path[l]->full, slot[l]);
+        if(!node_full(path[l]))
+            break;
+    }
+}
+
+void pbitmap_clr(pbitmap* pb, u64 val)
+{
+    pb_node* path[PB_MAX_HEIGHT];
+    u32 slot[PB_MAX_HEIGHT], l;
+
+    if(pb->root == NULL || !covers(pb->height, val))
+        return;
+    pb_page* p = page_of(pb, val, 0, path, slot);
+    u32 bit = (u32)(val % PAGE_BITS);
+    if(p == NULL || !MTST(p->bits, bit))
+        return;
+
+    if(p->ones == PAGE_BITS) {
+        for(l = 0; l < pb->height; l++) {
+            int was = node_full(path[l]);
+            MCLR(path[l]->full, slot[l]);
+            if(!was)
+                break;
+        }
+    }
+    MCLR(p->bits, bit);
+    p->ones--;
+    pb->ones--;
+    if(p->ones)
+        return;
+
+    /* drop the page and every node it leaves empty */
+    free(p);
+    pb->npage--;
+    for(l = 0; l < pb->height; l++) {
+        pb_node* n = path[l];
+        n->child[slot[l]] = NULL;
+        MCLR(n->used, slot[l]);
+        if(--n->nchild)
+            return;
+        free(n);
+        pb->nnode--;
+    }
+    pb->root = NULL;
+    pb->height = 0;
+}
+
+int pbitmap_tst(pbitmap* pb, u64 val)
+{
+    pb_node* path[PB_MAX_HEIGHT];
+    u32 slot[PB_MAX_HEIGHT];
+    if(pb->root == NULL || !covers(pb->height, val))
+        return 0;
+    pb_page* p = page_of(pb, val, 0, path, slot);
+    return p != NULL && MTST(p->bits, (u32)(val % PAGE_BITS));
+}
+
+static u64
+page_find(const pb_page* p, u64 from, int one)
+{
+    u32 off = (u32)(from % PAGE_BITS), w;
+    for(w = off / 64; w < PB_PAGE_WORDS; w++) {
+        u64 x = one ? p->bits[w] : ~p->bits[w];
+        if(w == off / 64)
+            x &= ~0ULL << (off % 64);
+        if(x)
+            return from - off + w * 64 + __builtin_ctzll(x);
+    }
+    return PBITMAP_NONE;
+}
+
+/* first one (zero) at or after from inside node n at level l,
+   children that are missing (full) are skipped by their mask */
+static u64
+node_find(const pb_node* n, u32 l, u64 from, int one)
+{
+    u32 sh = SHIFT(l);
+    u32 lim = sh + PB_NODE_SHIFT > 64 ? 1u << (64 - sh) : FAN;
+    u64 base = sh + PB_NODE_SHIFT >= 64 ? 0 :
+        from & ~((1ULL << (sh + PB_NODE_SHIFT)) - 1);
+    u32 s = (u32)(from >> sh) & (FAN - 1);
+
+    for(;; s++) {
+        s = one ? mask_next(n->used, s, 1) : mask_next(n->full, s, 0);
+        if(s >= lim)
+            return PBITMAP_NONE;
+        u64 start = base | (u64)s << sh;
+        if(start < from)
+            start = from;
+        const void* c = n->child[s];
+        if(c == NULL)
+            return start;           /* missing child, all zeros */
+        u64 r = l == 1 ? page_find((const pb_page*)c, start, one) :
+            node_find((const pb_node*)c, l - 1, start, one);
+        if(r != PBITMAP_NONE)
+            return r;
+    }
+}
+
+u64 pbitmap_next1(pbitmap* pb, u64 from)
+{
+    if(pb->root == NULL || !covers(pb->height, from))
+        return PBITMAP_NONE;
+    return node_find(pb->root, pb->height, from, 1);
+}
+
+u64 pbitmap_next0(pbitmap* pb, u64 from)
+{
+    if(pb->root == NULL || !covers(pb->height, from))
+        return from;
+    u64 r = node_find(pb->root, pb->height, from, 0);
+    /* past the tree everything is zero */
+    if(r == PBITMAP_NONE && pb->height < PB_MAX_HEIGHT)
+        r = 1ULL << SHIFT(pb->height + 1);
+    return r;
+}
+
+u64 pbitmap_first1(pbitmap* pb)
+{
+    return pbitmap_next1(pb, 0);
+}
+
+u64 pbitmap_first0(pbitmap* pb)
+{
+    return pbitmap_next0(pb, 0);
+}
+
+u64 pbitmap_count(pbitmap* pb)
+{
+    return pb->ones;
+}
+
+size_t pbitmap_bytes(pbitmap* pb)
+{
+    return sizeof(pbitmap) + pb->npage * sizeof(pb_page) +
+        pb->nnode * sizeof(pb_node);
+}
@@ -0,0 +1,64 @@
+
+// @Name   : PBITMAP_H
+//
+// @Brief  : paged bitmap over the whole u64 range. bits live in 4KB
+//           pages allocated on the first set and freed when they
+//           drop back to zero. pages hang off a radix tree of
+//           512-way nodes that grows upwards as larger indices
+//           show up, so small ids pay for one level only and the
+//           full u64 range needs six.
+
+#if !defined(PBITMAP_H)
+#define PBITMAP_H
+
+#include <stddef.h>
+
+typedef unsigned int u32;
+typedef unsigned long long u64;
+
+#define PB_PAGE_SHIFT  15                       /* bits per page */
+#define PB_PAGE_WORDS  ((1 << PB_PAGE_SHIFT) / 64)
+#define PB_NODE_SHIFT  9                        /* children per node */
+#define PB_NODE_FAN    (1 << PB_NODE_SHIFT)
+#define PB_MAX_HEIGHT  6                        /* 15 + 6*9 >= 64 */
+#define PBITMAP_NONE   ((u64)-1)
+
+typedef struct _pb_page{
+    u32 ones;                       /* set bits, freed at zero */
+    u64 bits[PB_PAGE_WORDS];
+}pb_page;
+
+/* used marks present children, full marks children without a
+   zero bit; a missing child is all zeros */
+typedef struct _pb_node{
+    u32 nchild;
+    u64 used[PB_NODE_FAN / 64];
+    u64 full[PB_NODE_FAN / 64];
+    void* child[PB_NODE_FAN];       /* pb_node, pages at height 1 */
+}pb_node;
+
+typedef struct _pbitmap{
+    pb_node* root;
+    u32 height;                     /* node levels above the pages */
+    u64 ones;
+    u64 npage;
+    u64 nnode;
+}pbitmap;
+
+pbitmap* pbitmap_new();
+void     pbitmap_del(pbitmap* pb);
+void     pbitmap_set(pbitmap* pb, u64 val);
+void     pbitmap_clr(pbitmap* pb, u64 val);
+int      pbitmap_tst(pbitmap* pb, u64 val);
+
+/* first bit at or after from, PBITMAP_NONE if there is none */
+u64      pbitmap_next1(pbitmap* pb, u64 from);
+u64      pbitmap_next0(pbitmap* pb, u64 from);
+u64      pbitmap_first1(pbitmap* pb);
+u64      pbitmap_first0(pbitmap* pb);
+
+u64      pbitmap_count(pbitmap* pb);
+/* heap bytes held by the bitmap */
+size_t   pbitmap_bytes(pbitmap* pb);
+
+#endif
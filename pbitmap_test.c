@@ -0,0 +1,102 @@
+// @Name   : pbitmap_test.c
+//
+// @Brief  :
+
+#include "pbitmap.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NVAL 20000
+#define PAGE ((u64)1 << PB_PAGE_SHIFT)
+
+static u64 vals[NVAL];
+
+static int cmp(const void* a, const void* b)
+{
+    u64 x = *(const u64*)a, y = *(const u64*)b;
+    return x < y ? -1 : x > y;
+}
+
+static u64 rand64()
+{
+    return (u64)rand() << 62 ^ (u64)rand() << 31 ^ (u64)rand();
+}
+
+/* values clustered in a few regions of the u64 space */
+static u64 pick(int k)
+{
+    static const u64 region[] = {0, 1ULL << 32, 1ULL << 47, 1ULL << 63,
+                                 ~0ULL - 100000};
+    u64 r = region[k % 5];
+    return r + (rand64() % 100000);
+}
+
+int main()
+{
+    pbitmap* pb = pbitmap_new();
+    u64 v;
+    u32 k, n;
+    assert(pb);
+
+    assert(pbitmap_first1(pb) == PBITMAP_NONE);
+    assert(pbitmap_first0(pb) == 0);
+    assert(!pbitmap_tst(pb, 12345));
+    pbitmap_clr(pb, 12345);
+    assert(pbitmap_bytes(pb) == sizeof(pbitmap));
+
+    pbitmap_set(pb, 5);
+    pbitmap_set(pb, ~0ULL - 1);
+    assert(pb->height == PB_MAX_HEIGHT);
+    assert(pbitmap_tst(pb, 5) && pbitmap_tst(pb, ~0ULL - 1));
+    assert(pbitmap_next1(pb, 6) == ~0ULL - 1);
+    assert(pbitmap_next0(pb, 5) == 6);
+    assert(pbitmap_count(pb) == 2 && pb->npage == 2);
+    pbitmap_clr(pb, ~0ULL - 1);
+    pbitmap_clr(pb, 5);
+    assert(pb->npage == 0 && pb->nnode == 0 && pb->root == NULL);
+
+    /* random values against a sorted copy */
+    srand(1);
+    for(k=0; k<NVAL; k++) {
+        vals[k] = pick(k);
+        pbitmap_set(pb, vals[k]);
+    }
+    qsort(vals, NVAL, sizeof(u64), cmp);
+    for(k=1, n=1; k<NVAL; k++)
+        if(vals[k] != vals[n-1])
+            vals[n++] = vals[k];
+    assert(pbitmap_count(pb) == n);
+    for(k=0; k<n; k++) {
+        assert(pbitmap_tst(pb, vals[k]));
+        assert(pbitmap_next1(pb, k ? vals[k-1] + 1 : 0) == vals[k]);
+        if(k + 1 < n && vals[k+1] != vals[k] + 1)
+            assert(pbitmap_next0(pb, vals[k]) == vals[k] + 1);
+    }
+    assert(pbitmap_next1(pb, vals[n-1] + 1) == PBITMAP_NONE);
+    for(k=0; k<n; k++)
+        pbitmap_clr(pb, vals[k]);
+    assert(pbitmap_count(pb) == 0 && pb->npage == 0 && pb->nnode == 0);
+
+    /* full pages, and a full node of pages, are skipped by next0 */
+    for(v=0; v<3*PAGE; v++)
+        pbitmap_set(pb, 7*PAGE + v);
+    assert(pb->npage == 3);
+    assert(pbitmap_next0(pb, 7*PAGE) == 10*PAGE);
+    pbitmap_clr(pb, 8*PAGE + 9);
+    assert(pbitmap_next0(pb, 7*PAGE) == 8*PAGE + 9);
+    pbitmap_set(pb, 8*PAGE + 9);
+    for(v=0; v<PB_NODE_FAN*PAGE; v++)
+        pbitmap_set(pb, v);
+    assert(pb->height == 1 && pbitmap_first0(pb) == PB_NODE_FAN*PAGE);
+    pbitmap_set(pb, PB_NODE_FAN*PAGE);
+    assert(pb->height == 2 && pbitmap_first0(pb) == PB_NODE_FAN*PAGE + 1);
+    pbitmap_clr(pb, 123456);
+    assert(pbitmap_first0(pb) == 123456);
+    assert(pbitmap_next0(pb, 123457) == PB_NODE_FAN*PAGE + 1);
+    assert(pbitmap_next1(pb, PB_NODE_FAN*PAGE + 1) == PBITMAP_NONE);
+    pbitmap_del(pb);
+
+    printf("pbitmap test ok\n");
+    return 0;
+}
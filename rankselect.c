@@ -0,0 +1,172 @@
+
+// @Name   : rankselect.c
+//
+// @Brief  : rank/select index over a bitmap
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "rankselect.h"
+
+#define WORD_BITS    64
+#define BLOCK_WORDS  (RS_BLOCK_BITS / WORD_BITS)
+#define SUPER_WORDS  (RS_SUPER_BITS / WORD_BITS)
+#define SUPER_BLOCKS (RS_SUPER_BITS / RS_BLOCK_BITS)
+
+static inline u32 popcnt(u64 x) { return __builtin_popcountll(x); }
+
+/* position of the set bit with rank k inside w, w has more than
+   k set bits: skip whole bytes, then drop low bits */
+static inline u32
+word_select(u64 w, u32 k)
+{
+    u32 shift = 0, c;
+    while(k >= (c = popcnt((w >> shift) & 0xFF))) {
+        k -= c;
+        shift += 8;
+    }
+    w >>= shift;
+    while(k--)
+        w &= w - 1;
+    return shift + __builtin_ctzll(w);
+}
+
+rankselect* rs_new(bitmap* bm)
+{
+    assert(bm);
+    rankselect* rs = (rankselect*)malloc(sizeof(rankselect));
+    if(rs == NULL)
+        return NULL;
+    rs->bm     = bm;
+    rs->built  = 0;
+    rs->ones   = 0;
+    rs->nsuper = (bm->cnt + SUPER_WORDS - 1) / SUPER_WORDS;
+    rs->nblock = (bm->cnt + BLOCK_WORDS - 1) / BLOCK_WORDS;
+    rs->nsample = 0;
+    rs->super  = (u32*)malloc(sizeof(u32) * rs->nsuper);
+    rs->block  = (unsigned short*)malloc(sizeof(unsigned short) * rs->nblock);
+    rs->sample = NULL;
+    if(rs->super == NULL || rs->block == NULL) {
+        rs_del(rs);
+        return NULL;
+    }
+    return rs;
+}
+
+void rs_del(rankselect* rs)
+{
+    if(rs == NULL)
+        return;
+    free(rs->super);
+    free(rs->block);
+    free(rs->sample);
+    free(rs);
+}
+
+void rs_build(rankselect* rs)
+{
+    const u64* t = rs->bm->table;
+    u32 cnt = rs->bm->cnt;
+    u32 b, w, total = 0, inside = 0, next = 0;
+
+    /* one sample per RS_SAMPLE ones, at most */
+    free(rs->sample);
+    rs->sample = NULL;
+    rs->nsample = 0;
+
+    for(b = 0; b < rs->nblock; b++) {
+        if(b % SUPER_BLOCKS == 0) {
+            rs->super[b / SUPER_BLOCKS] = total;
+            inside = 0;
+        }
+        rs->block[b] = (unsigned short)inside;
+        u32 c = 0, end = (b + 1) * BLOCK_WORDS;
+        for(w = b * BLOCK_WORDS; w < end && w < cnt; w++)
+            c += popcnt(t[w]);
+        inside += c;
+        total += c;
+    }
+    rs->ones = total;
+
+    rs->nsample = (total + RS_SAMPLE - 1) / RS_SAMPLE;
+    if(rs->nsample) {
+        u32 s;
+        rs->sample = (u32*)malloc(sizeof(u32) * rs->nsample);
+        assert(rs->sample);
+        for(s = 0; s < rs->nsuper; s++) {
+            u32 end = s + 1 < rs->nsuper ? rs->super[s + 1] : total;
+            /* every sampled one below end lives in superblock s */
+            while(next < rs->nsample && (u64)next * RS_SAMPLE < end)
+                rs->sample[next++] = s;
+        }
+    }
+    rs->version = rs->bm->version;
+    rs->built = 1;
+}
+
+static inline void
+rs_fresh(rankselect* rs)
+{
+    if(!rs->built || rs->version != rs->bm->version)
+        rs_build(rs);
+}
+
+u32 rs_rank(rankselect* rs, u32 i)
+{
+    assert(rs && i <= rs->bm->size && "rank out of range");
+    rs_fresh(rs);
+    if(i == rs->bm->size)
+        return rs->ones;
+
+    const u64* t = rs->bm->table;
+    u32 w = i / WORD_BITS, b = i / RS_BLOCK_BITS, j;
+    u32 r = rs->super[i / RS_SUPER_BITS] + rs->block[b];
+    for(j = b * BLOCK_WORDS; j < w; j++)
+        r += popcnt(t[j]);
+    if(i % WORD_BITS)
+        r += popcnt(t[w] & ((1ULL << (i % WORD_BITS)) - 1));
+    return r;
+}
+
+u32 rs_select(rankselect* rs, u32 k)
+{
+    assert(rs);
+    rs_fresh(rs);
+    if(k >= rs->ones)
+        return -1;
+
+    /* last superblock starting at or before one number k,
+       between the samples around k */
+    u32 lo = rs->sample[k / RS_SAMPLE];
+    u32 hi = k / RS_SAMPLE + 1 < rs->nsample ?
+        rs->sample[k / RS_SAMPLE + 1] : rs->nsuper - 1;
+    while(lo < hi) {
+        u32 mid = lo + (hi - lo + 1) / 2;
+        if(rs->super[mid] <= k)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    k -= rs->super[lo];
+
+    u32 b = lo * SUPER_BLOCKS, end = b + SUPER_BLOCKS;
+    if(end > rs->nblock)
+        end = rs->nblock;
+    while(b + 1 < end && rs->block[b + 1] <= k)
+        b++;
+    k -= rs->block[b];
+
+    const u64* t = rs->bm->table;
+    u32 w = b * BLOCK_WORDS, c;
+    while(k >= (c = popcnt(t[w]))) {
+        k -= c;
+        w++;
+    }
+    return w * WORD_BITS + word_select(t[w], k);
+}
+
+size_t rs_bytes(rankselect* rs)
+{
+    return sizeof(rankselect) + sizeof(u32) * rs->nsuper +
+        sizeof(unsigned short) * rs->nblock + sizeof(u32) * rs->nsample;
+}
@@ -0,0 +1,45 @@
+
+// @Name   : RANKSELECT_H
+//
+// @Brief  : rank/select index over a bitmap. ones are counted per
+//           4096-bit superblock (u32) and per 512-bit block inside
+//           it (u16), about 3.9% of the bitmap, plus one sampled
+//           superblock per 8192 ones for select. the index follows
+//           bm->version and is rebuilt on the first query after
+//           the bitmap changed.
+
+#if !defined(RANKSELECT_H)
+#define RANKSELECT_H
+
+#include "bitmap.h"
+
+#define RS_SUPER_BITS  4096
+#define RS_BLOCK_BITS  512
+#define RS_SAMPLE      8192
+
+typedef struct _rankselect{
+    bitmap* bm;
+    u32 version;        /* bm->version the counts are for */
+    int built;
+    u32 ones;           /* set bits in bm */
+    u32 nsuper;
+    u32 nblock;
+    u32 nsample;
+    u32* super;         /* ones before each superblock */
+    unsigned short* block; /* ones before each block, in its superblock */
+    u32* sample;        /* superblock holding one number k*RS_SAMPLE */
+}rankselect;
+
+rankselect* rs_new(bitmap* bm);
+void        rs_del(rankselect* rs);
+
+/* number of set bits in [0, i), i <= bm->size */
+u32         rs_rank(rankselect* rs, u32 i);
+/* position of the set bit with rank k, -1 if there are not
+   more than k set bits */
+u32         rs_select(rankselect* rs, u32 k);
+/* rebuild now instead of at the next query */
+void        rs_build(rankselect* rs);
+size_t      rs_bytes(rankselect* rs);
+
+#endif
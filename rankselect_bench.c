@@ -0,0 +1,105 @@
+
+// @Name   : rankselect_bench.c
+//
+// @Brief  : rank/select through the index against a popcount walk
+//           over bm->table, at 10% and 50% density.
+//           build with: make CFLAGS="-O2 -mpopcnt" rankselect_bench
+
+#include "rankselect.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NBITS  (1u << 26)
+#define NQUERY 2000000
+#define NWALK  200
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static u32 rnd()
+{
+    return ((u32)rand() << 16) ^ (u32)rand();
+}
+
+/* what callers did without the index */
+static u32 walk_rank(bitmap* bm, u32 i)
+{
+    u32 w, r = 0;
+    for(w = 0; w < i / 64; w++)
+        r += __builtin_popcountll(bm->table[w]);
+    if(i % 64)
+        r += __builtin_popcountll(bm->table[w] & ((1ULL << (i % 64)) - 1));
+    return r;
+}
+
+static u32 walk_select(bitmap* bm, u32 k)
+{
+    u32 w = 0, c;
+    while(k >= (c = __builtin_popcountll(bm->table[w]))) {
+        k -= c;
+        w++;
+    }
+    u64 x = bm->table[w];
+    while(k--)
+        x &= x - 1;
+    return w * 64 + __builtin_ctzll(x);
+}
+
+static volatile u32 sink;
+
+static void bench(int percent)
+{
+    bitmap* bm = bitmap_new(NBITS);
+    rankselect* rs;
+    double t, walk_r, walk_s, idx_r, idx_s, build;
+    u32 k;
+    assert(bm);
+    for(k = 0; k < NBITS; k++)
+        if(rnd() % 100 < (u32)percent)
+            bitmap_set(bm, k);
+    rs = rs_new(bm);
+    assert(rs);
+
+    t = now_sec();
+    rs_build(rs);
+    build = now_sec() - t;
+
+    t = now_sec();
+    for(k = 0; k < NWALK; k++)
+        sink = walk_rank(bm, rnd() % NBITS);
+    walk_r = (now_sec() - t) / NWALK * 1e9;
+    t = now_sec();
+    for(k = 0; k < NWALK; k++)
+        sink = walk_select(bm, rnd() % rs->ones);
+    walk_s = (now_sec() - t) / NWALK * 1e9;
+
+    t = now_sec();
+    for(k = 0; k < NQUERY; k++)
+        sink = rs_rank(rs, rnd() % NBITS);
+    idx_r = (now_sec() - t) / NQUERY * 1e9;
+    t = now_sec();
+    for(k = 0; k < NQUERY; k++)
+        sink = rs_select(rs, rnd() % rs->ones);
+    idx_s = (now_sec() - t) / NQUERY * 1e9;
+
+    printf("%3d%% %10.1f %10.1f %10.1f %10.1f %10.2f %9.2f%%\n", percent,
+           walk_r, idx_r, walk_s, idx_s, build * 1e3,
+           100.0 * rs_bytes(rs) / (NBITS / 8));
+    rs_del(rs);
+    bitmap_del(bm);
+}
+
+int main()
+{
+    printf("%4s %10s %10s %10s %10s %10s %10s\n", "fill", "walk rank",
+           "rank ns", "walk sel", "select ns", "build ms", "space");
+    bench(10);
+    bench(50);
+    return 0;
+}
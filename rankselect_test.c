@@ -0,0 +1,66 @@
+
+// @Name   : rankselect_test.c
+//
+// @Brief  :
+
+#include "rankselect.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SIZE 3000017
+
+/* every rank and select answer agrees with a counting walk */
+static void check(rankselect* rs, bitmap* bm)
+{
+    u32 k, r = 0;
+    for(k=0; k<SIZE; k++) {
+        if(k % 97 == 0)
+            assert(rs_rank(rs, k) == r);
+        if(bitmap_tst(bm, k)) {
+            assert(rs_select(rs, r) == k);
+            r++;
+        }
+    }
+    assert(rs_rank(rs, SIZE) == r);
+    assert(rs_select(rs, r) == -1);
+}
+
+int main()
+{
+    bitmap* bm = bitmap_new(SIZE);
+    rankselect* rs = rs_new(bm);
+    u32 k;
+    assert(bm && rs);
+
+    assert(rs_rank(rs, 0) == 0);
+    assert(rs_rank(rs, SIZE) == 0);
+    assert(rs_select(rs, 0) == -1);
+
+    bitmap_set(bm, 0);
+    bitmap_set(bm, 700);
+    bitmap_set(bm, SIZE - 1);
+    assert(rs_rank(rs, 1) == 1);
+    assert(rs_rank(rs, 700) == 1);
+    assert(rs_rank(rs, 701) == 2);
+    assert(rs_select(rs, 1) == 700);
+    assert(rs_select(rs, 2) == SIZE - 1);
+
+    /* sparse with long empty stretches, then dense */
+    srand(1);
+    for(k=0; k<20000; k++)
+        bitmap_set(bm, rand() % (SIZE / 3));
+    check(rs, bm);
+    bitmap_set_range(bm, SIZE / 2, SIZE / 2 + 400000);
+    for(k=0; k<200000; k++)
+        bitmap_set(bm, SIZE / 2 + 400000 + rand() % 300000);
+    check(rs, bm);
+    for(k=0; k<SIZE; k+=3)
+        bitmap_clr(bm, k);
+    check(rs, bm);
+
+    assert(rs_bytes(rs) < SIZE / 8 / 20);
+    rs_del(rs);
+    bitmap_del(bm);
+    return 0;
+}
@@ -0,0 +1,318 @@
+
+// @Name   : rcumap.c
+//
+// @Brief  : read-mostly hashmap with QSBR reclamation
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rcumap.h"
+
+#define RCU_MIN_BUCKETS 16
+
+enum { GARBAGE_NODE, GARBAGE_VAL, GARBAGE_TABLE };
+
+#define LOAD(p)      __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)  __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+static rcu_table*
+table_new(u32 nbucket)
+{
+    rcu_table* t = (rcu_table*)calloc(1, sizeof(rcu_table) +
+                                      sizeof(rcu_node*) * nbucket);
+    if(t)
+        t->nbucket = nbucket;
+    return t;
+}
+
+/* the nodes and the table, not the keys and values they point to */
+static void
+table_free(rcu_table* t)
+{
+    u32 b;
+    for(b = 0; b < t->nbucket; b++) {
+        while(t->buckets[b]) {
+            rcu_node* node = t->buckets[b];
+            t->buckets[b] = node->next;
+            free(node);
+        }
+    }
+    free(t);
+}
+
+static inline u32
+bucket_of(const rcu_table* t, u32 code)
+{
+    return code & (t->nbucket - 1);
+}
+
+static void
+garbage_free(rcumap* rcu, rcu_garbage* g)
+{
+    rcu_node* node = (rcu_node*)g->ptr;
+    switch(g->kind) {
+    case GARBAGE_NODE:
+        rcu->keyrel(node->key);
+        rcu->valrel(node->val);
+        free(node);
+        break;
+    case GARBAGE_VAL:
+        rcu->valrel(node->val);
+        free(node);
+        break;
+    case GARBAGE_TABLE:
+        table_free((rcu_table*)g->ptr);
+        break;
+    }
+    free(g);
+}
+
+/* called with the lock held, after ptr was unlinked */
+static void
+retire(rcumap* rcu, int kind, void* ptr)
+{
+    rcu_garbage* g = (rcu_garbage*)malloc(sizeof(rcu_garbage));
+    assert(g);
+    g->kind  = kind;
+    g->ptr   = ptr;
+    g->epoch = rcu->epoch;
+    g->next  = rcu->garbage;
+    rcu->garbage = g;
+    STORE(rcu->epoch, rcu->epoch + 1);
+}
+
+/* called with the lock held */
+static void
+reclaim(rcumap* rcu)
+{
+    u64 oldest = ~0ULL, e;
+    int k;
+    rcu_garbage** link = &rcu->garbage;
+
+    /* order the epoch bump before reading the readers, a reader
+       coming online orders its slot store before its lookups */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for(k = 0; k < RCU_MAX_READERS; k++) {
+        e = LOAD(rcu->readers[k].epoch);
+        if(e && e < oldest)
+            oldest = e;
+    }
+    while(*link) {
+        rcu_garbage* g = *link;
+        if(g->epoch < oldest) {
+            *link = g->next;
+            garbage_free(rcu, g);
+        } else {
+            link = &g->next;
+        }
+    }
+}
+
+rcumap* rcumap_new(hash_f hash, cmp_f cmp,
+                   keydup_f keydup, valdup_f valdup,
+                   keyrel_f keyrel, valrel_f valrel)
+{
+    rcumap* rcu = (rcumap*)aligned_alloc(64, sizeof(rcumap));
+    if(rcu == NULL)
+        return NULL;
+    memset(rcu, 0, sizeof(rcumap));
+    rcu->table = table_new(RCU_MIN_BUCKETS);
+    if(rcu->table == NULL) {
+        free(rcu);
+        return NULL;
+    }
+    pthread_mutex_init(&rcu->lock, NULL);
+    rcu->epoch  = 1;
+    rcu->hash   = hash;
+    rcu->cmp    = cmp;
+    rcu->keydup = keydup;
+    rcu->valdup = valdup;
+    rcu->keyrel = keyrel;
+    rcu->valrel = valrel;
+    return rcu;
+}
+
+void rcumap_del(rcumap* rcu)
+{
+    u32 b;
+    int k;
+    if(rcu == NULL)
+        return;
+    for(k = 0; k < RCU_MAX_READERS; k++)
+        assert(!rcu->readers[k].used && "reader still registered");
+    rcumap_reclaim(rcu);
+    assert(rcu->garbage == NULL);
+
+    for(b = 0; b < rcu->table->nbucket; b++) {
+        rcu_node* node = rcu->table->buckets[b];
+        for(; node; node = node->next) {
+            rcu->keyrel(node->key);
+            rcu->valrel(node->val);
+        }
+    }
+    table_free(rcu->table);
+    pthread_mutex_destroy(&rcu->lock);
+    free(rcu);
+}
+
+/* copy every node into a table twice as big and publish it, readers
+   still in the old one see a consistent old view */
+static void
+grow(rcumap* rcu)
+{
+    rcu_table* old = rcu->table;
+    rcu_table* t = table_new(old->nbucket * 2);
+    u32 b;
+    if(t == NULL)
+        return;
+    for(b = 0; b < old->nbucket; b++) {
+        rcu_node* node;
+        for(node = old->buckets[b]; node; node = node->next) {
+            rcu_node* copy = (rcu_node*)malloc(sizeof(rcu_node));
+            assert(copy);
+            *copy = *node;
+            copy->next = t->buckets[bucket_of(t, node->code)];
+            t->buckets[bucket_of(t, node->code)] = copy;
+        }
+    }
+    STORE(rcu->table, t);
+    retire(rcu, GARBAGE_TABLE, old);
+}
+
+/* @ 0 : add failed
+   @ 1 : add success */
+int rcumap_insert(rcumap* rcu, void* key, void* val)
+{
+    u32 code = rcu->hash(key);
+    pthread_mutex_lock(&rcu->lock);
+    rcu_table* t = rcu->table;
+    rcu_node** link = &t->buckets[bucket_of(t, code)];
+    rcu_node* node = (rcu_node*)malloc(sizeof(rcu_node));
+    if(node == NULL) {
+        pthread_mutex_unlock(&rcu->lock);
+        return 0;
+    }
+
+    for(; *link; link = &(*link)->next) {
+        rcu_node* cur = *link;
+        if(cur->code == code && rcu->cmp(cur->key, key) == 0) {
+            /* a new node with the new value replaces the old one,
+               the key stays shared between them */
+            node->next = cur->next;
+            node->code = code;
+            node->key  = cur->key;
+            node->val  = rcu->valdup(val);
+            STORE(*link, node);
+            retire(rcu, GARBAGE_VAL, cur);
+            reclaim(rcu);
+            pthread_mutex_unlock(&rcu->lock);
+            return 1;
+        }
+    }
+
+    link = &t->buckets[bucket_of(t, code)];
+    node->next = *link;
+    node->code = code;
+    node->key  = rcu->keydup(key);
+    node->val  = rcu->valdup(val);
+    STORE(*link, node);
+    STORE(rcu->count, rcu->count + 1);
+    if(rcu->count > t->nbucket)
+        grow(rcu);
+    if(rcu->garbage)
+        reclaim(rcu);
+    pthread_mutex_unlock(&rcu->lock);
+    return 1;
+}
+
+/* @ 0 : key not found
+   @ 1 : erased */
+int rcumap_erase(rcumap* rcu, void* key)
+{
+    u32 code = rcu->hash(key);
+    pthread_mutex_lock(&rcu->lock);
+    rcu_table* t = rcu->table;
+    rcu_node** link = &t->buckets[bucket_of(t, code)];
+    for(; *link; link = &(*link)->next) {
+        rcu_node* cur = *link;
+        if(cur->code == code && rcu->cmp(cur->key, key) == 0) {
+            STORE(*link, cur->next);
+            retire(rcu, GARBAGE_NODE, cur);
+            STORE(rcu->count, rcu->count - 1);
+            reclaim(rcu);
+            pthread_mutex_unlock(&rcu->lock);
+            return 1;
+        }
+    }
+    pthread_mutex_unlock(&rcu->lock);
+    return 0;
+}
+
+u32 rcumap_count(rcumap* rcu)
+{
+    return LOAD(rcu->count);
+}
+
+void rcumap_reclaim(rcumap* rcu)
+{
+    pthread_mutex_lock(&rcu->lock);
+    reclaim(rcu);
+    pthread_mutex_unlock(&rcu->lock);
+}
+
+rcu_reader* rcumap_register(rcumap* rcu)
+{
+    rcu_reader* r = NULL;
+    int k;
+    pthread_mutex_lock(&rcu->lock);
+    for(k = 0; k < RCU_MAX_READERS; k++) {
+        if(!rcu->readers[k].used) {
+            r = &rcu->readers[k];
+            r->used = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rcu->lock);
+    if(r)
+        rcumap_online(rcu, r);
+    return r;
+}
+
+void rcumap_unregister(rcumap* rcu, rcu_reader* r)
+{
+    rcumap_offline(rcu, r);
+    pthread_mutex_lock(&rcu->lock);
+    r->used = 0;
+    pthread_mutex_unlock(&rcu->lock);
+}
+
+void* rcumap_find(rcumap* rcu, const void* key)
+{
+    u32 code = rcu->hash(key);
+    rcu_table* t = LOAD(rcu->table);
+    rcu_node* node = LOAD(t->buckets[bucket_of(t, code)]);
+    for(; node; node = LOAD(node->next))
+        if(node->code == code && rcu->cmp(node->key, key) == 0)
+            return node->val;
+    return NULL;
+}
+
+/* a release store, the lookups before it are done with their nodes */
+void rcumap_quiescent(rcumap* rcu, rcu_reader* r)
+{
+    STORE(r->epoch, LOAD(rcu->epoch));
+}
+
+void rcumap_offline(rcumap* rcu, rcu_reader* r)
+{
+    (void)rcu;
+    STORE(r->epoch, 0);
+}
+
+/* the slot must be visible before the first lookup reads the map,
+   a fence orders the store before those loads */
+void rcumap_online(rcumap* rcu, rcu_reader* r)
+{
+    STORE(r->epoch, LOAD(rcu->epoch));
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
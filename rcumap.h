@@ -0,0 +1,100 @@
+
+// @Name   : RCUMAP_H
+//
+// @Brief  : read-mostly hashmap. readers take no lock and do no
+//           atomic read-modify-write: they follow pointers with
+//           acquire loads and now and then announce a quiescent
+//           state with a plain store to their own cache line.
+//           writers are serialized by a mutex, publish every change
+//           with one release store and retire the nodes, values and
+//           tables they unlinked until every reader has been
+//           quiescent since (QSBR).
+
+#if !defined(RCUMAP_H)
+#define RCUMAP_H
+
+#include <pthread.h>
+#include "hashmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RCU_MAX_READERS 64
+
+typedef struct _rcu_node{
+    struct _rcu_node* next;
+    u32 code;
+    void* key;
+    void* val;
+}rcu_node;
+
+typedef struct {
+    u32 nbucket;            /* a power of two */
+    rcu_node* buckets[];
+}rcu_table;
+
+typedef struct _rcu_garbage{
+    struct _rcu_garbage* next;
+    u64 epoch;              /* freed once every reader is past it */
+    int kind;
+    void* ptr;
+}rcu_garbage;
+
+/* epoch of the last quiescent state, 0 while offline */
+typedef struct {
+    u64 epoch;
+    int used;
+}__attribute__((aligned(64))) rcu_reader;
+
+typedef struct {
+    rcu_table* table;
+    u32 count;
+    u64 epoch;              /* bumped by every retire */
+
+    pthread_mutex_t lock;   /* writers and reader registration */
+    rcu_garbage* garbage;
+    rcu_reader readers[RCU_MAX_READERS];
+
+    hash_f hash;
+    cmp_f  cmp;
+
+    keydup_f keydup;
+    valdup_f valdup;
+    keyrel_f keyrel;
+    valrel_f valrel;
+}rcumap;
+
+rcumap* rcumap_new(hash_f hash, cmp_f cmp,
+                   keydup_f keydup, valdup_f valdup,
+                   keyrel_f keyrel, valrel_f valrel);
+/* no reader may be registered */
+void rcumap_del(rcumap* rcu);
+
+/* writers, serialized inside */
+int  rcumap_insert(rcumap* rcu, void* key, void* val);
+int  rcumap_erase(rcumap* rcu, void* key);
+u32  rcumap_count(rcumap* rcu);
+/* free what no reader can still see, writers do it as they go */
+void rcumap_reclaim(rcumap* rcu);
+
+/* a reader thread registers once and starts online, NULL if all
+   RCU_MAX_READERS slots are taken */
+rcu_reader* rcumap_register(rcumap* rcu);
+void rcumap_unregister(rcumap* rcu, rcu_reader* r);
+
+/* lock-free lookup by a registered, online reader. the value stays
+   valid until that reader's next quiescent state */
+void* rcumap_find(rcumap* rcu, const void* key);
+
+/* the reader holds no pointer from rcumap_find any more */
+void rcumap_quiescent(rcumap* rcu, rcu_reader* r);
+/* around long stretches without lookups, so writers need not wait */
+void rcumap_offline(rcumap* rcu, rcu_reader* r);
+void rcumap_online(rcumap* rcu, rcu_reader* r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+// @Name   : rcumap_bench.c
+//
+// @Brief  : lookups from 1 to N reader threads with one writer doing
+//           an update every so often, rcumap against shardmap's
+//           per-shard rwlocks.
+//           build with: make CFLAGS=-O2 rcumap_bench
+//           usage: rcumap_bench [max threads] [writes per second]
+
+#include "rcumap.h"
+#include "shardmap.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NKEYS  (1u << 20)
+#define NOPS   4000000      /* per reader */
+
+static rcumap*   rcu;
+static shardmap* shmap;
+static int done;
+static int write_rate;
+
+static unsigned id_hash(const void* a)
+{
+    u32 key = (u32)(uintptr_t)a;
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static int   id_cmp(const void* a, const void* b) { return a != b; }
+static void* id_dup(const void* key) { return (void*)key; }
+static void  id_rel(const void* key) { (void)key; }
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* read_rcu(void* arg)
+{
+    u32 seed = (u32)(size_t)arg * 7919 + 1, k;
+    rcu_reader* r = rcumap_register(rcu);
+    assert(r);
+    for(k = 0; k < NOPS; k++) {
+        seed = seed * 1103515245 + 12345;
+        rcumap_find(rcu, (void*)(uintptr_t)((seed >> 4) % NKEYS + 1));
+        if((k & 63) == 63)
+            rcumap_quiescent(rcu, r);
+    }
+    rcumap_unregister(rcu, r);
+    return NULL;
+}
+
+static void* read_shard(void* arg)
+{
+    u32 seed = (u32)(size_t)arg * 7919 + 1, k;
+    for(k = 0; k < NOPS; k++) {
+        seed = seed * 1103515245 + 12345;
+        shmap_find(shmap, (void*)(uintptr_t)((seed >> 4) % NKEYS + 1),
+                   NULL, NULL);
+    }
+    return NULL;
+}
+
+/* updates existing keys at roughly write_rate per second */
+static void* write_rcu(void* arg)
+{
+    u32 seed = 12345;
+    struct timespec ts = {0, 1000000000L / write_rate};
+    (void)arg;
+    while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        seed = seed * 1103515245 + 12345;
+        void* key = (void*)(uintptr_t)((seed >> 4) % NKEYS + 1);
+        rcumap_insert(rcu, key, key);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+static void* write_shard(void* arg)
+{
+    u32 seed = 12345;
+    struct timespec ts = {0, 1000000000L / write_rate};
+    (void)arg;
+    while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        seed = seed * 1103515245 + 12345;
+        void* key = (void*)(uintptr_t)((seed >> 4) % NKEYS + 1);
+        shmap_insert(shmap, key, key);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+/* million lookups per second over all readers */
+static double run(void* (*reader)(void*), void* (*writer)(void*), int n)
+{
+    pthread_t th[256], w;
+    double t;
+    int i;
+    done = 0;
+    pthread_create(&w, NULL, writer, NULL);
+    t = now_sec();
+    for(i = 0; i < n; i++)
+        pthread_create(&th[i], NULL, reader, (void*)(size_t)i);
+    for(i = 0; i < n; i++)
+        pthread_join(th[i], NULL);
+    t = now_sec() - t;
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    pthread_join(w, NULL);
+    return (double)n * NOPS / t / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    int max = argc > 1 ? atoi(argv[1]) : 8, n;
+    u32 k;
+    write_rate = argc > 2 ? atoi(argv[2]) : 1000;
+    assert(max > 0 && max < RCU_MAX_READERS && write_rate > 1);
+
+    rcu = rcumap_new(&id_hash, &id_cmp, &id_dup, &id_dup,
+                     &id_rel, &id_rel);
+    shmap = shmap_new(64, &id_hash, &id_cmp, &id_dup, &id_dup,
+                      &id_rel, &id_rel);
+    assert(rcu && shmap);
+    for(k = 1; k <= NKEYS; k++) {
+        rcumap_insert(rcu, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+        shmap_insert(shmap, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+    }
+
+    printf("%u keys, about %d writes/s\n", NKEYS, write_rate);
+    printf("%-8s %16s %16s\n", "readers", "rwlock Mop/s", "rcu Mop/s");
+    for(n = 1; n <= max; n *= 2)
+        printf("%-8d %16.2f %16.2f\n", n, run(read_shard, write_shard, n),
+               run(read_rcu, write_rcu, n));
+    rcumap_del(rcu);
+    shmap_del(shmap);
+    return 0;
+}
@@ -0,0 +1,123 @@
+// @Name   : rcumap_test.c
+//
+// @Brief  :
+
+#include "rcumap.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NREADER 3
+#define NKEYS   20000
+
+static rcumap* rcu;
+static int done;
+static long seen[NREADER];
+
+static unsigned int_hash(const void* a)
+{
+    u32 key = (u32)(*(int*)a);
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static int int_cmp(const void* a, const void* b)
+{
+    return *(int*)a - *(int*)b;
+}
+
+static void* int_dup(const void* key)
+{
+    int* res = (int*)malloc(sizeof(int));
+    *res = *(int*)key;
+    return res;
+}
+
+static void int_rel(const void* key)
+{
+    free((int*)key);
+}
+
+/* values are key or -key, anything else was freed under us */
+static void* reader(void* arg)
+{
+    int no = (int)(size_t)arg;
+    u32 seed = no + 1, n = 0;
+    rcu_reader* r = rcumap_register(rcu);
+    assert(r);
+    while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        seed = seed * 1103515245 + 12345;
+        int key = (seed >> 8) % NKEYS + 1;
+        int* v = (int*)rcumap_find(rcu, &key);
+        if(v) {
+            assert(*v == key || *v == -key);
+            seen[no]++;
+        }
+        if(++n % 64 == 0)
+            rcumap_quiescent(rcu, r);
+        if(n % 100000 == 0) {
+            rcumap_offline(rcu, r);
+            rcumap_online(rcu, r);
+        }
+    }
+    rcumap_unregister(rcu, r);
+    return NULL;
+}
+
+int main()
+{
+    pthread_t th[NREADER];
+    int t, k, round;
+
+    rcu = rcumap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                     &int_rel, &int_rel);
+    assert(rcu);
+    k = 1;
+    assert(rcumap_find(rcu, &k) == NULL && !rcumap_erase(rcu, &k));
+
+    for(t=0; t<NREADER; t++)
+        pthread_create(&th[t], NULL, reader, (void*)(size_t)t);
+
+    /* the writer grows the table, flips values and erases under
+       the readers */
+    for(round=0; round<3; round++) {
+        for(k=1; k<=NKEYS; k++)
+            assert(rcumap_insert(rcu, &k, &k));
+        assert(rcumap_count(rcu) == NKEYS);
+        for(k=1; k<=NKEYS; k++) {
+            int v = -k;
+            assert(rcumap_insert(rcu, &k, &v));
+        }
+        for(k=1; k<=NKEYS; k+=2)
+            assert(rcumap_erase(rcu, &k));
+        assert(rcumap_count(rcu) == NKEYS/2);
+        for(k=2; k<=NKEYS; k+=2)
+            assert(rcumap_erase(rcu, &k));
+        assert(rcumap_count(rcu) == 0);
+    }
+    for(k=1; k<=NKEYS; k++)
+        assert(rcumap_insert(rcu, &k, &k));
+
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    for(t=0; t<NREADER; t++)
+        pthread_join(th[t], NULL);
+
+    /* with every reader gone the writer frees all it retired */
+    rcumap_reclaim(rcu);
+    assert(rcu->garbage == NULL);
+    for(k=1; k<=NKEYS; k++) {
+        rcu_reader* r = rcumap_register(rcu);
+        int* v = (int*)rcumap_find(rcu, &k);
+        assert(v && *v == k);
+        rcumap_unregister(rcu, r);
+    }
+    rcumap_del(rcu);
+    printf("rcumap test ok\n");
+    return 0;
+}
@@ -0,0 +1,797 @@
+
+// @Name   : roaring.c
+//
+// @Brief  : compressed bitmap with array, bitset and run chunks
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "roaring.h"
+
+#define HIGH(v)      ((u16)((v) >> 16))
+#define LOW(v)       ((u16)((v) & 0xFFFF))
+#define BITSET_WORDS (RB_CHUNK_BITS / 64)
+#define BITSET_BYTES (RB_CHUNK_BITS / 8)
+
+#define RUN_END(r)   ((u32)(r).start + (r).len)
+
+static inline u32 popcnt(u64 x) { return __builtin_popcountll(x); }
+
+/* ---------------------------- bitset words ---------------------------- */
+
+/* set bits [lo, hi] */
+static void
+bits_set_range(u64* w, u32 lo, u32 hi)
+{
+    u32 first = lo / 64, last = hi / 64, i;
+    u64 head = ~0ULL << (lo % 64);
+    u64 tail = ~0ULL >> (63 - hi % 64);
+    if(first == last) {
+        w[first] |= head & tail;
+        return;
+    }
+    w[first] |= head;
+    for(i = first + 1; i < last; i++)
+        w[i] = ~0ULL;
+    w[last] |= tail;
+}
+
+/* bits of w inside [lo, hi], word by word */
+static u64
+bits_range_mask(u32 word, u32 lo, u32 hi)
+{
+    u32 base = word * 64;
+    u64 m = ~0ULL;
+    if(lo > base)
+        m &= ~0ULL << (lo - base);
+    if(hi < base + 63)
+        m &= ~0ULL >> (base + 63 - hi);
+    return m;
+}
+
+static u32
+bits_count(const u64* w)
+{
+    u32 i, c = 0;
+    for(i = 0; i < BITSET_WORDS; i++)
+        c += popcnt(w[i]);
+    return c;
+}
+
+/* number of runs: a run starts at every 1 whose left neighbour is 0 */
+static u32
+bits_runs(const u64* w)
+{
+    u32 i, n = 0;
+    u64 carry = 0;
+    for(i = 0; i < BITSET_WORDS; i++) {
+        n += popcnt(w[i] & ~((w[i] << 1) | carry));
+        carry = w[i] >> 63;
+    }
+    return n;
+}
+
+/* first bit equal to one at or after from, RB_CHUNK_BITS if none */
+static u32
+bits_next(const u64* w, u32 from, int one)
+{
+    u32 i = from / 64;
+    u64 v;
+    if(from >= RB_CHUNK_BITS)
+        return RB_CHUNK_BITS;
+    v = (one ? w[i] : ~w[i]) & (~0ULL << (from % 64));
+    while(v == 0) {
+        if(++i == BITSET_WORDS)
+            return RB_CHUNK_BITS;
+        v = one ? w[i] : ~w[i];
+    }
+    return i * 64 + __builtin_ctzll(v);
+}
+
+/* ------------------------------- chunks ------------------------------- */
+
+static void
+chunk_init(rb_chunk* c, u16 key)
+{
+    c->key  = key;
+    c->type = RB_ARRAY;
+    c->card = 0;
+    c->n    = 0;
+    c->cap  = 0;
+    c->d.array = NULL;
+}
+
+static void
+chunk_free(rb_chunk* c)
+{
+    free(c->d.array);
+    c->d.array = NULL;
+}
+
+static size_t
+chunk_bytes(const rb_chunk* c)
+{
+    if(c->type == RB_BITSET)
+        return BITSET_BYTES;
+    if(c->type == RB_RUN)
+        return c->cap * sizeof(rb_run);
+    return c->cap * sizeof(u16);
+}
+
+/* make room for need array values or runs */
+static void
+chunk_reserve(rb_chunk* c, u32 need)
+{
+    size_t elem = c->type == RB_RUN ? sizeof(rb_run) : sizeof(u16);
+    if(need <= c->cap)
+        return;
+    u32 cap = c->cap ? c->cap * 2 : 4;
+    while(cap < need)
+        cap *= 2;
+    c->d.array = (u16*)realloc(c->d.array, cap * elem);
+    assert(c->d.array);
+    c->cap = cap;
+}
+
+/* index of the first array value >= v */
+static u32
+array_lower(const rb_chunk* c, u32 v)
+{
+    u32 lo = 0, hi = c->n;
+    while(lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if(c->d.array[mid] < v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* index of the last run starting at or before v, -1 if none */
+static int
+run_find(const rb_chunk* c, u32 v)
+{
+    int lo = 0, hi = (int)c->n - 1, ret = -1;
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if(c->d.runs[mid].start <= v) {
+            ret = mid;
+            lo = mid + 1;
+        } else
+            hi = mid - 1;
+    }
+    return ret;
+}
+
+static void
+run_insert(rb_chunk* c, u32 at, u32 start, u32 len)
+{
+    chunk_reserve(c, c->n + 1);
+    memmove(c->d.runs + at + 1, c->d.runs + at,
+            (c->n - at) * sizeof(rb_run));
+    c->d.runs[at].start = (u16)start;
+    c->d.runs[at].len   = (u16)len;
+    c->n++;
+}
+
+static void
+run_remove(rb_chunk* c, u32 at)
+{
+    memmove(c->d.runs + at, c->d.runs + at + 1,
+            (c->n - at - 1) * sizeof(rb_run));
+    c->n--;
+}
+
+/* append [start, end] to a run list built in increasing order */
+static void
+run_append(rb_chunk* c, u32 start, u32 end)
+{
+    if(c->n && RUN_END(c->d.runs[c->n-1]) + 1 >= start) {
+        rb_run* last = &c->d.runs[c->n-1];
+        if(end > RUN_END(*last))
+            last->len = (u16)(end - last->start);
+        return;
+    }
+    run_insert(c, c->n, start, end - start);
+}
+
+static u32
+chunk_runs(const rb_chunk* c)
+{
+    u32 i, n = 0;
+    if(c->type == RB_RUN)
+        return c->n;
+    if(c->type == RB_BITSET)
+        return bits_runs(c->d.bits);
+    for(i = 0; i < c->n; i++)
+        if(i == 0 || c->d.array[i] != c->d.array[i-1] + 1)
+            n++;
+    return n;
+}
+
+/* the chunk as a freshly allocated bitset */
+static u64*
+chunk_to_bits(const rb_chunk* c)
+{
+    u64* w = (u64*)calloc(BITSET_WORDS, sizeof(u64));
+    u32 i;
+    assert(w);
+    if(c->type == RB_BITSET)
+        memcpy(w, c->d.bits, BITSET_BYTES);
+    else if(c->type == RB_ARRAY) {
+        for(i = 0; i < c->n; i++)
+            w[c->d.array[i] / 64] |= 1ULL << (c->d.array[i] % 64);
+    } else {
+        for(i = 0; i < c->n; i++)
+            bits_set_range(w, c->d.runs[i].start, RUN_END(c->d.runs[i]));
+    }
+    return w;
+}
+
+/* switch c to type, keeping its content */
+static void
+chunk_convert(rb_chunk* c, int type)
+{
+    rb_chunk out;
+    u32 i, v, end;
+    if(c->type == type)
+        return;
+    chunk_init(&out, c->key);
+    out.type = type;
+    out.card = c->card;
+
+    if(type == RB_BITSET) {
+        out.d.bits = chunk_to_bits(c);
+    } else if(type == RB_ARRAY) {
+        chunk_reserve(&out, c->card);
+        if(c->type == RB_RUN) {
+            for(i = 0; i < c->n; i++)
+                for(v = c->d.runs[i].start; v <= RUN_END(c->d.runs[i]); v++)
+                    out.d.array[out.n++] = (u16)v;
+        } else {
+            for(v = bits_next(c->d.bits, 0, 1); v < RB_CHUNK_BITS;
+                v = bits_next(c->d.bits, v + 1, 1))
+                out.d.array[out.n++] = (u16)v;
+        }
+    } else {
+        chunk_reserve(&out, chunk_runs(c));
+        if(c->type == RB_ARRAY) {
+            for(i = 0; i < c->n; i++)
+                run_append(&out, c->d.array[i], c->d.array[i]);
+        } else {
+            for(v = bits_next(c->d.bits, 0, 1); v < RB_CHUNK_BITS;
+                v = bits_next(c->d.bits, end, 1)) {
+                end = bits_next(c->d.bits, v, 0);
+                run_append(&out, v, end - 1);
+            }
+        }
+    }
+    chunk_free(c);
+    *c = out;
+}
+
+/* pick the smallest form; runs are only considered when
+   allow_run, counting them on a bitset costs a full pass */
+static void
+chunk_fix(rb_chunk* c, int allow_run)
+{
+    size_t best = BITSET_BYTES;
+    int type = RB_BITSET;
+    if(c->card <= RB_ARRAY_MAX) {
+        best = c->card * sizeof(u16);
+        type = RB_ARRAY;
+    }
+    if(allow_run || c->type == RB_RUN) {
+        size_t run = chunk_runs(c) * sizeof(rb_run);
+        if(run < best)
+            type = RB_RUN;
+    }
+    chunk_convert(c, type);
+}
+
+static int
+chunk_tst(const rb_chunk* c, u32 v)
+{
+    if(c->type == RB_BITSET)
+        return (c->d.bits[v / 64] >> (v % 64)) & 1;
+    if(c->type == RB_ARRAY) {
+        u32 i = array_lower(c, v);
+        return i < c->n && c->d.array[i] == v;
+    }
+    int i = run_find(c, v);
+    return i >= 0 && v <= RUN_END(c->d.runs[i]);
+}
+
+static void
+chunk_set(rb_chunk* c, u32 v)
+{
+    if(c->type == RB_BITSET) {
+        u64* w = &c->d.bits[v / 64];
+        if(!(*w & (1ULL << (v % 64)))) {
+            *w |= 1ULL << (v % 64);
+            c->card++;
+        }
+        return;
+    }
+
+    if(c->type == RB_ARRAY) {
+        u32 i = array_lower(c, v);
+        if(i < c->n && c->d.array[i] == v)
+            return;
+        if(c->n == RB_ARRAY_MAX) {
+            /* full array: go to whichever of bitset/run is smaller */
+            chunk_fix(c, 1);
+            if(c->type == RB_ARRAY)
+                chunk_convert(c, RB_BITSET);
+            chunk_set(c, v);
+            return;
+        }
+        chunk_reserve(c, c->n + 1);
+        memmove(c->d.array + i + 1, c->d.array + i,
+                (c->n - i) * sizeof(u16));
+        c->d.array[i] = (u16)v;
+        c->n++;
+        c->card++;
+        return;
+    }
+
+    int i = run_find(c, v);
+    rb_run* r = c->d.runs;
+    if(i >= 0 && v <= RUN_END(r[i]))
+        return;
+    int left  = i >= 0 && RUN_END(r[i]) + 1 == v;
+    int right = i + 1 < (int)c->n && r[i+1].start == v + 1;
+    if(left && right) {
+        r[i].len = (u16)(RUN_END(r[i+1]) - r[i].start);
+        run_remove(c, i + 1);
+    } else if(left) {
+        r[i].len++;
+    } else if(right) {
+        r[i+1].start--;
+        r[i+1].len++;
+    } else {
+        run_insert(c, i + 1, v, 0);
+    }
+    c->card++;
+    chunk_fix(c, 0);
+}
+
+static void
+chunk_clr(rb_chunk* c, u32 v)
+{
+    if(c->type == RB_BITSET) {
+        u64* w = &c->d.bits[v / 64];
+        if(*w & (1ULL << (v % 64))) {
+            *w &= ~(1ULL << (v % 64));
+            if(--c->card <= RB_ARRAY_MAX)
+                chunk_convert(c, RB_ARRAY);
+        }
+        return;
+    }
+
+    if(c->type == RB_ARRAY) {
+        u32 i = array_lower(c, v);
+        if(i == c->n || c->d.array[i] != v)
+            return;
+        memmove(c->d.array + i, c->d.array + i + 1,
+                (c->n - i - 1) * sizeof(u16));
+        c->n--;
+        c->card--;
+        return;
+    }
+
+    int i = run_find(c, v);
+    rb_run* r = c->d.runs;
+    if(i < 0 || v > RUN_END(r[i]))
+        return;
+    u32 start = r[i].start, end = RUN_END(r[i]);
+    if(start == end)
+        run_remove(c, i);
+    else if(v == start) {
+        r[i].start++;
+        r[i].len--;
+    } else if(v == end) {
+        r[i].len--;
+    } else {
+        r[i].len = (u16)(v - 1 - start);
+        run_insert(c, i + 1, v + 1, end - v - 1);
+    }
+    c->card--;
+    chunk_fix(c, 0);
+}
+
+static u32
+chunk_first1(const rb_chunk* c)
+{
+    if(c->type == RB_ARRAY)
+        return c->d.array[0];
+    if(c->type == RB_RUN)
+        return c->d.runs[0].start;
+    return bits_next(c->d.bits, 0, 1);
+}
+
+/* lowest clear bit of a chunk that is not full */
+static u32
+chunk_first0(const rb_chunk* c)
+{
+    u32 i;
+    if(c->type == RB_BITSET)
+        return bits_next(c->d.bits, 0, 0);
+    if(c->type == RB_RUN)
+        return c->d.runs[0].start ? 0 : RUN_END(c->d.runs[0]) + 1;
+    for(i = 0; i < c->n && c->d.array[i] == i; i++)
+        ;
+    return i;
+}
+
+/* a & b into out, out is initialized here */
+static void
+chunk_and(const rb_chunk* a, const rb_chunk* b, rb_chunk* out)
+{
+    u32 i, j;
+    chunk_init(out, a->key);
+    if(b->type == RB_ARRAY && a->type != RB_ARRAY) {
+        const rb_chunk* t = a;
+        a = b;
+        b = t;
+    }
+
+    if(a->type == RB_ARRAY) {
+        chunk_reserve(out, a->card < b->card ? a->card : b->card);
+        if(b->type == RB_ARRAY) {
+            for(i = 0, j = 0; i < a->n && j < b->n; ) {
+                if(a->d.array[i] < b->d.array[j])
+                    i++;
+                else if(a->d.array[i] > b->d.array[j])
+                    j++;
+                else {
+                    out->d.array[out->n++] = a->d.array[i];
+                    i++;
+                    j++;
+                }
+            }
+        } else {
+            for(i = 0; i < a->n; i++)
+                if(chunk_tst(b, a->d.array[i]))
+                    out->d.array[out->n++] = a->d.array[i];
+        }
+        out->card = out->n;
+        return;
+    }
+
+    if(a->type == RB_RUN && b->type == RB_RUN) {
+        out->type = RB_RUN;
+        for(i = 0, j = 0; i < a->n && j < b->n; ) {
+            u32 lo = a->d.runs[i].start > b->d.runs[j].start ?
+                a->d.runs[i].start : b->d.runs[j].start;
+            u32 ea = RUN_END(a->d.runs[i]), eb = RUN_END(b->d.runs[j]);
+            u32 hi = ea < eb ? ea : eb;
+            if(lo <= hi) {
+                run_append(out, lo, hi);
+                out->card += hi - lo + 1;
+            }
+            if(ea < eb)
+                i++;
+            else
+                j++;
+        }
+        chunk_fix(out, 0);
+        return;
+    }
+
+    /* at least one bitset */
+    if(a->type == RB_RUN) {
+        const rb_chunk* t = a;
+        a = b;
+        b = t;
+    }
+    out->type = RB_BITSET;
+    out->d.bits = (u64*)calloc(BITSET_WORDS, sizeof(u64));
+    assert(out->d.bits);
+    if(b->type == RB_BITSET) {
+        for(i = 0; i < BITSET_WORDS; i++)
+            out->d.bits[i] = a->d.bits[i] & b->d.bits[i];
+    } else {
+        for(j = 0; j < b->n; j++) {
+            u32 lo = b->d.runs[j].start, hi = RUN_END(b->d.runs[j]);
+            for(i = lo / 64; i <= hi / 64; i++)
+                out->d.bits[i] |= a->d.bits[i] & bits_range_mask(i, lo, hi);
+        }
+    }
+    out->card = bits_count(out->d.bits);
+    chunk_fix(out, 0);
+}
+
+/* a | b into out, out is initialized here */
+static void
+chunk_or(const rb_chunk* a, const rb_chunk* b, rb_chunk* out)
+{
+    u32 i, j;
+    chunk_init(out, a->key);
+    if(b->type == RB_BITSET) {
+        const rb_chunk* t = a;
+        a = b;
+        b = t;
+    }
+
+    if(a->type == RB_BITSET) {
+        out->type = RB_BITSET;
+        out->d.bits = chunk_to_bits(a);
+        if(b->type == RB_BITSET) {
+            for(i = 0; i < BITSET_WORDS; i++)
+                out->d.bits[i] |= b->d.bits[i];
+        } else if(b->type == RB_ARRAY) {
+            for(i = 0; i < b->n; i++)
+                out->d.bits[b->d.array[i] / 64] |=
+                    1ULL << (b->d.array[i] % 64);
+        } else {
+            for(i = 0; i < b->n; i++)
+                bits_set_range(out->d.bits, b->d.runs[i].start,
+                               RUN_END(b->d.runs[i]));
+        }
+        out->card = bits_count(out->d.bits);
+        chunk_fix(out, 0);
+        return;
+    }
+
+    if(a->type == RB_ARRAY && b->type == RB_ARRAY) {
+        chunk_reserve(out, a->n + b->n);
+        for(i = 0, j = 0; i < a->n || j < b->n; ) {
+            if(j == b->n || (i < a->n && a->d.array[i] < b->d.array[j]))
+                out->d.array[out->n++] = a->d.array[i++];
+            else if(i == a->n || b->d.array[j] < a->d.array[i])
+                out->d.array[out->n++] = b->d.array[j++];
+            else {
+                out->d.array[out->n++] = a->d.array[i++];
+                j++;
+            }
+        }
+        out->card = out->n;
+        if(out->card > RB_ARRAY_MAX)
+            chunk_fix(out, 1);
+        return;
+    }
+
+    /* runs and arrays: merge as interval lists, an array value
+       being a run of one */
+    out->type = RB_RUN;
+    for(i = 0, j = 0; i < a->n || j < b->n; ) {
+        u32 sa = RB_CHUNK_BITS, sb = RB_CHUNK_BITS, ea = 0, eb = 0;
+        if(i < a->n) {
+            sa = a->type == RB_RUN ? a->d.runs[i].start : a->d.array[i];
+            ea = a->type == RB_RUN ? RUN_END(a->d.runs[i]) : sa;
+        }
+        if(j < b->n) {
+            sb = b->type == RB_RUN ? b->d.runs[j].start : b->d.array[j];
+            eb = b->type == RB_RUN ? RUN_END(b->d.runs[j]) : sb;
+        }
+        if(sa <= sb) {
+            run_append(out, sa, ea);
+            i++;
+        } else {
+            run_append(out, sb, eb);
+            j++;
+        }
+    }
+    for(i = 0; i < out->n; i++)
+        out->card += out->d.runs[i].len + 1;
+    chunk_fix(out, 0);
+}
+
+/* ------------------------------ roaring ------------------------------- */
+
+/* index of the chunk with key, or where it would be inserted */
+static u32
+chunk_lower(const roaring* rb, u16 key)
+{
+    u32 lo = 0, hi = rb->nchunk;
+    while(lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if(rb->chunks[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static rb_chunk*
+chunk_get(roaring* rb, u16 key)
+{
+    u32 i = chunk_lower(rb, key);
+    if(i < rb->nchunk && rb->chunks[i].key == key)
+        return &rb->chunks[i];
+    return NULL;
+}
+
+/* open an empty chunk for key at index i */
+static rb_chunk*
+chunk_insert(roaring* rb, u32 i, u16 key)
+{
+    if(rb->nchunk == rb->capchunk) {
+        rb->capchunk = rb->capchunk ? rb->capchunk * 2 : 4;
+        rb->chunks = (rb_chunk*)realloc(rb->chunks,
+                                        rb->capchunk * sizeof(rb_chunk));
+        assert(rb->chunks);
+    }
+    memmove(rb->chunks + i + 1, rb->chunks + i,
+            (rb->nchunk - i) * sizeof(rb_chunk));
+    rb->nchunk++;
+    chunk_init(&rb->chunks[i], key);
+    return &rb->chunks[i];
+}
+
+/* append a chunk, callers add in key order, empty ones are dropped */
+static void
+chunk_push(roaring* rb, rb_chunk* c)
+{
+    if(c->card == 0) {
+        chunk_free(c);
+        return;
+    }
+    *chunk_insert(rb, rb->nchunk, c->key) = *c;
+}
+
+roaring* roaring_new(u32 size)
+{
+    assert( size>0 && "size <= 0" );
+    roaring* rb = (roaring*)malloc(sizeof(roaring));
+    if(rb == NULL)
+        return NULL;
+    rb->size = size;
+    rb->nchunk = 0;
+    rb->capchunk = 0;
+    rb->chunks = NULL;
+    return rb;
+}
+
+void roaring_del(roaring* rb)
+{
+    u32 i;
+    if(rb == NULL)
+        return;
+    for(i = 0; i < rb->nchunk; i++)
+        chunk_free(&rb->chunks[i]);
+    free(rb->chunks);
+    free(rb);
+}
+
+void roaring_set(roaring* rb, u32 val)
+{
+    assert(val < rb->size && "val out of range");
+    u32 i = chunk_lower(rb, HIGH(val));
+    if(i == rb->nchunk || rb->chunks[i].key != HIGH(val))
+        chunk_insert(rb, i, HIGH(val));
+    chunk_set(&rb->chunks[i], LOW(val));
+}
+
+void roaring_clr(roaring* rb, u32 val)
+{
+    assert(val < rb->size && "val out of range");
+    u32 i = chunk_lower(rb, HIGH(val));
+    if(i == rb->nchunk || rb->chunks[i].key != HIGH(val))
+        return;
+    chunk_clr(&rb->chunks[i], LOW(val));
+    if(rb->chunks[i].card == 0) {
+        chunk_free(&rb->chunks[i]);
+        memmove(rb->chunks + i, rb->chunks + i + 1,
+                (rb->nchunk - i - 1) * sizeof(rb_chunk));
+        rb->nchunk--;
+    }
+}
+
+int roaring_tst(roaring* rb, u32 val)
+{
+    assert(val < rb->size && "val out of range");
+    rb_chunk* c = chunk_get(rb, HIGH(val));
+    return c != NULL && chunk_tst(c, LOW(val));
+}
+
+/* the index of first 1,
+   return -1 means no 1 bit */
+u32 roaring_first1(roaring* rb)
+{
+    assert(rb);
+    if(rb->nchunk == 0)
+        return -1;
+    return ((u32)rb->chunks[0].key << 16) | chunk_first1(&rb->chunks[0]);
+}
+
+/* the index of first 0,
+   return -1 means no 0 bit */
+u32 roaring_first0(roaring* rb)
+{
+    assert(rb);
+    u32 i, pos = 0;
+    for(i = 0; i < rb->nchunk; i++) {
+        if(rb->chunks[i].key != i)
+            break;
+        if(rb->chunks[i].card < RB_CHUNK_BITS) {
+            pos = (i << 16) | chunk_first0(&rb->chunks[i]);
+            return pos < rb->size ? pos : (u32)-1;
+        }
+    }
+    pos = i << 16;
+    if(i == RB_CHUNK_BITS || pos >= rb->size)
+        return -1;
+    return pos;
+}
+
+u32 roaring_count(roaring* rb)
+{
+    u32 i, n = 0;
+    for(i = 0; i < rb->nchunk; i++)
+        n += rb->chunks[i].card;
+    return n;
+}
+
+roaring* roaring_and(roaring* a, roaring* b)
+{
+    roaring* rb = roaring_new(a->size < b->size ? a->size : b->size);
+    u32 i = 0, j = 0;
+    assert(rb);
+    while(i < a->nchunk && j < b->nchunk) {
+        if(a->chunks[i].key < b->chunks[j].key)
+            i++;
+        else if(a->chunks[i].key > b->chunks[j].key)
+            j++;
+        else {
+            rb_chunk c;
+            chunk_and(&a->chunks[i++], &b->chunks[j++], &c);
+            chunk_push(rb, &c);
+        }
+    }
+    return rb;
+}
+
+/* copy of a chunk, data included */
+static void
+chunk_copy(const rb_chunk* src, rb_chunk* dst)
+{
+    *dst = *src;
+    if(src->type == RB_BITSET) {
+        dst->d.bits = chunk_to_bits(src);
+        return;
+    }
+    dst->cap = 0;
+    dst->d.array = NULL;
+    chunk_reserve(dst, src->n);
+    memcpy(dst->d.array, src->d.array,
+           src->n * (src->type == RB_RUN ? sizeof(rb_run) : sizeof(u16)));
+}
+
+roaring* roaring_or(roaring* a, roaring* b)
+{
+    roaring* rb = roaring_new(a->size > b->size ? a->size : b->size);
+    u32 i = 0, j = 0;
+    rb_chunk c;
+    assert(rb);
+    while(i < a->nchunk || j < b->nchunk) {
+        if(j == b->nchunk ||
+           (i < a->nchunk && a->chunks[i].key < b->chunks[j].key))
+            chunk_copy(&a->chunks[i++], &c);
+        else if(i == a->nchunk || b->chunks[j].key < a->chunks[i].key)
+            chunk_copy(&b->chunks[j++], &c);
+        else
+            chunk_or(&a->chunks[i++], &b->chunks[j++], &c);
+        chunk_push(rb, &c);
+    }
+    return rb;
+}
+
+void roaring_optimize(roaring* rb)
+{
+    u32 i;
+    for(i = 0; i < rb->nchunk; i++)
+        chunk_fix(&rb->chunks[i], 1);
+}
+
+size_t roaring_bytes(roaring* rb)
+{
+    size_t n = sizeof(roaring) + rb->capchunk * sizeof(rb_chunk);
+    u32 i;
+    for(i = 0; i < rb->nchunk; i++)
+        n += chunk_bytes(&rb->chunks[i]);
+    return n;
+}
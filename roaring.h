@@ -0,0 +1,67 @@
+
+// @Name   : ROARING_H
+//
+// @Brief  : compressed bitmap, the u32 space is cut into 65536-bit
+//           chunks keyed by the high 16 bits, each chunk is stored
+//           as a sorted array, a raw bitset or a list of runs,
+//           whichever is smallest.
+
+#if !defined(ROARING_H)
+#define ROARING_H
+
+#include <stddef.h>
+
+typedef unsigned int u32;
+typedef unsigned long long u64;
+typedef unsigned short u16;
+
+#define RB_CHUNK_BITS  65536
+#define RB_ARRAY_MAX   4096   /* past this a bitset is smaller */
+
+enum { RB_ARRAY, RB_BITSET, RB_RUN };
+
+/* [start, start+len] inclusive */
+typedef struct _rb_run{
+    u16 start;
+    u16 len;
+}rb_run;
+
+typedef struct _rb_chunk{
+    u16 key;        /* high 16 bits of every value in the chunk */
+    u16 type;
+    u32 card;       /* number of 1 bits */
+    u32 n;          /* array: values used, run: runs used */
+    u32 cap;        /* array/run: entries allocated */
+    union {
+        u16*    array;
+        u64*    bits;
+        rb_run* runs;
+    }d;
+}rb_chunk;
+
+typedef struct _roaring{
+    u32 size;
+    u32 nchunk;
+    u32 capchunk;
+    rb_chunk* chunks; /* sorted by key, never empty */
+}roaring;
+
+roaring* roaring_new(u32 size);
+void     roaring_del(roaring* rb);
+void     roaring_set(roaring* rb, u32 val);
+void     roaring_clr(roaring* rb, u32 val);
+int      roaring_tst(roaring* rb, u32 val);
+u32      roaring_first0(roaring* rb);
+u32      roaring_first1(roaring* rb);
+u32      roaring_count(roaring* rb);
+
+/* new bitmap holding a & b, a | b */
+roaring* roaring_and(roaring* a, roaring* b);
+roaring* roaring_or(roaring* a, roaring* b);
+
+/* convert every chunk to its smallest form, runs included */
+void     roaring_optimize(roaring* rb);
+/* heap bytes held by the bitmap */
+size_t   roaring_bytes(roaring* rb);
+
+#endif
@@ -0,0 +1,118 @@
+
+// @Name   : roaring_bench.c
+//
+// @Brief  : memory per element and ops/sec of roaring against the
+//           flat bitmap at several densities.
+//           build with: make CFLAGS=-O2 roaring_bench
+
+#include "roaring.h"
+#include "bitmap.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NBITS  (1u << 26)
+#define NPROBE 4000000
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static u32 rnd()
+{
+    return ((u32)rand() << 16) ^ (u32)rand();
+}
+
+static volatile u32 sink;
+
+/* density in set bits per universe bit, clustered puts the same
+   count into runs of 1000 */
+static void bench(double density, int clustered)
+{
+    u32 n = (u32)(NBITS * density), k, hit = 0;
+    u32* vals = (u32*)malloc(sizeof(u32) * n);
+    double t, t_bm, t_rb;
+    assert(vals);
+    for(k = 0; k < n; k++) {
+        if(clustered)
+            vals[k] = k % 1000 + (k / 1000) * (u32)(1000 / density);
+        else
+            vals[k] = rnd() % NBITS;
+    }
+
+    bitmap*  bm = bitmap_new(NBITS);
+    roaring* rb = roaring_new(NBITS);
+    roaring* rb2 = roaring_new(NBITS);
+    assert(bm && rb && rb2);
+
+    t = now_sec();
+    for(k = 0; k < n; k++)
+        bitmap_set(bm, vals[k]);
+    t_bm = now_sec() - t;
+    t = now_sec();
+    for(k = 0; k < n; k++)
+        roaring_set(rb, vals[k]);
+    t_rb = now_sec() - t;
+    roaring_optimize(rb);
+    u32 card = roaring_count(rb);
+    assert(card == bitmap_count(bm));
+
+    size_t bm_bytes = (size_t)NBITS / 8;
+    printf("%8.4f%% %-9s %9u | B/elem %10.3f %10.3f | Mset/s %7.1f %7.1f",
+           density * 100, clustered ? "clustered" : "random", card,
+           (double)bm_bytes / card, (double)roaring_bytes(rb) / card,
+           n / t_bm / 1e6, n / t_rb / 1e6);
+
+    srand(42);
+    t = now_sec();
+    for(k = 0; k < NPROBE; k++)
+        hit += bitmap_tst(bm, rnd() % NBITS) != 0;
+    t_bm = now_sec() - t;
+    srand(42);
+    t = now_sec();
+    for(k = 0; k < NPROBE; k++)
+        hit -= roaring_tst(rb, rnd() % NBITS);
+    t_rb = now_sec() - t;
+    assert(hit == 0);
+    printf(" | Mtst/s %7.1f %7.1f", NPROBE / t_bm / 1e6, NPROBE / t_rb / 1e6);
+
+    /* and against a shifted copy */
+    bitmap* bm2 = bitmap_new(NBITS);
+    bitmap* bm3 = bitmap_new(NBITS);
+    for(k = 0; k < n; k++) {
+        roaring_set(rb2, (vals[k] + 1) % NBITS);
+        bitmap_set(bm2, (vals[k] + 1) % NBITS);
+    }
+    t = now_sec();
+    bitmap_and_to(bm3, bm, bm2);
+    t_bm = now_sec() - t;
+    t = now_sec();
+    roaring* r = roaring_and(rb, rb2);
+    t_rb = now_sec() - t;
+    sink = roaring_count(r);
+    printf(" | and ms %7.2f %7.2f\n", t_bm * 1e3, t_rb * 1e3);
+
+    roaring_del(r);
+    roaring_del(rb);
+    roaring_del(rb2);
+    bitmap_del(bm);
+    bitmap_del(bm2);
+    bitmap_del(bm3);
+    free(vals);
+}
+
+int main()
+{
+    double dens[] = { 0.0001, 0.001, 0.01, 0.1, 0.5 };
+    int i;
+    printf("columns are flat bitmap then roaring\n");
+    for(i = 0; i < 5; i++)
+        bench(dens[i], 0);
+    for(i = 0; i < 4; i++)
+        bench(dens[i], 1);
+    return 0;
+}
@@ -0,0 +1,124 @@
+
+// @Name   : roaring_test.c
+//
+// @Brief  : roaring bitmap checked against the flat bitmap
+
+#include "roaring.h"
+#include "bitmap.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SIZE 1000000
+
+/* every bit of rb agrees with bm */
+static void check(roaring* rb, bitmap* bm)
+{
+    u32 k;
+    for(k=0; k<SIZE; k++)
+        assert(!roaring_tst(rb, k) == !bitmap_tst(bm, k));
+    assert(roaring_count(rb) == bitmap_count(bm));
+    assert(roaring_first1(rb) == bitmap_first1(bm));
+    assert(roaring_first0(rb) == bitmap_first0(bm));
+}
+
+/* fill with a mix of sparse values, dense blocks and long runs */
+static void fill(roaring* rb, bitmap* bm, int seed)
+{
+    int k;
+    u32 v;
+    srand(seed);
+    for(k=0; k<20000; k++) {
+        v = rand() % SIZE;
+        roaring_set(rb, v);
+        bitmap_set(bm, v);
+    }
+    for(k=0; k<30000; k++) {
+        v = 65536 * 3 + rand() % 20000;
+        roaring_set(rb, v);
+        bitmap_set(bm, v);
+    }
+    for(v=65536 * 7 + 100; v<65536 * 9 + 5; v++) {
+        roaring_set(rb, v);
+        bitmap_set(bm, v);
+    }
+}
+
+int main()
+{
+    roaring* rb = roaring_new(SIZE);
+    bitmap*  bm = bitmap_new(SIZE);
+    u32 k, v;
+    assert(rb && bm);
+
+    assert(roaring_first1(rb) == -1);
+    assert(roaring_first0(rb) == 0);
+    roaring_set(rb, 1);
+    assert(roaring_tst(rb, 1));
+    roaring_clr(rb, 1);
+    assert(roaring_tst(rb, 1) == 0);
+    assert(rb->nchunk == 0);
+
+    /* array -> bitset -> array */
+    for(k=0; k<RB_ARRAY_MAX + 1; k++)
+        roaring_set(rb, k * 3);
+    assert(rb->chunks[0].type == RB_BITSET);
+    roaring_clr(rb, 0);
+    assert(rb->chunks[0].type == RB_ARRAY);
+    assert(roaring_first1(rb) == 3);
+    assert(roaring_first0(rb) == 0);
+    for(k=0; k<RB_ARRAY_MAX + 1; k++)
+        roaring_clr(rb, k * 3);
+    assert(rb->nchunk == 0);
+
+    /* a long run stays a run, splitting it keeps it one */
+    for(k=0; k<RB_CHUNK_BITS; k++)
+        roaring_set(rb, k);
+    assert(rb->chunks[0].type == RB_RUN && rb->chunks[0].n == 1);
+    assert(roaring_first0(rb) == RB_CHUNK_BITS);
+    roaring_clr(rb, 500);
+    assert(rb->chunks[0].type == RB_RUN && rb->chunks[0].n == 2);
+    assert(roaring_first0(rb) == 500);
+    assert(roaring_bytes(rb) < 256);
+    for(k=0; k<RB_CHUNK_BITS; k++)
+        roaring_clr(rb, k);
+    assert(rb->nchunk == 0);
+
+    fill(rb, bm, 1);
+    check(rb, bm);
+    roaring_optimize(rb);
+    check(rb, bm);
+    for(k=0; k<SIZE; k+=7) {
+        roaring_clr(rb, k);
+        bitmap_clr(bm, k);
+    }
+    check(rb, bm);
+
+    /* and/or across chunk types */
+    roaring* rb2 = roaring_new(SIZE);
+    bitmap*  bm2 = bitmap_new(SIZE);
+    bitmap*  bm3 = bitmap_new(SIZE);
+    fill(rb2, bm2, 2);
+    for(v=65536 * 8; v<65536 * 8 + 3000; v+=2) {
+        roaring_clr(rb2, v);
+        bitmap_clr(bm2, v);
+    }
+    roaring_optimize(rb2);
+
+    roaring* r = roaring_and(rb, rb2);
+    bitmap_and_to(bm3, bm, bm2);
+    check(r, bm3);
+    roaring_del(r);
+
+    r = roaring_or(rb, rb2);
+    bitmap_or_to(bm3, bm, bm2);
+    check(r, bm3);
+    roaring_del(r);
+
+    roaring_del(rb);
+    roaring_del(rb2);
+    bitmap_del(bm);
+    bitmap_del(bm2);
+    bitmap_del(bm3);
+    return 0;
+}
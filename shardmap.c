@@ -0,0 +1,104 @@
+
+// @Name   : shardmap.c
+//
+// @Brief  : sharded hashmap with a reader-writer lock per shard
+
+#include <assert.h>
+#include <stdlib.h>
+#include "shardmap.h"
+
+/* high bits pick the shard, the shard's hashmap masks the low ones
+   of the same code, so the key is hashed once */
+static inline shard*
+shard_of(shardmap* shmap, u32 code)
+{
+    if(shmap->shift == 32)
+        return shmap->shards;
+    return &shmap->shards[code >> shmap->shift];
+}
+
+shardmap* shmap_new(u32 nshard, hash_f hash, cmp_f cmp,
+                    keydup_f keydup, valdup_f valdup,
+                    keyrel_f keyrel, valrel_f valrel)
+{
+    u32 n = 1, shift = 32, k;
+    assert(nshard > 0 && nshard <= (1u << 16));
+    while(n < nshard) {
+        n <<= 1;
+        shift--;
+    }
+
+    shardmap* shmap = (shardmap*)malloc(sizeof(shardmap));
+    if(shmap == NULL)
+        return NULL;
+    shmap->nshard = n;
+    shmap->shift  = shift;
+    shmap->hash   = hash;
+    shmap->shards = (shard*)aligned_alloc(64, sizeof(shard) * n);
+    if(shmap->shards == NULL) {
+        free(shmap);
+        return NULL;
+    }
+    for(k = 0; k < n; k++) {
+        pthread_rwlock_init(&shmap->shards[k].lock, NULL);
+        shmap->shards[k].map = hsmap_new(hash, cmp, keydup, valdup,
+                                         keyrel, valrel);
+    }
+    return shmap;
+}
+
+void shmap_del(shardmap* shmap)
+{
+    u32 k;
+    if(shmap == NULL)
+        return;
+    for(k = 0; k < shmap->nshard; k++) {
+        hsmap_del(shmap->shards[k].map);
+        pthread_rwlock_destroy(&shmap->shards[k].lock);
+    }
+    free(shmap->shards);
+    free(shmap);
+}
+
+int shmap_insert(shardmap* shmap, void* key, void* val)
+{
+    u32 code = shmap->hash(key);
+    shard* s = shard_of(shmap, code);
+    pthread_rwlock_wrlock(&s->lock);
+    int ret = hsmap_insert_code(s->map, code, key, val);
+    pthread_rwlock_unlock(&s->lock);
+    return ret;
+}
+
+int shmap_find(shardmap* shmap, void* key, visit_f visit, void* arg)
+{
+    u32 code = shmap->hash(key);
+    shard* s = shard_of(shmap, code);
+    pthread_rwlock_rdlock(&s->lock);
+    void* val = hsmap_find_code(s->map, code, key);
+    if(val && visit)
+        visit(val, arg);
+    pthread_rwlock_unlock(&s->lock);
+    return val != NULL;
+}
+
+int shmap_erase(shardmap* shmap, void* key)
+{
+    u32 code = shmap->hash(key);
+    shard* s = shard_of(shmap, code);
+    pthread_rwlock_wrlock(&s->lock);
+    int ret = hsmap_erase_code(s->map, code, key);
+    pthread_rwlock_unlock(&s->lock);
+    return ret;
+}
+
+u32 shmap_count(shardmap* shmap)
+{
+    u32 k, n = 0;
+    for(k = 0; k < shmap->nshard; k++) {
+        pthread_rwlock_rdlock(&shmap->shards[k].lock);
+        n += hsmap_count(shmap->shards[k].map);
+        pthread_rwlock_unlock(&shmap->shards[k].lock);
+    }
+    return n;
+}
@@ -0,0 +1,53 @@
+
+// @Name   : SHARDMAP_H
+//
+// @Brief  : hashmap shared between threads. keys are spread over a
+//           power of two of shards by the high bits of their hash,
+//           each shard is a hashmap behind its own reader-writer
+//           lock and grows on its own, so a resize only stalls the
+//           threads that touch that shard.
+
+#if !defined(SHARDMAP_H)
+#define SHARDMAP_H
+
+#include <pthread.h>
+#include "hashmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* called with the shard locked for reading, val is only valid
+   inside the call */
+typedef void (*visit_f) (void* val, void* arg);
+
+typedef struct {
+    pthread_rwlock_t lock;
+    hashmap* map;           /* grown all at once, finds never write */
+}__attribute__((aligned(64))) shard;
+
+typedef struct {
+    u32 nshard;             /* a power of two */
+    u32 shift;              /* 32 - log2(nshard) */
+    shard* shards;
+    hash_f hash;
+}shardmap;
+
+/* nshard is rounded up to a power of two */
+shardmap* shmap_new(u32 nshard, hash_f hash, cmp_f cmp,
+                    keydup_f keydup, valdup_f valdup,
+                    keyrel_f keyrel, valrel_f valrel);
+void shmap_del(shardmap* shmap);
+
+int  shmap_insert(shardmap* shmap, void* key, void* val);
+/* @ 0 : not found
+   @ 1 : found, visit(val, arg) was called unless visit is NULL */
+int  shmap_find(shardmap* shmap, void* key, visit_f visit, void* arg);
+int  shmap_erase(shardmap* shmap, void* key);
+u32  shmap_count(shardmap* shmap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
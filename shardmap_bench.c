@@ -0,0 +1,123 @@
+
+// @Name   : shardmap_bench.c
+//
+// @Brief  : lookups and updates from 1 to N threads, shardmap against
+//           one hashmap behind one mutex, 90/10 and 50/50 read/write.
+//           build with: make CFLAGS=-O2 shardmap_bench
+//           usage: shardmap_bench [max threads] [shards]
+
+#include "shardmap.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NKEYS  (1u << 20)
+#define NOPS   2000000      /* per thread */
+
+static shardmap* shmap;
+static hashmap*  hsmap;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int read_pct;
+
+/* keys are the pointer values themselves, nothing is dupped */
+static unsigned id_hash(const void* a)
+{
+    u32 key = (u32)(uintptr_t)a;
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static int   id_cmp(const void* a, const void* b) { return a != b; }
+static void* id_dup(const void* key) { return (void*)key; }
+static void  id_rel(const void* key) { (void)key; }
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* run_sharded(void* arg)
+{
+    u32 seed = (u32)(size_t)arg * 7919 + 1, k;
+    for(k = 0; k < NOPS; k++) {
+        seed = seed * 1103515245 + 12345;
+        void* key = (void*)(uintptr_t)((seed >> 4) % NKEYS + 1);
+        if((int)(seed >> 25) % 100 < read_pct)
+            shmap_find(shmap, key, NULL, NULL);
+        else
+            shmap_insert(shmap, key, key);
+    }
+    return NULL;
+}
+
+static void* run_mutex(void* arg)
+{
+    u32 seed = (u32)(size_t)arg * 7919 + 1, k;
+    for(k = 0; k < NOPS; k++) {
+        seed = seed * 1103515245 + 12345;
+        void* key = (void*)(uintptr_t)((seed >> 4) % NKEYS + 1);
+        pthread_mutex_lock(&lock);
+        if((int)(seed >> 25) % 100 < read_pct)
+            hsmap_find(hsmap, key);
+        else
+            hsmap_insert(hsmap, key, key);
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+/* million operations per second over all threads */
+static double run(void* (*fn)(void*), int n)
+{
+    pthread_t th[256];
+    double t = now_sec();
+    int i;
+    for(i = 0; i < n; i++)
+        pthread_create(&th[i], NULL, fn, (void*)(size_t)i);
+    for(i = 0; i < n; i++)
+        pthread_join(th[i], NULL);
+    t = now_sec() - t;
+    return (double)n * NOPS / t / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    int max = argc > 1 ? atoi(argv[1]) : 8, n, m;
+    u32 nshard = argc > 2 ? (u32)atoi(argv[2]) : 64, k;
+    static const int mixes[] = {90, 50};
+    assert(max > 0 && max <= 256);
+
+    shmap = shmap_new(nshard, &id_hash, &id_cmp, &id_dup, &id_dup,
+                      &id_rel, &id_rel);
+    hsmap = hsmap_new(&id_hash, &id_cmp, &id_dup, &id_dup,
+                      &id_rel, &id_rel);
+    assert(shmap && hsmap);
+    /* half the keys present, writes add the rest over time */
+    for(k = 1; k <= NKEYS; k += 2) {
+        shmap_insert(shmap, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+        hsmap_insert(hsmap, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+    }
+
+    printf("%u keys, %u shards\n", NKEYS, shmap->nshard);
+    printf("%-8s %-6s %16s %16s\n", "threads", "read%", "mutex Mop/s",
+           "sharded Mop/s");
+    for(m = 0; m < 2; m++) {
+        read_pct = mixes[m];
+        for(n = 1; n <= max; n *= 2)
+            printf("%-8d %-6d %16.2f %16.2f\n", n, read_pct,
+                   run(run_mutex, n), run(run_sharded, n));
+    }
+    shmap_del(shmap);
+    hsmap_del(hsmap);
+    return 0;
+}
@@ -0,0 +1,125 @@
+// @Name   : shardmap_test.c
+//
+// @Brief  :
+
+#include "shardmap.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NTHREAD 4
+#define PER     50000
+
+static shardmap* shmap;
+
+static unsigned int_hash(const void* a)
+{
+    u32 key = (u32)(*(int*)a);
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+static size_t hashes;
+
+static unsigned count_hash(const void* a)
+{
+    hashes++;
+    return int_hash(a);
+}
+
+static int int_cmp(const void* a, const void* b)
+{
+    return *(int*)a - *(int*)b;
+}
+
+static void* int_dup(const void* key)
+{
+    int* res = (int*)malloc(sizeof(int));
+    *res = *(int*)key;
+    return res;
+}
+
+static void int_rel(const void* key)
+{
+    free((int*)key);
+}
+
+static void copy_int(void* val, void* arg)
+{
+    *(int*)arg = *(int*)val;
+}
+
+/* each thread owns a key range and reads the others' meanwhile */
+static void* worker(void* arg)
+{
+    int no = (int)(size_t)arg, k, v;
+    u32 seed = no + 1;
+    for(k=no*PER; k<(no+1)*PER; k++) {
+        int val = -k;
+        assert(shmap_insert(shmap, &k, &val));
+        assert(shmap_find(shmap, &k, copy_int, &v) && v == -k);
+        seed = seed * 1103515245 + 12345;
+        int other = (seed >> 8) % (NTHREAD*PER);
+        if(shmap_find(shmap, &other, copy_int, &v))
+            assert(v == -other);
+    }
+    for(k=no*PER; k<(no+1)*PER; k+=2)
+        assert(shmap_erase(shmap, &k));
+    return NULL;
+}
+
+int main()
+{
+    pthread_t th[NTHREAD];
+    int t, k, v;
+
+    shmap = shmap_new(12, &int_hash, &int_cmp, &int_dup, &int_dup,
+                      &int_rel, &int_rel);
+    assert(shmap && shmap->nshard == 16 && shmap->shift == 28);
+    k = 7;
+    assert(!shmap_find(shmap, &k, NULL, NULL));
+    assert(!shmap_erase(shmap, &k));
+
+    for(t=0; t<NTHREAD; t++)
+        pthread_create(&th[t], NULL, worker, (void*)(size_t)t);
+    for(t=0; t<NTHREAD; t++)
+        pthread_join(th[t], NULL);
+
+    assert(shmap_count(shmap) == NTHREAD*PER/2);
+    for(k=0; k<NTHREAD*PER; k++) {
+        int found = shmap_find(shmap, &k, copy_int, &v);
+        assert(k % 2 ? found && v == -k : !found);
+    }
+    /* every shard took a share of the keys and grew on its own */
+    for(t=0; t<(int)shmap->nshard; t++)
+        assert(hsmap_count(shmap->shards[t].map) > 0);
+    shmap_del(shmap);
+
+    shmap = shmap_new(1, &int_hash, &int_cmp, &int_dup, &int_dup,
+                      &int_rel, &int_rel);
+    assert(shmap && shmap->nshard == 1);
+    k = 3;
+    assert(shmap_insert(shmap, &k, &k) && shmap_find(shmap, &k, NULL, NULL));
+    shmap_del(shmap);
+
+    /* the shard and the bucket come from one hash of the key */
+    shmap = shmap_new(8, &count_hash, &int_cmp, &int_dup, &int_dup,
+                      &int_rel, &int_rel);
+    assert(shmap);
+    for(k=0; k<10000; k++)
+        assert(shmap_insert(shmap, &k, &k));
+    for(k=0; k<10000; k++)
+        assert(shmap_find(shmap, &k, NULL, NULL));
+    for(k=0; k<10000; k++)
+        assert(shmap_erase(shmap, &k));
+    assert(hashes == 3 * 10000);
+    shmap_del(shmap);
+    printf("shardmap test ok\n");
+    return 0;
+}
@@ -45,32 +45,77 @@ random_lev(skiplist* skip_l)
 
 
 static
-skipnode* make_node(int lev, void* value, int vsize)
+skipnode* make_node(skiplist* sl, int lev, void* value)
 {
-    skipnode* node = (skipnode*)malloc(sizeof(skipnode*));
+    skipnode* node = (skipnode*)mem_alloc(&sl->alloc, &sl->mem,
+                                          sizeof(skipnode));
     assert(node);
-    node->value = (void*)malloc(vsize);
-    node->forward = (skipnode**)calloc(lev+1, sizeof(skipnode*));
-    memcpy(node->value, value, vsize); //copy value
+    node->lev = lev;
+    node->value = mem_alloc(&sl->alloc, &sl->mem, sl->vsize);
+    node->forward = (skipnode**)mem_calloc(&sl->alloc, &sl->mem,
+                                           (lev+1) * sizeof(skipnode*));
+    assert(node->value && node->forward);
+    memcpy(node->value, value, sl->vsize); //copy value
     return node;
 }
 
+static
+void free_node(skiplist* sl, skipnode* node)
+{
+    mem_free(&sl->alloc, &sl->mem, node->value, sl->vsize);
+    mem_free(&sl->alloc, &sl->mem, node->forward,
+             (node->lev+1) * sizeof(skipnode*));
+    mem_free(&sl->alloc, &sl->mem, node, sizeof(skipnode));
+}
+
 skiplist* sl_new(int maxlev, int vsize, cmp_func cfunc, show_func sfunc)
+{
+    return sl_new_alloc(maxlev, vsize, cfunc, sfunc, NULL);
+}
+
+skiplist* sl_new_alloc(int maxlev, int vsize, cmp_func cfunc,
+                       show_func sfunc, const allocator* alloc)
 {
     assert(maxlev);
-    skiplist* sl = (skiplist*)malloc(sizeof(skiplist));
+    allocator a;
+    memstat mem;
+    mem_init(&a, &mem, alloc);
+    skiplist* sl = (skiplist*)mem_alloc(&a, &mem, sizeof(skiplist));
     assert(sl);
 
+    sl->alloc  = a;
+    sl->mem    = mem;
+
     sl->maxlev = maxlev;
     sl->lev    = 0;
     sl->inited = 0;
     sl->vsize  = vsize;
     sl->cfunc  = cfunc;
     sl->sfunc  = sfunc;
-    sl->header = make_node(maxlev, &MINVALUE, sl->vsize);
+    sl->header = make_node(sl, maxlev, &MINVALUE);
     return sl;
 }
 
+void sl_free(skiplist* sl)
+{
+    allocator a;
+    skipnode* node;
+    if(sl == NULL) return;
+    while(sl->header) {
+        node = sl->header->forward[0];
+        free_node(sl, sl->header);
+        sl->header = node;
+    }
+    a = sl->alloc;
+    mem_free(&a, &sl->mem, sl, sizeof(skiplist));
+}
+
+void sl_mem(skiplist* sl, memstat* mem)
+{
+    assert(sl);
+    *mem = sl->mem;
+}
+
 void sl_print(skiplist* sl)
 {
     assert(sl);
@@ -136,7 +181,7 @@ int sl_insert(skiplist* sl, void* value)
             update[i] = sl->header;
         sl->lev = lev;
     }
-    node = make_node(lev, value, sl->vsize);
+    node = make_node(sl, lev, value);
     assert(node);
     for(i=0; i<=lev; i++){
         node->forward[i] = update[i]->forward[i];
@@ -164,9 +209,7 @@ int sl_delete(skiplist* sl, void* value)
         update[i]->forward[i] = node->forward[i];
     }
 
-    free(node->value);
-    free(node->forward);
-    free(node);
+    free_node(sl, node);
     while(sl->lev > 0 && sl->header->forward[sl->lev] == NULL)
         sl->lev--;
     
@@ -25,6 +25,8 @@ extern "C" {
 #include <string.h>
 #endif
 
+#include "alloc.h"
+
     
     typedef int   (*cmp_func)  (const void* l, const void* r);
     typedef void  (*show_func) (const void* value);
@@ -34,6 +36,7 @@ extern "C" {
 
     typedef struct _skip_node{
         void* value;
+        int lev;                    /* forward has lev+1 links */
         struct _skip_node** forward;
     }skipnode;
 
@@ -45,9 +48,17 @@ extern "C" {
         int maxlev;
         int inited;
         int vsize;
+        allocator alloc;
+        memstat mem;
     }skiplist;
 
     skiplist* sl_new(int maxlev, int vsize, cmp_func cfunc, show_func sfunc);
+    /* nodes and values from alloc, NULL for malloc */
+    skiplist* sl_new_alloc(int maxlev, int vsize, cmp_func cfunc,
+                           show_func sfunc, const allocator* alloc);
+    void      sl_free  (skiplist* list);
+    /* live bytes and blocks of the list */
+    void      sl_mem   (skiplist* list, memstat* mem);
     void*     sl_search(skiplist* list, void* item);
     int       sl_insert(skiplist* list, void* item);
     int       sl_delete(skiplist* list, void* item);
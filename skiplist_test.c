@@ -61,6 +61,14 @@ int main()
         //printf("lev : %d\n", sl->lev);
         sl_print(sl);
     }
+
+    /* the list and its header are left */
+    memstat mem;
+    sl_mem(sl, &mem);
+    assert(mem.blocks == 4 && mem.allocs == 4 + 3*10);
+    assert(mem.bytes == sizeof(skiplist) + sizeof(skipnode) +
+           sizeof(int) + 21 * sizeof(skipnode*));
+    sl_free(sl);
     return 0;
 }
 
@@ -0,0 +1,265 @@
+
+// @Name   : swissmap.c
+//
+// @Brief  : open addressing hashmap with SSE2 control groups
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "swissmap.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define NONE ((u32)-1)
+
+/* bit i set when control byte i of the group equals c */
+static inline u32
+group_match(const unsigned char* g, unsigned char c)
+{
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_load_si128((const __m128i*)g);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+    u32 m = 0, i;
+    for(i = 0; i < SW_GROUP; i++)
+        m |= (u32)(g[i] == c) << i;
+    return m;
+#endif
+}
+
+/* empty and deleted both have the high bit, full tags do not */
+static inline u32
+group_free(const unsigned char* g)
+{
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_load_si128((const __m128i*)g));
+#else
+    u32 m = 0, i;
+    for(i = 0; i < SW_GROUP; i++)
+        m |= (u32)(g[i] >> 7) << i;
+    return m;
+#endif
+}
+
+/* first group from the high bits of a fibonacci product, the tag
+   from the low bits of the code */
+static inline u32
+group_of(const swissmap* swmap, u32 code)
+{
+    if(swmap->gshift == 0)
+        return 0;
+    return (code * 2654435769u) >> (32 - swmap->gshift);
+}
+
+static inline unsigned char
+tag_of(u32 code)
+{
+    return code & 0x7F;
+}
+
+static int
+table_init(swissmap* swmap, u32 capacity)
+{
+    u32 shift = 0;
+    assert(capacity <= SW_MAX_CAPACITY);
+    while(((u32)SW_GROUP << shift) < capacity)
+        shift++;
+    capacity = (u32)SW_GROUP << shift;
+
+    swmap->ctrl  = (unsigned char*)aligned_alloc(SW_GROUP, capacity);
+    swmap->slots = (swslot*)malloc(sizeof(swslot) * capacity);
+    if(swmap->ctrl == NULL || swmap->slots == NULL) {
+        free(swmap->ctrl);
+        free(swmap->slots);
+        return 0;
+    }
+    memset(swmap->ctrl, SW_EMPTY, capacity);
+    swmap->capacity    = capacity;
+    swmap->gshift      = shift;
+    swmap->growth_left = capacity - capacity / 8 - swmap->count;
+    return 1;
+}
+
+/* first empty or deleted slot on the probe sequence of code, the
+   table is never full so there always is one */
+static u32
+find_free(const swissmap* swmap, u32 code)
+{
+    u32 gmask = (swmap->capacity / SW_GROUP) - 1;
+    u32 g = group_of(swmap, code), step = 0, m;
+    for(;;) {
+        m = group_free(swmap->ctrl + g * SW_GROUP);
+        if(m)
+            return g * SW_GROUP + __builtin_ctz(m);
+        g = (g + ++step) & gmask;
+    }
+}
+
+/* groups are probed at triangular offsets, which visit every group
+   of a power of two table, a group with an empty slot ends it */
+static u32
+find_slot(const swissmap* swmap, u32 code, const void* key)
+{
+    u32 gmask = (swmap->capacity / SW_GROUP) - 1;
+    u32 g = group_of(swmap, code), step = 0, m;
+    unsigned char tag = tag_of(code);
+    for(;;) {
+        const unsigned char* ctrl = swmap->ctrl + g * SW_GROUP;
+        for(m = group_match(ctrl, tag); m; m &= m - 1) {
+            u32 idx = g * SW_GROUP + __builtin_ctz(m);
+            if(swmap->cmp(swmap->slots[idx].key, key) == 0)
+                return idx;
+        }
+        if(group_match(ctrl, SW_EMPTY))
+            return NONE;
+        g = (g + ++step) & gmask;
+    }
+}
+
+/* move every item into a table of capacity, dropping tombstones */
+static int
+rehash(swissmap* swmap, u32 capacity)
+{
+    unsigned char* ctrl = swmap->ctrl;
+    swslot* slots = swmap->slots;
+    u32 old = swmap->capacity, n;
+
+    if(!table_init(swmap, capacity)) {
+        swmap->ctrl  = ctrl;
+        swmap->slots = slots;
+        return 0;
+    }
+    for(n = 0; n < old; n++) {
+        if(ctrl[n] & 0x80)
+            continue;
+        u32 code = swmap->hash(slots[n].key);
+        u32 idx = find_free(swmap, code);
+        swmap->ctrl[idx]  = tag_of(code);
+        swmap->slots[idx] = slots[n];
+    }
+    free(ctrl);
+    free(slots);
+    return 1;
+}
+
+swissmap*
+swmap_new(hash_f hash, cmp_f cmp,
+          keydup_f keydup, valdup_f valdup,
+          keyrel_f keyrel, valrel_f valrel)
+{
+    swissmap* swmap = (swissmap*)calloc(1, sizeof(swissmap));
+    if(swmap == NULL)
+        return NULL;
+    swmap->hash   = hash;
+    swmap->cmp    = cmp;
+    swmap->keydup = keydup;
+    swmap->valdup = valdup;
+    swmap->keyrel = keyrel;
+    swmap->valrel = valrel;
+    if(!table_init(swmap, SW_GROUP)) {
+        free(swmap);
+        return NULL;
+    }
+    return swmap;
+}
+
+void swmap_del(swissmap* swmap)
+{
+    u32 n;
+    if(swmap == NULL)
+        return;
+    for(n = 0; n < swmap->capacity; n++) {
+        if(swmap->ctrl[n] & 0x80)
+            continue;
+        swmap->keyrel(swmap->slots[n].key);
+        swmap->valrel(swmap->slots[n].val);
+    }
+    free(swmap->ctrl);
+    free(swmap->slots);
+    free(swmap);
+}
+
+/* @ 0 : add failed
+   @ 1 : add success */
+int swmap_insert(swissmap* swmap, void* key, void* val)
+{
+    assert(swmap);
+    u32 code = swmap->hash(key);
+    u32 idx = find_slot(swmap, code, key);
+    if(idx != NONE) {
+        swmap->valrel(swmap->slots[idx].val);
+        swmap->slots[idx].val = swmap->valdup(val);
+        return 1;
+    }
+
+    if(swmap->growth_left == 0) {
+        /* mostly tombstones: same size, otherwise double */
+        u32 capacity = swmap->capacity;
+        if(swmap->count >= capacity / 2 - capacity / 16) {
+            if(capacity == SW_MAX_CAPACITY)
+                return 0;
+            capacity *= 2;
+        }
+        if(!rehash(swmap, capacity))
+            return 0;
+    }
+    idx = find_free(swmap, code);
+    if(swmap->ctrl[idx] == SW_EMPTY)
+        swmap->growth_left--;
+    swmap->ctrl[idx] = tag_of(code);
+    swmap->slots[idx].key = swmap->keydup(key);
+    swmap->slots[idx].val = swmap->valdup(val);
+    swmap->count++;
+    return 1;
+}
+
+/* @ NULL : no found
+   @ *val : pointer of value */
+void* swmap_find(swissmap* swmap, void* key)
+{
+    assert(swmap);
+    u32 idx = find_slot(swmap, swmap->hash(key), key);
+    return idx == NONE ? NULL : swmap->slots[idx].val;
+}
+
+/* a group that still has an empty slot never ended a probe for
+   another key, so the slot can go back to empty, else it is left
+   as a tombstone */
+int swmap_erase(swissmap* swmap, void* key)
+{
+    assert(swmap);
+    u32 idx = find_slot(swmap, swmap->hash(key), key);
+    if(idx == NONE)
+        return 0;
+    swmap->keyrel(swmap->slots[idx].key);
+    swmap->valrel(swmap->slots[idx].val);
+    if(group_match(swmap->ctrl + idx / SW_GROUP * SW_GROUP, SW_EMPTY)) {
+        swmap->ctrl[idx] = SW_EMPTY;
+        swmap->growth_left++;
+    } else {
+        swmap->ctrl[idx] = SW_DELETED;
+    }
+    swmap->count--;
+    return 1;
+}
+
+u32 swmap_count(swissmap* swmap)
+{
+    return swmap->count;
+}
+
+int swmap_reserve(swissmap* swmap, u32 n)
+{
+    u32 capacity = swmap->capacity;
+    while(capacity - capacity / 8 < n) {
+        /* the slots are counted in a u32 */
+        if(capacity == SW_MAX_CAPACITY)
+            return 0;
+        capacity *= 2;
+    }
+    if(capacity == swmap->capacity)
+        return 1;
+    return rehash(swmap, capacity);
+}
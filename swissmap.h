@@ -0,0 +1,63 @@
+
+// @Name   : SWISSMAP_H
+//
+// @Brief  : open addressing hashmap with the hsmap surface. slots come
+//           in groups of 16 with one control byte each: a 7-bit tag
+//           of the hash when full, empty or deleted otherwise. a
+//           lookup matches the tag against a whole group with one
+//           SSE2 compare and calls cmp only for tag hits.
+
+#if !defined(SWISSMAP_H)
+#define SWISSMAP_H
+
+#include "hashmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SW_GROUP      16
+#define SW_EMPTY      0x80
+#define SW_DELETED    0xFE
+#define SW_MAX_CAPACITY (1u << 31)
+
+typedef struct {
+    void* key;
+    void* val;
+}swslot;
+
+typedef struct {
+    u32 capacity;           /* slots, a power of two, >= SW_GROUP */
+    u32 gshift;             /* log2 of the number of groups */
+    u32 count;
+    u32 growth_left;        /* empty slots to fill before a rehash */
+    unsigned char* ctrl;    /* one byte per slot, 16-byte aligned */
+    swslot* slots;
+
+    hash_f hash;
+    cmp_f  cmp;
+
+    keydup_f keydup;
+    valdup_f valdup;
+    keyrel_f keyrel;
+    valrel_f valrel;
+}swissmap;
+
+swissmap* swmap_new(hash_f hash, cmp_f cmp,
+                    keydup_f keydup, valdup_f valdup,
+                    keyrel_f keyrel, valrel_f valrel);
+void  swmap_del(swissmap* swmap);
+
+int   swmap_insert(swissmap* swmap, void* key, void* val);
+void* swmap_find(swissmap* swmap, void* key);
+int   swmap_erase(swissmap* swmap, void* key);
+u32   swmap_count(swissmap* swmap);
+/* room for n items without a rehash, 0 when n would need more than
+   SW_MAX_CAPACITY slots or the memory runs out */
+int   swmap_reserve(swissmap* swmap, u32 n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
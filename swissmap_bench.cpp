@@ -0,0 +1,118 @@
+
+// @Name   : swissmap_bench.cpp
+//
+// @Brief  : lookups in swissmap against hashmap and
+//           std::unordered_map, hit-heavy (90% present) and
+//           miss-heavy (10% present), all with the same hash.
+//           build with: make CFLAGS=-O2 swissmap_bench
+//           usage: swissmap_bench [keys]
+
+#include "swissmap.h"
+#include "hashmap.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unordered_map>
+
+#define NLOOKUP (1u << 23)
+
+static unsigned mix(u32 key)
+{
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+/* keys are the pointer values themselves, nothing is dupped */
+static unsigned id_hash(const void* a) { return mix((u32)(uintptr_t)a); }
+static int   id_cmp(const void* a, const void* b) { return a != b; }
+static void* id_dup(const void* key) { return (void*)key; }
+static void  id_rel(const void* key) { (void)key; }
+
+struct mix_hash {
+    size_t operator()(u32 key) const { return mix(key); }
+};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* lookup keys, present ones are 1..n, absent ones above n */
+static void make_lookups(u32* keys, u32 n, int hit_pct)
+{
+    u32 k;
+    for(k=0; k<NLOOKUP; k++) {
+        u32 r = (u32)rand();
+        keys[k] = (int)(r % 100) < hit_pct ? r % n + 1 : n + 1 + r % n;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    u32 n = argc > 1 ? (u32)atol(argv[1]) : 1000000, k;
+    u32* keys = (u32*)malloc(sizeof(u32) * NLOOKUP);
+    static const int mixes[] = {90, 10};
+    assert(n > 0 && keys);
+
+    hashmap* hsmap = hsmap_new(&id_hash, &id_cmp, &id_dup, &id_dup,
+                               &id_rel, &id_rel);
+    swissmap* swmap = swmap_new(&id_hash, &id_cmp, &id_dup, &id_dup,
+                                &id_rel, &id_rel);
+    std::unordered_map<u32, u32, mix_hash> umap;
+    assert(hsmap && swmap);
+
+    double t[3];
+    t[0] = now_sec();
+    for(k=1; k<=n; k++)
+        hsmap_insert(hsmap, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+    t[0] = now_sec() - t[0];
+    t[1] = now_sec();
+    for(k=1; k<=n; k++)
+        swmap_insert(swmap, (void*)(uintptr_t)k, (void*)(uintptr_t)k);
+    t[1] = now_sec() - t[1];
+    t[2] = now_sec();
+    for(k=1; k<=n; k++)
+        umap.emplace(k, k);
+    t[2] = now_sec() - t[2];
+
+    printf("%u keys, %u lookups, M ops/s\n", n, NLOOKUP);
+    printf("%-10s %12s %12s %12s\n", "", "hashmap", "swissmap",
+           "unordered");
+    printf("%-10s %12.2f %12.2f %12.2f\n", "insert",
+           n / t[0] / 1e6, n / t[1] / 1e6, n / t[2] / 1e6);
+
+    for(int m = 0; m < 2; m++) {
+        u32 found[3] = {0, 0, 0};
+        srand(7);
+        make_lookups(keys, n, mixes[m]);
+        t[0] = now_sec();
+        for(k=0; k<NLOOKUP; k++)
+            found[0] += hsmap_find(hsmap, (void*)(uintptr_t)keys[k]) != NULL;
+        t[0] = now_sec() - t[0];
+        t[1] = now_sec();
+        for(k=0; k<NLOOKUP; k++)
+            found[1] += swmap_find(swmap, (void*)(uintptr_t)keys[k]) != NULL;
+        t[1] = now_sec() - t[1];
+        t[2] = now_sec();
+        for(k=0; k<NLOOKUP; k++)
+            found[2] += umap.find(keys[k]) != umap.end();
+        t[2] = now_sec() - t[2];
+        assert(found[0] == found[1] && found[1] == found[2]);
+        printf("%2d%% hit   %12.2f %12.2f %12.2f\n", mixes[m],
+               NLOOKUP / t[0] / 1e6, NLOOKUP / t[1] / 1e6,
+               NLOOKUP / t[2] / 1e6);
+    }
+    hsmap_del(hsmap);
+    swmap_del(swmap);
+    free(keys);
+    return 0;
+}
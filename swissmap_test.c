@@ -0,0 +1,111 @@
+// @Name   : swissmap_test.c
+//
+// @Brief  :
+
+#include "swissmap.h"
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define N 100000
+
+static unsigned int_hash(const void* a)
+{
+    u32 key = (u32)(*(int*)a);
+    key = (key+0x7ed55d16) + (key<<12);
+    key = (key^0xc761c23c) ^ (key>>19);
+    key = (key+0x165667b1) + (key<<5);
+    key = (key+0xd3a2646c) ^ (key<<9);
+    key = (key+0xfd7046c5) + (key<<3);
+    key = (key^0xb55a4f09) ^ (key>>16);
+    return key;
+}
+
+/* every key in one group chain, only the tags tell them apart */
+static unsigned bad_hash(const void* a)
+{
+    return (u32)(*(int*)a) & 0x7F;
+}
+
+static int int_cmp(const void* a, const void* b)
+{
+    return *(int*)a - *(int*)b;
+}
+
+static void* int_dup(const void* key)
+{
+    int* res = (int*)malloc(sizeof(int));
+    *res = *(int*)key;
+    return res;
+}
+
+static void int_rel(const void* key)
+{
+    free((int*)key);
+}
+
+static void test_map(hash_f hash, int n)
+{
+    swissmap* swmap = swmap_new(hash, &int_cmp, &int_dup, &int_dup,
+                                &int_rel, &int_rel);
+    int k, round;
+    assert(swmap);
+    for(k=0; k<n; k++) {
+        int val = k+1;
+        assert(swmap_insert(swmap, &k, &val));
+        void* v = swmap_find(swmap, &k);
+        assert(v && *(int*)v == val);
+        val = k-1;
+        assert(swmap_insert(swmap, &k, &val));
+        v = swmap_find(swmap, &k);
+        assert(v && *(int*)v == val);
+    }
+    assert(swmap_count(swmap) == (u32)n);
+    for(k=0; k<n; k++) {
+        int miss = -k-1;
+        assert(swmap_find(swmap, &miss) == NULL);
+    }
+    assert(swmap->count + swmap->growth_left <= swmap->capacity / 8 * 7);
+
+    /* churn at a steady size leaves tombstones, the table must not
+       keep growing and must not lose keys */
+    u32 capacity = swmap->capacity;
+    for(round=0; round<4; round++) {
+        for(k=0; k<n; k++) {
+            int old = round * n + k, key = old + n;
+            assert(swmap_erase(swmap, &old));
+            assert(!swmap_erase(swmap, &old));
+            assert(swmap_insert(swmap, &key, &key));
+        }
+        for(k=0; k<n; k++) {
+            int key = (round+1) * n + k;
+            void* v = swmap_find(swmap, &key);
+            assert(v && *(int*)v == key);
+        }
+    }
+    assert(swmap_count(swmap) == (u32)n);
+    assert(swmap->capacity <= capacity * 2);
+    swmap_del(swmap);
+}
+
+int main()
+{
+    test_map(&int_hash, N);
+    test_map(&bad_hash, 2000);
+
+    swissmap* swmap = swmap_new(&int_hash, &int_cmp, &int_dup, &int_dup,
+                                &int_rel, &int_rel);
+    int k;
+    assert(swmap && swmap_reserve(swmap, N));
+    u32 capacity = swmap->capacity;
+    for(k=0; k<N; k++)
+        assert(swmap_insert(swmap, &k, &k));
+    assert(swmap->capacity == capacity);
+    /* beyond what a u32 of slots can hold, it fails untouched */
+    assert(swmap_reserve(swmap, 0xFFFFFFFF) == 0);
+    assert(swmap_reserve(swmap, 0xF0000000) == 0);
+    assert(swmap->capacity == capacity && swmap_count(swmap) == N);
+    swmap_del(swmap);
+    printf("swissmap test ok\n");
+    return 0;
+}